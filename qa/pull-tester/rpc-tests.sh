@@ -53,6 +53,7 @@ testScripts=(
     'mempool_tx_input_limit.py'
     'mempool_nu_activation.py'
     'mempool_tx_expiry.py'
+    'mempool_persist.py'
     'httpbasics.py'
     'zapwallettxes.py'
     'proxy_test.py'
@@ -107,6 +108,7 @@ testScriptsExt=(
     'invalidblockrequest.py'
 #    'forknotify.py'
     'p2p-acceptblock.py'
+    'p2p-blockstall.py'
 );
 
 if [ "x$ENABLE_ZMQ" = "x1" ]; then
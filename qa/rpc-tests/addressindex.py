@@ -135,6 +135,22 @@ class AddressIndexTest(BitcoinTestFramework):
         height_txids = getaddresstxids(1, [addr_p2pkh, addr_p2sh], 1, 5)
         assert_equal(sorted(height_txids), sorted(unspent_txids))
 
+        # paging returns the same txids in the same order, each once
+        def get_pages(method, params, key):
+            rows = []
+            while True:
+                page = getattr(self.nodes[1], method)(params)
+                assert(len(page[key]) <= params['limit'])
+                rows += page[key]
+                if 'cursor' not in page:
+                    return rows
+                params['cursor'] = page['cursor']
+
+        all_txids = self.nodes[1].getaddresstxids({'addresses': [addr_p2pkh, addr_p2sh]})
+        paged_txids = get_pages('getaddresstxids',
+            {'addresses': [addr_p2pkh, addr_p2sh], 'limit': 7}, 'txids')
+        assert_equal(paged_txids, all_txids)
+
         # do some transfers, make sure balances are good
         txids_a1 = []
         addr1 = self.nodes[1].getnewaddress()
@@ -228,6 +244,8 @@ class AddressIndexTest(BitcoinTestFramework):
             # the value 4 UTXO is no longer in our balance
             check_balance(i, addr1, (expected - 4) * COIN, expected * COIN)
             check_balance(i, addr2, 3 * COIN)
+            assert_equal(node.getaddressbalance(addr1)['txcount'], len(txids_a1))
+            assert_equal(node.getaddressbalance(addr2)['txcount'], 1)
 
             assert_equal(node.getblockcount(), 111)
             node.invalidateblock(tip['hash'])
@@ -238,6 +256,8 @@ class AddressIndexTest(BitcoinTestFramework):
 
             check_balance(i, addr1, expected * COIN)
             check_balance(i, addr2, 0)
+            assert_equal(node.getaddressbalance(addr1)['txcount'], len(txids_a1) - 1)
+            assert_equal(node.getaddressbalance(addr2)['txcount'], 0)
 
         # now re-mine the addr1 to addr2 send
         self.nodes[0].generate(1)
@@ -317,6 +337,16 @@ class AddressIndexTest(BitcoinTestFramework):
         block_hash = self.nodes[1].getblockhash(111)
         assert_equal(deltas_info['end']['hash'], block_hash)
 
+        # deltas and utxos in pages of 2
+        deltas = self.nodes[1].getaddressdeltas({'addresses': [addr1, addr2]})
+        paged_deltas = get_pages('getaddressdeltas',
+            {'addresses': [addr1, addr2], 'limit': 2}, 'deltas')
+        assert_equal(paged_deltas, deltas)
+        utxos = self.nodes[1].getaddressutxos({'addresses': [addr1, addr2]})
+        paged_utxos = get_pages('getaddressutxos',
+            {'addresses': [addr1, addr2], 'limit': 2}, 'utxos')
+        assert_equal(sorted(paged_utxos), sorted(utxos))
+
         # Test getaddressutxos by comparing results with deltas
         utxos = self.nodes[1].getaddressutxos(addr1)
 
@@ -70,11 +70,23 @@ class dPoS_PositiveTest(dPoS_BaseTest):
                 txs = {tx["hash"] for tx in node.i_listtransactions()}
                 assert_equal(len(txs), 2)
                 assert_equal(txs, {tx, ztx[0]["result"]["txid"]})
+                # the commit log answers the same, and lists only what was committed after a sequence number
+                for txid in txs:
+                    assert_equal(node.i_gettransactioncommit(txid)["committed"], True)
+                log = node.i_listtransactioncommits()
+                assert(txs <= {commit["txid"] for commit in log["commits"]})
+                assert_equal(node.i_listtransactioncommits(log["sequence"])["commits"], [])
+                assert_equal(node.i_gettransactioncommit("00" * 32)["committed"], False)
             self.nodes[self.num_nodes - n - 1].generate(1)
             time.sleep(2)
             self.sync_all()
             blockCount = blockCount + 1
             self.check_nodes_block_count(blockCount)
+        # the commits of votings which left the guarantee window are logged as removals
+        for node in self.nodes:
+            log = node.i_listtransactioncommits()
+            assert_equal(log["complete"], True)
+            assert(any(commit["removed"] for commit in log["commits"]))
 
     def check_mix_txs(self):
         for n in range(self.num_nodes):
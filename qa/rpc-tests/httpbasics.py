@@ -13,6 +13,8 @@ from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal, start_nodes
 
 import base64
+import json
+from decimal import Decimal
 
 try:
     import http.client as httplib
@@ -100,5 +102,45 @@ class HTTPBasicsTest (BitcoinTestFramework):
         assert_equal('"error":null' in out1, True)
         assert_equal(conn.sock!=None, True) # connection must be closed because bitcoind should use keep-alive by default
 
+        ###############################################
+        # batch replies come back in request order    #
+        ###############################################
+        batch = [{"method": "getblockhash", "params": [i % 201], "id": i} for i in range(100)]
+        batch.append({"method": "nosuchmethod", "params": [], "id": "last"})
+        conn.request('POST', '/', json.dumps(batch), headers)
+        out1 = json.loads(conn.getresponse().read())
+        assert_equal(len(out1), 101)
+        for i in range(100):
+            assert_equal(out1[i]["id"], i)
+            assert_equal(out1[i]["result"], self.nodes[2].getblockhash(i % 201))
+        assert_equal(out1[100]["id"], "last")
+        assert_equal(out1[100]["error"]["code"], -32601)
+
+        # batches with wallet commands run in order
+        batch = []
+        for i in range(20):
+            batch.append({"method": "settxfee", "params": [0.0001 * (i + 1)], "id": 2 * i})
+            batch.append({"method": "getwalletinfo", "params": [], "id": 2 * i + 1})
+        conn.request('POST', '/', json.dumps(batch), headers)
+        out1 = json.loads(conn.getresponse().read(), parse_float=Decimal)
+        for i in range(20):
+            assert_equal(out1[2 * i + 1]["result"]["paytxfee"], Decimal("0.0001") * (i + 1))
+
+        ###############################################
+        # requests are spread over the work lanes     #
+        ###############################################
+        self.nodes[2].gettxoutsetinfo()
+        self.nodes[2].getbestblockhash()
+        lanes = dict((l["lane"], l) for l in self.nodes[2].getrpcqueueinfo())
+        assert_equal(sorted(lanes.keys()), ["fast", "heavy", "wallet"])
+        # An item counts as processed once its worker is done with it, which
+        # may be just after the reply went out.
+        assert(lanes["heavy"]["processed"] + lanes["heavy"]["running"] >= 1)
+        assert(lanes["fast"]["processed"] >= 1)
+        assert_equal(lanes["fast"]["rejected"], 0)
+        for lane in lanes.values():
+            assert(lane["threads"] >= 1)
+            assert(lane["max_wait_us"] >= lane["avg_wait_us"])
+
 if __name__ == '__main__':
     HTTPBasicsTest().main()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+# Copyright (c) 2019 The Crypticcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test mempool persistence across restarts.
+#
+# Node 1 sends transactions which are relayed to node 0. Node 0 is then
+# restarted without any peers:
+# - with the default -persistmempool it gets the transactions back from
+#   mempool.dat;
+# - with -persistmempool=0 it starts with an empty mempool.
+#
+
+import sys; assert sys.version_info < (3,), ur"This script does not run under Python 3. Please use Python 2.7.x."
+
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, start_node, stop_node, \
+    connect_nodes_bi, sync_mempools
+
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def setup_network(self, split=False):
+        self.nodes = []
+        self.nodes.append(start_node(0, self.options.tmpdir, ["-debug=mempool"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug=mempool"]))
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def wait_for_mempool_size(self, node, size, timeout=60):
+        for _ in range(timeout * 10):
+            if node.getmempoolinfo()['size'] == size:
+                break
+            time.sleep(0.1)
+        assert_equal(node.getmempoolinfo()['size'], size)
+
+    def run_test(self):
+        node1_address = self.nodes[1].getnewaddress()
+        txids = [ self.nodes[1].sendtoaddress(node1_address, 1) for _ in range(5) ]
+        sync_mempools(self.nodes)
+        assert_equal(len(self.nodes[0].getrawmempool()), 5)
+
+        # Restart node 0 alone, the mempool is loaded back from disk
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-debug=mempool"])
+        self.wait_for_mempool_size(self.nodes[0], 5)
+        assert_equal(set(self.nodes[0].getrawmempool()), set(txids))
+
+        # Restart node 0 with -persistmempool=0, the mempool stays empty
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ["-persistmempool=0"])
+        time.sleep(2)
+        assert_equal(len(self.nodes[0].getrawmempool()), 0)
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
@@ -64,5 +64,24 @@ class NodeHandlingTest (BitcoinTestFramework):
                 found = True
         assert(found)
 
+        ###########################################
+        # per message type traffic and timing     #
+        ###########################################
+        for node in self.nodes[0].getpeerinfo():
+            assert_equal(node['sent_per_msg']['version']['count'], 1)
+            assert_equal(node['recv_per_msg']['version']['count'], 1)
+            assert(node['recv_per_msg']['verack']['bytes'] >= 24) # message header only
+            assert(node['recv_per_msg']['version']['handlertime'] >= 0)
+        totals = self.nodes[0].getnettotals()
+        assert(totals['recv_per_msg']['version']['count'] >= 2)
+        assert(sum(msg['bytes'] for msg in totals['recv_per_msg'].values()) <= totals['totalbytesrecv'])
+
+        ###########################################
+        # adaptive block download window          #
+        ###########################################
+        for node in self.nodes[0].getpeerinfo():
+            assert(2 <= node['inflight_limit'] <= 64)
+            assert(node['block_delivery_time'] >= 0)
+
 if __name__ == '__main__':
     NodeHandlingTest ().main ()
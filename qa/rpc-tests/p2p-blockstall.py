@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+#
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+#
+
+import sys; assert sys.version_info < (3,), ur"This script does not run under Python 3. Please use Python 2.7.x."
+
+from test_framework.mininode import CBlockHeader, NodeConn, NodeConnCB, \
+    NetworkThread, msg_headers, mininode_lock
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, initialize_chain_clean, \
+    start_nodes, connect_nodes, p2p_port, hex_str_to_bytes, log_filename
+
+import cStringIO
+import time
+
+'''
+BlockStallTest -- test that a peer holding back the block download window
+is detected and the download moves on without it.
+
+Setup: node0 and node1 start on a clean chain, not connected to each other.
+Node1 mines more blocks than fit in one download window (1024).
+
+1. A mininode peer announces node1's headers to node0 but never answers a
+   getdata, so the first blocks of the chain stay in flight from it.
+
+2. Node0 connects to node1 and downloads the rest of the window from it.
+   The blocks held by the mininode now stall the window. Node0 must request
+   them from node1 again instead of disconnecting the staller, and end up on
+   node1's tip with the staller still connected.
+'''
+
+# Longer than BLOCK_DOWNLOAD_WINDOW, so the window end is reached.
+CHAIN_LENGTH = 1100
+# Headers per message (MAX_HEADERS_RESULTS).
+HEADERS_PER_MESSAGE = 160
+
+# StallingNode: announces headers and silently ignores every getdata.
+class StallingNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.requested = set()
+        self.disconnected = False
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def on_getdata(self, conn, message):
+        for inv in message.inv:
+            self.requested.add(inv.hash)
+
+    def on_close(self, conn):
+        self.disconnected = True
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+
+class BlockStallTest(BitcoinTestFramework):
+    def setup_chain(self):
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir,
+                                 extra_args=[['-debug'], ['-debug']])
+        self.is_network_split = True
+
+    def get_header(self, node, blockhash):
+        header = CBlockHeader()
+        header.deserialize(cStringIO.StringIO(hex_str_to_bytes(node.getblockheader(blockhash, False))))
+        header.calc_sha256()
+        return header
+
+    def run_test(self):
+        self.nodes[1].generate(CHAIN_LENGTH)
+        tip = self.nodes[1].getbestblockhash()
+
+        staller = StallingNode()
+        staller.add_connection(NodeConn('127.0.0.1', p2p_port(0), self.nodes[0], staller))
+        NetworkThread().start()
+        staller.wait_for_verack()
+
+        # 1. Announce the whole chain from the staller.
+        headers = [self.get_header(self.nodes[1], self.nodes[1].getblockhash(height))
+                   for height in range(1, CHAIN_LENGTH + 1)]
+        for i in range(0, len(headers), HEADERS_PER_MESSAGE):
+            message = msg_headers()
+            message.headers = headers[i:i + HEADERS_PER_MESSAGE]
+            staller.send_message(message)
+
+        timeout = 30
+        while timeout > 0:
+            with mininode_lock:
+                if len(staller.requested) > 0:
+                    break
+            time.sleep(0.5)
+            timeout -= 0.5
+        with mininode_lock:
+            requested = set(staller.requested)
+        assert(len(requested) > 0)
+        assert_equal(self.nodes[0].getblockcount(), 0)
+        print "Staller was asked for %d blocks" % len(requested)
+
+        # 2. Node0 must reach node1's tip despite the staller.
+        connect_nodes(self.nodes[0], 1)
+        timeout = 120
+        while timeout > 0 and self.nodes[0].getbestblockhash() != tip:
+            time.sleep(1)
+            timeout -= 1
+        assert_equal(self.nodes[0].getbestblockhash(), tip)
+
+        # The staller was kept, and every block it held was fetched from node1
+        with mininode_lock:
+            assert(not staller.disconnected)
+        assert_equal(len(self.nodes[0].getpeerinfo()), 2)
+        with open(log_filename(self.options.tmpdir, 0, "debug.log")) as f:
+            debug_log = f.read()
+        assert("is stalling block download" not in debug_log)
+        for blockhash in requested:
+            assert("Reassigning block %064x" % blockhash in debug_log)
+        print "Synced past the stalled window, %d blocks reassigned from the staller" % len(requested)
+
+if __name__ == '__main__':
+    BlockStallTest().main()
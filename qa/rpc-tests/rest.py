@@ -13,6 +13,7 @@ from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal, assert_greater_than, \
     initialize_chain_clean, start_nodes, connect_nodes_bi
 
+import os
 import struct
 import binascii
 import json
@@ -304,6 +305,37 @@ class RESTTest (BitcoinTestFramework):
         assert_equal(hex_string.status, 200)
         assert_greater_than(int(response.getheader('content-length')), 10)
 
+        # get a range of raw blocks straight from disk
+        tip_height = self.nodes[0].getblockcount()
+        raw_blocks = ""
+        for h in range(tip_height - 4, tip_height + 1):
+            raw_blocks += binascii.unhexlify(self.nodes[0].getblock(str(h), 0))
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip_height - 4)+'/5'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(int(response.getheader('content-length')), len(raw_blocks))
+        assert_equal(response.read(), raw_blocks)
+
+        # the count is capped at the tip, and byte ranges can be requested on one connection
+        conn = httplib.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/blocks/'+str(tip_height - 4)+'/100'+self.FORMAT_SEPARATOR+'bin', headers={'Range': 'bytes=10-'})
+        response = conn.getresponse()
+        assert_equal(response.status, 206)
+        assert_equal(response.getheader('content-range'), 'bytes 10-%d/%d' % (len(raw_blocks) - 1, len(raw_blocks)))
+        assert_equal(response.read(), raw_blocks[10:])
+        conn.request('GET', '/rest/blocks/'+str(tip_height - 4)+'/5'+self.FORMAT_SEPARATOR+'bin', headers={'Range': 'bytes=-20'})
+        response = conn.getresponse()
+        assert_equal(response.status, 206)
+        assert_equal(response.read(), raw_blocks[-20:])
+        conn.request('GET', '/rest/blocks/0/1'+self.FORMAT_SEPARATOR+'bin', headers={'Range': 'bytes=100000000-'})
+        response = conn.getresponse()
+        assert_equal(response.status, 416)
+        response.read()
+
+        # several transactions in one reply
+        response = http_get_call(url.hostname, url.port, '/rest/txs/'+tx_hash+','+tx_hash+self.FORMAT_SEPARATOR+'hex', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.read().split(), [self.nodes[0].getrawtransaction(tx_hash)] * 2)
+
 
 
         # check block tx details
@@ -351,5 +383,37 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(json_string)
         assert_equal(json_obj['bestblockhash'], bb_hash)
 
+        # a /rest/blocks reply that fails after its headers were sent closes
+        # the connection instead of leaving the client waiting for the body.
+        # Cut the last byte of node2's tip block off its block file, so the
+        # block sizes can still be read but the tip block data cannot.
+        tip_height = self.nodes[2].getblockcount()
+        raw_blocks = ""
+        for h in range(tip_height - 4, tip_height + 1):
+            raw_blocks += binascii.unhexlify(self.nodes[2].getblock(str(h), 0))
+        blk_path = os.path.join(self.options.tmpdir, "node2", "regtest", "blocks", "blk00000.dat")
+        with open(blk_path, "r+b") as f:
+            data_end = 0
+            while True:
+                f.seek(data_end)
+                record = f.read(8)
+                if len(record) < 8 or record[:4] == b"\0" * 4:
+                    break
+                data_end += 8 + struct.unpack("<I", record[4:])[0]
+            f.truncate(data_end - 1)
+        url2 = urlparse.urlparse(self.nodes[2].url)
+        conn = httplib.HTTPConnection(url2.hostname, url2.port)
+        conn.request('GET', '/rest/blocks/'+str(tip_height - 4)+'/5'+self.FORMAT_SEPARATOR+'bin')
+        response = conn.getresponse()
+        assert_equal(response.status, 200)
+        assert_equal(int(response.getheader('content-length')), len(raw_blocks))
+        try:
+            response.read()
+            raise AssertionError("truncated /rest/blocks reply was not cut short")
+        except httplib.IncompleteRead as e:
+            assert(raw_blocks.startswith(e.partial))
+        # the node itself keeps serving requests
+        assert_equal(self.nodes[2].getblockcount(), tip_height)
+
 if __name__ == '__main__':
     RESTTest().main()
@@ -18,15 +18,20 @@ import struct
 class ZMQTest(BitcoinTestFramework):
 
     port = 28332
+    dposTopics = [b"dposviceblock", b"dposroundquorum", b"dposinstanttx"]
 
     def setup_nodes(self):
         self.zmqContext = zmq.Context()
         self.zmqSubSocket = self.zmqContext.socket(zmq.SUB)
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
+        for topic in self.dposTopics:
+            self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, topic)
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        address = 'tcp://127.0.0.1:' + str(self.port)
         return start_nodes(4, self.options.tmpdir, extra_args=[
-            ['-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port), '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port)],
+            ['-zmqpubhashtx=' + address, '-zmqpubhashblock=' + address] +
+            ['-zmqpub' + topic + '=' + address for topic in self.dposTopics],
             [],
             [],
             []
@@ -92,6 +97,17 @@ class ZMQTest(BitcoinTestFramework):
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        # dPoS is not active without masternodes, so the dPoS topics stay silent
+        # while blocks and transactions are published next to them
+        self.nodes[1].generate(1)
+        self.sync_all()
+        topics = []
+        while self.zmqSubSocket.poll(2000):
+            topics.append(self.zmqSubSocket.recv_multipart()[0])
+        assert(b"hashblock" in topics)
+        for topic in self.dposTopics:
+            assert(topic not in topics)
+
 
 if __name__ == '__main__':
     ZMQTest ().main ()
@@ -10,7 +10,7 @@ AMQPAbstractNotifier::~AMQPAbstractNotifier()
 {
 }
 
-bool AMQPAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool AMQPAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/, const CDiskBlockPos & /*pos*/)
 {
     return true;
 }
@@ -19,3 +19,27 @@ bool AMQPAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool AMQPAbstractNotifier::NotifyTransactions(const std::vector<CTransaction> &vtx)
+{
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!NotifyTransaction(vtx[i]))
+            return false;
+    }
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyViceBlock(const uint256 &/*hash*/, const uint256 &/*tip*/, uint32_t /*nRound*/)
+{
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyRoundQuorum(const uint256 &/*tip*/, uint32_t /*nRound*/, const uint256 &/*viceBlockHash*/, size_t /*nVotes*/)
+{
+    return true;
+}
+
+bool AMQPAbstractNotifier::NotifyTxCommitted(const uint256 &/*txid*/, const uint256 &/*tip*/)
+{
+    return true;
+}
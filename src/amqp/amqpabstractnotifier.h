@@ -7,7 +7,10 @@
 
 #include "amqpconfig.h"
 
+#include <vector>
+
 class CBlockIndex;
+struct CDiskBlockPos;
 class AMQPAbstractNotifier;
 
 typedef AMQPAbstractNotifier* (*AMQPNotifierFactory)();
@@ -32,8 +35,14 @@ public:
     virtual bool Initialize() = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** New tip, pos is where the block is stored, read under cs_main when it was queued */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Transactions that were queued together, by default notified one by one */
+    virtual bool NotifyTransactions(const std::vector<CTransaction> &vtx);
+    virtual bool NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+    virtual bool NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+    virtual bool NotifyTxCommitted(const uint256 &txid, const uint256 &tip);
 
 protected:
     std::string type;
@@ -7,21 +7,20 @@
 
 #include "version.h"
 #include "main.h"
+#include "notificationqueue.h"
 #include "streams.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+
 // AMQP 1.0 Support
 //
 // The boost::signals2 signals and slot system is thread safe, so CValidationInterface listeners
 // can be invoked from any thread.
 //
-// Currently signals are fired from main.cpp so the callbacks should be invoked on the same thread.
-// It should be safe to share objects responsible for sending, as they should not be run concurrently
-// across different threads.
-//
-// Developers should be mindful of where notifications are fired to avoid potential race conditions.
-// For example, different signals targeting the same address could be fired from different threads
-// in different parts of the system around the same time.
+// The callbacks only queue the notifications, they are sent from the publisher thread of the
+// notification queue. That thread is the only one using the objects responsible for sending, so
+// they are never run concurrently.
 //
 // Like the ZMQ notification interface, if a notifier fails to send a message, the notifier is shut down.
 //
@@ -49,6 +48,9 @@ AMQPNotificationInterface* AMQPNotificationInterface::CreateWithArguments(const
     factories["pubhashtx"] = AMQPAbstractNotifier::Create<AMQPPublishHashTransactionNotifier>;
     factories["pubrawblock"] = AMQPAbstractNotifier::Create<AMQPPublishRawBlockNotifier>;
     factories["pubrawtx"] = AMQPAbstractNotifier::Create<AMQPPublishRawTransactionNotifier>;
+    factories["pubdposviceblock"] = AMQPAbstractNotifier::Create<AMQPPublishViceBlockNotifier>;
+    factories["pubdposroundquorum"] = AMQPAbstractNotifier::Create<AMQPPublishRoundQuorumNotifier>;
+    factories["pubdposinstanttx"] = AMQPAbstractNotifier::Create<AMQPPublishTxCommittedNotifier>;
 
     for (std::map<std::string, AMQPNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i) {
         std::map<std::string, std::string>::const_iterator j = args.find("-amqp" + i->first);
@@ -95,6 +97,13 @@ bool AMQPNotificationInterface::Initialize()
         return false;
     }
 
+    queue.reset(new CNotificationQueue("amqp",
+        boost::bind(&AMQPNotificationInterface::PublishTransactions, this, _1),
+        GetArg("-notifyqueuesize", DEFAULT_NOTIFY_QUEUE_SIZE),
+        GetArg("-notifytxbatch", DEFAULT_NOTIFY_TX_BATCH),
+        GetBoolArg("-notifyqueueblock", DEFAULT_NOTIFY_QUEUE_BLOCK)));
+    queue->Start();
+
     return true;
 }
 
@@ -103,6 +112,12 @@ void AMQPNotificationInterface::Shutdown()
 {
     LogPrint("amqp", "amqp: Shutdown notification interface\n");
 
+    if (queue) {
+        // Publish what is still queued before the connections go away
+        queue->Stop();
+        queue.reset();
+    }
+
     for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ++i) {
         AMQPAbstractNotifier *notifier = *i;
         notifier->Shutdown();
@@ -111,22 +126,46 @@ void AMQPNotificationInterface::Shutdown()
 
 void AMQPNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
 {
-    for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ) {
-        AMQPAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex)) {
-            i++;
-        } else {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+    // Called without cs_main, take it here so the publisher never needs it
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
     }
+    queue->Push(boost::bind(&AMQPNotificationInterface::PublishBlockTip, this, pindex, pos));
 }
 
 void AMQPNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    queue->PushTransaction(tx);
+}
+
+void AMQPNotificationInterface::DposViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound)
+{
+    queue->Push([this, hash, tip, nRound]() {
+        Publish([&](AMQPAbstractNotifier *notifier) { return notifier->NotifyViceBlock(hash, tip, nRound); });
+    });
+}
+
+void AMQPNotificationInterface::DposRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes)
+{
+    queue->Push([this, tip, nRound, viceBlockHash, nVotes]() {
+        Publish([&](AMQPAbstractNotifier *notifier) { return notifier->NotifyRoundQuorum(tip, nRound, viceBlockHash, nVotes); });
+    });
+}
+
+void AMQPNotificationInterface::DposTxCommitted(const uint256 &txid, const uint256 &tip)
+{
+    queue->Push([this, txid, tip]() {
+        Publish([&](AMQPAbstractNotifier *notifier) { return notifier->NotifyTxCommitted(txid, tip); });
+    });
+}
+
+void AMQPNotificationInterface::Publish(const boost::function<bool(AMQPAbstractNotifier*)> &notify)
 {
     for (std::list<AMQPAbstractNotifier*>::iterator i = notifiers.begin(); i != notifiers.end(); ) {
         AMQPAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx)) {
+        if (notify(notifier)) {
             i++;
         } else {
             notifier->Shutdown();
@@ -134,3 +173,13 @@ void AMQPNotificationInterface::SyncTransaction(const CTransaction &tx, const CB
         }
     }
 }
+
+void AMQPNotificationInterface::PublishBlockTip(const CBlockIndex *pindex, const CDiskBlockPos &pos)
+{
+    Publish([&](AMQPAbstractNotifier *notifier) { return notifier->NotifyBlock(pindex, pos); });
+}
+
+void AMQPNotificationInterface::PublishTransactions(const std::vector<CTransaction> &vtx)
+{
+    Publish([&](AMQPAbstractNotifier *notifier) { return notifier->NotifyTransactions(vtx); });
+}
@@ -8,8 +8,14 @@
 #include "validationinterface.h"
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/function.hpp>
 
 class CBlockIndex;
+struct CDiskBlockPos;
+class CNotificationQueue;
 class AMQPAbstractNotifier;
 
 class AMQPNotificationInterface : public CValidationInterface
@@ -26,11 +32,22 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void DposViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+    void DposRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+    void DposTxCommitted(const uint256 &txid, const uint256 &tip);
 
 private:
     AMQPNotificationInterface();
 
+    // Run on the publisher thread of the queue
+    /** Pass a notification to every notifier, the ones that fail are shut down */
+    void Publish(const boost::function<bool(AMQPAbstractNotifier*)> &notify);
+    void PublishTransactions(const std::vector<CTransaction> &vtx);
+    void PublishBlockTip(const CBlockIndex *pindex, const CDiskBlockPos &pos);
+
     std::list<AMQPAbstractNotifier*> notifiers;
+    //! Notifications waiting to be published, the notifiers are only used from its thread
+    std::unique_ptr<CNotificationQueue> queue;
 };
 
 #endif // CRYPTICCOIN_AMQP_AMQPNOTIFICATIONINTERFACE_H
@@ -4,7 +4,9 @@
 
 #include "amqppublishnotifier.h"
 #include "chainparams.h"
+#include "crypto/common.h"
 #include "main.h"
+#include "notificationformat.h"
 #include "util.h"
 
 #include "amqpsender.h"
@@ -18,6 +20,9 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_DPOSVICEBLOCK   = "dposviceblock";
+static const char *MSG_DPOSROUNDQUORUM = "dposroundquorum";
+static const char *MSG_DPOSINSTANTTX   = "dposinstanttx";
 
 // Invoke this method from a new thread to run the proton container event loop.
 void AMQPAbstractPublishNotifier::SpawnProtonContainer()
@@ -129,7 +134,7 @@ bool AMQPAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("amqp", "amqp: Publish hashblock %s\n", hash.GetHex());
@@ -149,16 +154,16 @@ bool AMQPPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool AMQPPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool AMQPPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos)
 {
     LogPrint("amqp", "amqp: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // No cs_main here, validation may be waiting for room in the queue while holding it
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     {
-        LOCK(cs_main);
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams)) {
+        if(!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != pindex->GetBlockHash()) {
             LogPrint("amqp", "amqp: Can't read block from disk");
             return false;
         }
@@ -177,3 +182,32 @@ bool AMQPPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool AMQPPublishViceBlockNotifier::NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound)
+{
+    LogPrint("amqp", "amqp: Publish dposviceblock %s\n", hash.GetHex());
+    unsigned char data[68];
+    unsigned char *p = WriteNotificationHash(data, hash);
+    p = WriteNotificationHash(p, tip);
+    WriteLE32(p, nRound);
+    return SendMessage(MSG_DPOSVICEBLOCK, data, sizeof(data));
+}
+
+bool AMQPPublishRoundQuorumNotifier::NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes)
+{
+    LogPrint("amqp", "amqp: Publish dposroundquorum %s\n", viceBlockHash.GetHex());
+    unsigned char data[72];
+    unsigned char *p = WriteNotificationHash(data, viceBlockHash);
+    p = WriteNotificationHash(p, tip);
+    WriteLE32(p, nRound);
+    WriteLE32(p + 4, (uint32_t)nVotes);
+    return SendMessage(MSG_DPOSROUNDQUORUM, data, sizeof(data));
+}
+
+bool AMQPPublishTxCommittedNotifier::NotifyTxCommitted(const uint256 &txid, const uint256 &tip)
+{
+    LogPrint("amqp", "amqp: Publish dposinstanttx %s\n", txid.GetHex());
+    unsigned char data[64];
+    WriteNotificationHash(WriteNotificationHash(data, txid), tip);
+    return SendMessage(MSG_DPOSINSTANTTX, data, sizeof(data));
+}
@@ -32,7 +32,7 @@ public:
 class AMQPPublishHashBlockNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
 };
 
 class AMQPPublishHashTransactionNotifier : public AMQPAbstractPublishNotifier
@@ -44,7 +44,7 @@ public:
 class AMQPPublishRawBlockNotifier : public AMQPAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
 };
 
 class AMQPPublishRawTransactionNotifier : public AMQPAbstractPublishNotifier
@@ -53,4 +53,22 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class AMQPPublishViceBlockNotifier : public AMQPAbstractPublishNotifier
+{
+public:
+    bool NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+};
+
+class AMQPPublishRoundQuorumNotifier : public AMQPAbstractPublishNotifier
+{
+public:
+    bool NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+};
+
+class AMQPPublishTxCommittedNotifier : public AMQPAbstractPublishNotifier
+{
+public:
+    bool NotifyTxCommitted(const uint256 &txid, const uint256 &tip);
+};
+
 #endif // CRYPTICCOIN_AMQP_AMQPPUBLISHNOTIFIER_H
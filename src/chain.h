@@ -17,6 +17,11 @@
 static const int SPROUT_VALUE_VERSION = 1001400;
 static const int SAPLING_VALUE_VERSION = 1010100;
 
+struct BlockHasher
+{
+    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+};
+
 class CBlockFileInfo
 {
 public:
@@ -548,4 +553,47 @@ public:
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
 };
 
+/**
+ * Immutable view of a chain, given by its tip. Index entries are never
+ * changed in ways visible here once they are linked in, so a snapshot can be
+ * read from any thread without locks. Lookups by height walk the skip list.
+ */
+class CChainSnapshot {
+private:
+    const CBlockIndex *tip;
+
+public:
+    explicit CChainSnapshot(const CBlockIndex *pindexTip = NULL) : tip(pindexTip) {}
+
+    /** Returns the index entry for the tip of this chain, or NULL if none. */
+    const CBlockIndex *Tip() const {
+        return tip;
+    }
+
+    /** Return the maximal height in the chain, -1 if empty. */
+    int Height() const {
+        return tip ? tip->nHeight : -1;
+    }
+
+    /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
+    const CBlockIndex *operator[](int nHeight) const {
+        if (nHeight < 0 || nHeight > Height())
+            return NULL;
+        return tip->GetAncestor(nHeight);
+    }
+
+    /** Check whether a block is present in this chain. */
+    bool Contains(const CBlockIndex *pindex) const {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in this chain, or NULL if the given index is not found or is the tip. */
+    const CBlockIndex *Next(const CBlockIndex *pindex) const {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return NULL;
+    }
+};
+
 #endif // BITCOIN_CHAIN_H
@@ -1,7 +1,85 @@
 #include <gtest/gtest.h>
 #include "../masternodes/dpos_controller.h"
+#include "../masternodes/dpos_p2p_messages.h"
+#include "../pubkey.h"
+#include "../streams.h"
+#include "../version.h"
 
 TEST(dPoS, getController)
 {
     EXPECT_TRUE(dpos::getController() != nullptr);
 }
+
+TEST(dPoS, ApprovedBlockReconstruct)
+{
+    CBlock viceBlock{};
+    viceBlock.nBits = 1;
+    viceBlock.nRound = 1;
+    CMutableTransaction mtx{};
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    viceBlock.vtx.push_back(mtx);
+    viceBlock.hashMerkleRoot = viceBlock.BuildMerkleTree();
+
+    CBlock approved{viceBlock};
+    approved.vSig.assign(2 * CPubKey::COMPACT_SIGNATURE_SIZE, 0x01);
+
+    CDataStream ss{SER_NETWORK, PROTOCOL_VERSION};
+    ss << dpos::CApprovedBlock_p2p{approved};
+    dpos::CApprovedBlock_p2p received{};
+    ss >> received;
+    EXPECT_EQ(received.GetHash(), approved.GetHash());
+
+    CBlock block{};
+    ASSERT_TRUE(received.reconstruct(viceBlock, block));
+    EXPECT_EQ(block.GetHash(), approved.GetHash());
+    EXPECT_EQ(block.vSig, approved.vSig);
+    ASSERT_EQ(block.vtx.size(), 1u);
+    EXPECT_EQ(block.vtx[0].GetHash(), viceBlock.vtx[0].GetHash());
+
+    // A vice-block of another round doesn't match
+    CBlock otherViceBlock{viceBlock};
+    otherViceBlock.nRound = 2;
+    EXPECT_FALSE(received.reconstruct(otherViceBlock, block));
+}
+
+TEST(dPoS, CommitLogRemovals)
+{
+    dpos::CCommitLog commitLog{2};
+    const BlockHash tip = uint256S("0xB101");
+    for (uint64_t i = 1; i <= 3; i++) {
+        commitLog.add(ArithToUint256(arith_uint256{i}), tip, 0);
+    }
+    ASSERT_TRUE(commitLog.get(ArithToUint256(arith_uint256{1})));
+
+    // Three removals with room for two, the first one is forgotten
+    commitLog.removeExcept({}, 0);
+    EXPECT_FALSE(commitLog.get(ArithToUint256(arith_uint256{1})));
+
+    uint64_t nLastSequence = 0;
+    bool fComplete = false;
+    auto entries = commitLog.listSince(0, &nLastSequence, &fComplete);
+    EXPECT_EQ(nLastSequence, 6u);
+    EXPECT_TRUE(fComplete);
+    ASSERT_EQ(entries.size(), 2u);
+    EXPECT_EQ(entries[0].nSequence, 5u);
+    EXPECT_EQ(entries[0].txid, ArithToUint256(arith_uint256{2}));
+    EXPECT_TRUE(entries[0].fRemoved);
+    EXPECT_EQ(entries[1].nSequence, 6u);
+
+    // The removal at 4 is gone, a client that saw the commits only has to start over
+    commitLog.listSince(3, nullptr, &fComplete);
+    EXPECT_FALSE(fComplete);
+    entries = commitLog.listSince(4, nullptr, &fComplete);
+    EXPECT_TRUE(fComplete);
+    EXPECT_EQ(entries.size(), 2u);
+
+    // Commits logged again after their removal get new sequence numbers
+    commitLog.add(ArithToUint256(arith_uint256{1}), tip, 0);
+    entries = commitLog.listSince(6, &nLastSequence, &fComplete);
+    EXPECT_TRUE(fComplete);
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].nSequence, 7u);
+    EXPECT_FALSE(entries[0].fRemoved);
+    EXPECT_EQ(nLastSequence, 7u);
+}
@@ -68,6 +68,9 @@ TEST(dPoS, DummyEmptyBlock)
     dpos::CDposVoter::Output res;
     for (uint64_t i = 0; i < 23u; i++) {
         res += voters[i].applyViceBlock(viceBlock);
+        ASSERT_EQ(res.vViceBlocks.size(), i + 1);
+        ASSERT_EQ(res.vViceBlocks[i].hash, viceBlock.GetHash());
+        ASSERT_EQ(res.vViceBlocks[i].tip, tip);
 
         ASSERT_EQ(voters[i].v.size(), 1u);
         ASSERT_EQ(voters[i].txs.size(), 0u);
@@ -95,6 +98,11 @@ TEST(dPoS, DummyEmptyBlock)
             ASSERT_TRUE(voter0out.blockToSubmit != boost::none);
             ASSERT_EQ(voter0out.blockToSubmit->block.GetHash(), viceBlock.GetHash());
             ASSERT_EQ(voter0out.blockToSubmit->vApprovedBy.size(), 23u);
+            ASSERT_EQ(voter0out.vRoundQuorums.size(), 1u);
+            ASSERT_EQ(voter0out.vRoundQuorums[0].tip, tip);
+            ASSERT_EQ(voter0out.vRoundQuorums[0].nRound, 1u);
+            ASSERT_EQ(voter0out.vRoundQuorums[0].viceBlock, viceBlock.GetHash());
+            ASSERT_EQ(voter0out.vRoundQuorums[0].nVotes, 23u);
         }
         else {
             // not final
@@ -102,6 +110,7 @@ TEST(dPoS, DummyEmptyBlock)
             ASSERT_TRUE(voter0out.vRoundVotes.empty());
             ASSERT_TRUE(voter0out.vErrors.empty());
             ASSERT_FALSE(voter0out.blockToSubmit);
+            ASSERT_TRUE(voter0out.vRoundQuorums.empty());
         }
 
         { // duplicate check
@@ -189,6 +198,9 @@ TEST(dPoS, DummyCommitTx)
         ASSERT_TRUE(voter0out.empty());
         if (i == 23 - 1) {
             // final vote
+            ASSERT_EQ(voter0out.vTxCommits.size(), 1u);
+            ASSERT_EQ(voter0out.vTxCommits[0].txid, tx.GetHash());
+            ASSERT_EQ(voter0out.vTxCommits[0].tip, tip);
             ASSERT_EQ(voters[0].listCommittedTxs(tip).txs.size(), 1u);
             ASSERT_EQ(voters[0].listCommittedTxs(tip).missing.size(), 0u);
             ASSERT_EQ(voters[0].listCommittedTxs(tip).txs[0].GetHash(), tx.GetHash());
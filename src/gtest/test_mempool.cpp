@@ -1,11 +1,13 @@
 #include <gtest/gtest.h>
 #include <gtest/gtest-spi.h>
 
+#include "arith_uint256.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "txadmission.h"
 #include "txmempool.h"
 #include "policy/fees.h"
 #include "util.h"
@@ -318,3 +320,55 @@ TEST(Mempool, ExpiringSoonTxRejection) {
     // Revert to default
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
+
+TEST(Mempool, PrecheckVerdictIsReused) {
+    SelectParams(CBaseChainParams::REGTEST);
+
+    CTxMemPool pool(::minRelayTxFee);
+    bool missingInputs;
+    CTransaction tx(GetValidTransaction());
+
+    // The next block height is 0 since there is no active chain.
+    CValidationState stateCached;
+    stateCached.DoS(100, false, REJECT_INVALID, "bad-precheck");
+    txPrecheckCache.Insert(tx.GetHash(), 0, stateCached);
+    EXPECT_EQ(txPrecheckCache.Size(), 1u);
+
+    CValidationState state1;
+    EXPECT_FALSE(AcceptToMemoryPool(pool, state1, tx, false, &missingInputs, FakeMnTxChecker));
+    EXPECT_EQ(state1.GetRejectReason(), "bad-precheck");
+
+    // The verdict is consumed by the commit stage
+    EXPECT_EQ(txPrecheckCache.Size(), 0u);
+
+    // Verdicts computed for another height are ignored
+    txPrecheckCache.Insert(tx.GetHash(), 1, stateCached);
+    CValidationState state2;
+    EXPECT_FALSE(txPrecheckCache.Take(tx.GetHash(), 0, state2));
+    EXPECT_TRUE(state2.IsValid());
+    EXPECT_EQ(txPrecheckCache.Size(), 0u);
+}
+
+TEST(Mempool, PrecheckCacheEvictsOldestVerdict) {
+    txPrecheckCache.Clear();
+    CValidationState state;
+    const uint256 hashA = uint256S("0a");
+    const uint256 hashB = uint256S("0b");
+
+    // A taken verdict leaves nothing behind that could evict the verdict
+    // inserted for the same hash later on
+    txPrecheckCache.Insert(hashA, 0, state);
+    EXPECT_TRUE(txPrecheckCache.Take(hashA, 0, state));
+    txPrecheckCache.Insert(hashB, 0, state);
+    txPrecheckCache.Insert(hashA, 0, state);
+    for (size_t i = 2; i < MAX_TXPRECHECK_CACHE_SIZE; i++) {
+        txPrecheckCache.Insert(ArithToUint256(arith_uint256(i + 0x100)), 0, state);
+    }
+    EXPECT_EQ(txPrecheckCache.Size(), MAX_TXPRECHECK_CACHE_SIZE);
+
+    txPrecheckCache.Insert(uint256S("0c"), 0, state);
+    EXPECT_EQ(txPrecheckCache.Size(), MAX_TXPRECHECK_CACHE_SIZE);
+    EXPECT_FALSE(txPrecheckCache.Contains(hashB, 0));
+    EXPECT_TRUE(txPrecheckCache.Contains(hashA, 0));
+    txPrecheckCache.Clear();
+}
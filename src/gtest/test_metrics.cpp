@@ -94,6 +94,35 @@ TEST(Metrics, GetLocalSolPS) {
     EXPECT_EQ(1, GetLocalSolPS());
 }
 
+TEST(Metrics, GetLocalSolPSPerThread) {
+    SetMockTime(100);
+    ResetMinerThreadMetrics(2);
+    MinerThreadTimerStart(0);
+    MinerThreadTimerStart(1);
+
+    MinerThreadSolutionChecked(0);
+    MinerThreadSolutionChecked(1);
+    MinerThreadSolutionChecked(1);
+    // Unknown threads are ignored
+    MinerThreadSolutionChecked(2);
+
+    SetMockTime(102);
+    auto rates = GetLocalSolPSPerThread();
+    ASSERT_EQ(2, rates.size());
+    EXPECT_EQ(0.5, rates[0]);
+    EXPECT_EQ(1, rates[1]);
+
+    // Stopped threads keep their average
+    MinerThreadTimerStop(0);
+    SetMockTime(104);
+    rates = GetLocalSolPSPerThread();
+    EXPECT_EQ(0.5, rates[0]);
+    EXPECT_EQ(0.5, rates[1]);
+
+    ResetMinerThreadMetrics(0);
+    EXPECT_TRUE(GetLocalSolPSPerThread().empty());
+}
+
 TEST(Metrics, EstimateNetHeight) {
     auto params = RegtestActivateBlossom(false, 200);
     int64_t blockTimes[400];
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "../masternodes/heartbeat.h"
+
+using Ages = CHeartBeatTracker::Ages;
+
+namespace {
+
+const std::pair<time_ms, time_ms> bounds{100, 300};
+
+// the classification of the original full scan in filterMasternodes()
+bool OriginalFilter(time_ms elapsed, CHeartBeatTracker::AgeFilter ageFilter)
+{
+    const bool recently = elapsed < bounds.first && ageFilter == CHeartBeatTracker::RECENTLY;
+    const bool stale = elapsed >= bounds.first && elapsed < bounds.second && ageFilter == CHeartBeatTracker::STALE;
+    const bool outdated = elapsed > bounds.second && ageFilter == CHeartBeatTracker::OUTDATED;
+    return recently || stale || outdated;
+}
+
+CKeyID MakeKeyId(int n)
+{
+    std::vector<unsigned char> vch(20, 0);
+    vch[0] = n;
+    return CKeyID(uint160(vch));
+}
+
+}
+
+TEST(HeartBeatAges, ClassifyLikeOriginalScan) {
+    const CHeartBeatTracker::AgeFilter filters[] = {CHeartBeatTracker::RECENTLY, CHeartBeatTracker::STALE, CHeartBeatTracker::OUTDATED};
+    for (time_ms elapsed = -10; elapsed <= bounds.second + 10; elapsed++) {
+        const auto age = Ages::classify(elapsed, bounds);
+        for (const auto ageFilter : filters) {
+            EXPECT_EQ(age && *age == ageFilter, OriginalFilter(elapsed, ageFilter)) << "elapsed " << elapsed;
+        }
+    }
+    // exactly at the max period a masternode is neither STALE nor OUTDATED
+    EXPECT_FALSE(Ages::classify(bounds.second, bounds));
+    EXPECT_EQ(*Ages::classify(bounds.second - 1, bounds), CHeartBeatTracker::STALE);
+    EXPECT_EQ(*Ages::classify(bounds.second + 1, bounds), CHeartBeatTracker::OUTDATED);
+}
+
+TEST(HeartBeatAges, IncrementalMatchesFullScan) {
+    const CHeartBeatTracker::AgeFilter filters[] = {CHeartBeatTracker::RECENTLY, CHeartBeatTracker::STALE, CHeartBeatTracker::OUTDATED};
+    // last seen times, announcements are later than some of the heartbeats
+    std::vector<time_ms> vLastSeen{0, 50, 100, 250, 299, 300};
+    const std::vector<time_ms> vAnnounced{0, 0, 150, 0, 0, 301};
+
+    Ages ages;
+    ages.reset(bounds);
+    for (size_t i = 0; i < vLastSeen.size(); i++) {
+        ages.add(MakeKeyId(i), CMasternode::ID{}, vAnnounced[i], vLastSeen[i], 0);
+        vLastSeen[i] = std::max(vLastSeen[i], vAnnounced[i]);
+    }
+
+    for (time_ms now = 0; now <= 1000; now++) {
+        if (now == 500) {
+            // a new heartbeat moves the masternode back to RECENTLY
+            ages.update(MakeKeyId(0), 490, now);
+            vLastSeen[0] = 490;
+        }
+        ages.advance(now);
+        for (const auto ageFilter : filters) {
+            const std::set<CKeyID>& mns = ages.get(ageFilter);
+            for (size_t i = 0; i < vLastSeen.size(); i++) {
+                EXPECT_EQ(mns.count(MakeKeyId(i)) != 0, OriginalFilter(now - vLastSeen[i], ageFilter))
+                    << "masternode " << i << " at " << now;
+            }
+        }
+    }
+}
@@ -3,6 +3,7 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "key_io.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -12,10 +13,28 @@
 #include "ui_interface.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/foreach.hpp>
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** Commands that scan the address indexes or the UTXO set, run in the heavy lane */
+static const char* const HEAVY_RPC_COMMANDS[] = {
+    "getaddressbalance",
+    "getaddressdeltas",
+    "getaddressmempool",
+    "getaddresstxids",
+    "getaddressutxos",
+    "getblockdeltas",
+    "getblockhashes",
+    "getchaintips",
+    "gettxoutsetinfo",
+    "verifychain",
+};
+
+/** Only this much of a request body is looked at to pick its lane */
+static const size_t MAX_RPC_CLASSIFY_SIZE = 64 * 1024;
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
  */
@@ -87,6 +106,59 @@ static bool RPCAuthorized(const std::string& strAuth)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
+/**
+ * Execute a single request, writing the reply as it is produced. Once the
+ * output exceeds a chunk it is sent as a chunked reply, so large results are
+ * never held in memory as a whole. Errors raised before that are thrown as
+ * usual, there is no way to report an error in a reply that is partly sent.
+ */
+static bool JSONRPCExecStreamed(HTTPRequest* req, const JSONRequest& jreq)
+{
+    bool fStarted = false;
+    bool fClientGone = false;
+    JSONWriter writer([req, &fStarted, &fClientGone](std::string& chunk) {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartReply(HTTP_OK);
+            fStarted = true;
+        }
+        // Stop the command, nobody is reading what it produces
+        if (!req->WriteReplyChunk(chunk)) {
+            fClientGone = true;
+            throw std::runtime_error("client stopped reading the reply");
+        }
+    });
+
+    try {
+        // Same layout as JSONRPCReplyObj
+        writer.beginObject();
+        writer.key("result");
+        tableRPC.execute(jreq.strMethod, jreq.params, writer);
+        writer.pushKV("error", NullUniValue);
+        writer.pushKV("id", jreq.id);
+        writer.endObject();
+    } catch (...) {
+        if (!fStarted)
+            throw;
+        if (fClientGone)
+            LogPrint("http", "%s: client went away during %s, reply abandoned\n", __func__, jreq.strMethod);
+        else
+            LogPrintf("%s: %s failed after part of the reply was sent, reply truncated\n", __func__, jreq.strMethod);
+        req->EndReply();
+        return false;
+    }
+
+    writer.pending() += "\n";
+    if (fStarted) {
+        writer.flush();
+        req->EndReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, writer.pending());
+    }
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -126,15 +198,11 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
-
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            return JSONRPCExecStreamed(req, jreq);
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), QueueHTTPTask);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -150,6 +218,41 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Lane of a single command */
+static HTTPWorkLane JSONRPCCommandLane(const std::string& strMethod)
+{
+    BOOST_FOREACH(const char* strHeavy, HEAVY_RPC_COMMANDS) {
+        if (strMethod == strHeavy)
+            return HTTP_LANE_HEAVY;
+    }
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (pcmd && pcmd->category == "wallet")
+        return HTTP_LANE_WALLET;
+    return HTTP_LANE_FAST;
+}
+
+/** Pick the lane of a JSON-RPC request from the methods it names, without
+ * parsing the body. A batch goes to the lane of its most expensive call.
+ */
+static HTTPWorkLane JSONRPCLane(HTTPRequest* req, const std::string &)
+{
+    std::string strBody = req->PeekBody(MAX_RPC_CLASSIFY_SIZE);
+    HTTPWorkLane lane = HTTP_LANE_FAST;
+    size_t pos = 0;
+    while (lane != HTTP_LANE_HEAVY && (pos = strBody.find("\"method\"", pos)) != std::string::npos) {
+        pos = strBody.find_first_not_of(" \t\r\n:", pos + 8);
+        if (pos == std::string::npos || strBody[pos] != '"')
+            continue;
+        size_t end = strBody.find('"', pos + 1);
+        if (end == std::string::npos)
+            break;
+        // Lanes are declared from cheapest to most expensive
+        lane = std::max(lane, JSONRPCCommandLane(strBody.substr(pos + 1, end - pos - 1)));
+        pos = end + 1;
+    }
+    return lane;
+}
+
 static bool InitRPCAuthentication()
 {
     if (mapArgs["-rpcpassword"] == "")
@@ -173,7 +276,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, JSONRPCLane);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -12,6 +12,9 @@
 #include "sync.h"
 #include "ui_interface.h"
 
+#include <deque>
+#include <limits>
+#include <map>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -58,21 +61,76 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
+/** Work item running an arbitrary task on a worker thread */
+class HTTPTask : public HTTPClosure
+{
+public:
+    HTTPTask(const boost::function<void()>& func): func(func)
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    boost::function<void()> func;
+};
+
+/** Work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
+ *
+ * Items are queued in lanes (see HTTPWorkLane). Each lane has its own depth
+ * limit and may occupy at most its thread budget of workers at once; idle
+ * workers take from the first lane that has work and free budget. Within a
+ * lane every client has its own queue and clients are served round robin, so
+ * a client with a long backlog only delays itself. While other clients have
+ * items waiting in a lane, a client may fill at most half of it; a single
+ * client can use the whole lane.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct Entry
+    {
+        WorkItem* item;
+        int64_t nTimeQueued;
+    };
+
+    struct Lane
+    {
+        //! Waiting items per client, only clients with waiting items are present
+        std::map<std::string, std::deque<Entry> > mapClients;
+        //! Clients with waiting items, the front one is served next
+        std::deque<std::string> rotation;
+        size_t nQueued;
+        int nRunning;
+        int nThreads;
+        uint64_t nProcessed;
+        uint64_t nRejected;
+        int64_t nAvgWait;
+        int64_t nMaxWait;
+
+        Lane() : nQueued(0), nRunning(0), nThreads(0), nProcessed(0), nRejected(0), nAvgWait(0), nMaxWait(0) {}
+    };
+
+    //! Lane and client of the item a worker thread is running
+    struct Current
+    {
+        HTTPWorkLane lane;
+        std::string client;
+    };
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    Lane lanes[HTTP_LANE_COUNT];
     bool running;
     size_t maxDepth;
     int numThreads;
+    boost::thread_specific_ptr<Current> current;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -92,30 +150,83 @@ private:
         }
     };
 
+    /** Take the next item to run, if any lane has one and may use another thread.
+     * cs must be held.
+     */
+    bool Next(Entry& entry, HTTPWorkLane& laneOut, std::string& clientOut)
+    {
+        for (int i = 0; i < HTTP_LANE_COUNT; i++) {
+            Lane& lane = lanes[i];
+            if (lane.rotation.empty() || lane.nRunning >= lane.nThreads)
+                continue;
+            clientOut = lane.rotation.front();
+            lane.rotation.pop_front();
+            std::deque<Entry>& queue = lane.mapClients[clientOut];
+            entry = queue.front();
+            queue.pop_front();
+            if (queue.empty())
+                lane.mapClients.erase(clientOut);
+            else
+                lane.rotation.push_back(clientOut);
+            lane.nQueued--;
+            lane.nRunning++;
+
+            int64_t nWait = GetTimeMicros() - entry.nTimeQueued;
+            lane.nAvgWait += (nWait - lane.nAvgWait) / 16;
+            lane.nMaxWait = std::max(lane.nMaxWait, nWait);
+            laneOut = (HTTPWorkLane)i;
+            return true;
+        }
+        return false;
+    }
+
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
                                  numThreads(0)
     {
+        for (int i = 0; i < HTTP_LANE_COUNT; i++)
+            lanes[i].nThreads = std::numeric_limits<int>::max();
     }
     /*( Precondition: worker threads have all stopped
      * (call WaitExit)
      */
     ~WorkQueue()
     {
-        while (!queue.empty()) {
-            delete queue.front();
-            queue.pop_front();
+        for (int i = 0; i < HTTP_LANE_COUNT; i++) {
+            typename std::map<std::string, std::deque<Entry> >::iterator it;
+            for (it = lanes[i].mapClients.begin(); it != lanes[i].mapClients.end(); ++it) {
+                BOOST_FOREACH(const Entry& entry, it->second)
+                    delete entry.item;
+            }
         }
     }
+    /** Limit the number of workers that may run items of a lane at once */
+    void SetThreadBudget(HTTPWorkLane lane, int nThreads)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        lanes[lane].nThreads = std::max(nThreads, 1);
+        cond.notify_all();
+    }
     /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    bool Enqueue(WorkItem* item, HTTPWorkLane laneId = HTTP_LANE_FAST, const std::string& client = "")
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        Lane& lane = lanes[laneId];
+        typename std::map<std::string, std::deque<Entry> >::iterator it = lane.mapClients.find(client);
+        size_t nClientQueued = it == lane.mapClients.end() ? 0 : it->second.size();
+        bool fOthersQueued = lane.mapClients.size() > (nClientQueued > 0 ? 1 : 0);
+        if (lane.nQueued >= maxDepth || (fOthersQueued && nClientQueued >= std::max(maxDepth / 2, (size_t)1))) {
+            lane.nRejected++;
             return false;
         }
-        queue.push_back(item);
+        Entry entry;
+        entry.item = item;
+        entry.nTimeQueued = GetTimeMicros();
+        if (nClientQueued == 0)
+            lane.rotation.push_back(client);
+        lane.mapClients[client].push_back(entry);
+        lane.nQueued++;
         cond.notify_one();
         return true;
     }
@@ -123,21 +234,39 @@ public:
     void Run()
     {
         ThreadCounter count(*this);
+        current.reset(new Current());
         while (running) {
-            WorkItem* i = 0;
+            Entry entry;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && !Next(entry, current->lane, current->client))
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
-                queue.pop_front();
             }
-            (*i)();
-            delete i;
+            (*entry.item)();
+            delete entry.item;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                Lane& lane = lanes[current->lane];
+                lane.nRunning--;
+                lane.nProcessed++;
+                // Freed budget in this lane may let another worker pick up work
+                cond.notify_one();
+            }
         }
     }
+    /** Lane and client of the item the calling worker thread is running.
+     * Returns false if not called from a worker thread.
+     */
+    bool GetCurrent(HTTPWorkLane& lane, std::string& client)
+    {
+        if (!current.get())
+            return false;
+        lane = current->lane;
+        client = current->client;
+        return true;
+    }
     /** Interrupt and exit loops */
     void Interrupt()
     {
@@ -157,20 +286,46 @@ public:
     size_t Depth()
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
+        size_t nDepth = 0;
+        for (int i = 0; i < HTTP_LANE_COUNT; i++)
+            nDepth += lanes[i].nQueued;
+        return nDepth;
+    }
+
+    /** Return the statistics of all lanes */
+    std::vector<HTTPWorkLaneStats> Stats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::vector<HTTPWorkLaneStats> vStats(HTTP_LANE_COUNT);
+        for (int i = 0; i < HTTP_LANE_COUNT; i++) {
+            const Lane& lane = lanes[i];
+            HTTPWorkLaneStats& stats = vStats[i];
+            stats.lane = (HTTPWorkLane)i;
+            stats.nQueued = lane.nQueued;
+            stats.nClients = lane.mapClients.size();
+            stats.nRunning = lane.nRunning;
+            stats.nThreads = std::min(lane.nThreads, numThreads);
+            stats.nMaxDepth = maxDepth;
+            stats.nProcessed = lane.nProcessed;
+            stats.nRejected = lane.nRejected;
+            stats.nAvgWait = lane.nAvgWait;
+            stats.nMaxWait = lane.nMaxWait;
+        }
+        return vStats;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPLaneClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPLaneClassifier classifier;
 };
 
 /** HTTP module state */
@@ -285,9 +440,11 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkLane lane = i->classifier ? i->classifier(hreq.get(), path) : HTTP_LANE_FAST;
+        std::string client = hreq->GetPeer().ToStringIP();
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), lane, client))
             item.release(); /* if true, queue took ownership */
         else
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
@@ -430,7 +587,7 @@ bool InitHTTPServer()
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queue of depth %d per lane\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
     eventBase = base;
@@ -440,11 +597,44 @@ bool InitHTTPServer()
 
 boost::thread threadHTTP;
 
+bool QueueHTTPTask(const boost::function<void()>& task)
+{
+    if (!workQueue)
+        return false;
+    HTTPWorkLane lane = HTTP_LANE_FAST;
+    std::string client;
+    workQueue->GetCurrent(lane, client);
+    std::unique_ptr<HTTPTask> item(new HTTPTask(task));
+    if (!workQueue->Enqueue(item.get(), lane, client))
+        return false;
+    item.release(); /* if true, queue took ownership */
+    return true;
+}
+
+std::vector<HTTPWorkLaneStats> GetHTTPWorkQueueStats()
+{
+    if (!workQueue)
+        return std::vector<HTTPWorkLaneStats>();
+    return workQueue->Stats();
+}
+
+const char* HTTPWorkLaneName(HTTPWorkLane lane)
+{
+    switch (lane) {
+    case HTTP_LANE_FAST: return "fast";
+    case HTTP_LANE_WALLET: return "wallet";
+    case HTTP_LANE_HEAVY: return "heavy";
+    default: return "unknown";
+    }
+}
+
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
     LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    workQueue->SetThreadBudget(HTTP_LANE_HEAVY, GetArg("-rpcheavythreads", std::min(DEFAULT_HTTP_HEAVY_THREADS, rpcThreads)));
+    workQueue->SetThreadBudget(HTTP_LANE_WALLET, GetArg("-rpcwalletthreads", std::min(DEFAULT_HTTP_WALLET_THREADS, rpcThreads)));
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
 
     for (int i = 0; i < rpcThreads; i++) {
@@ -536,11 +726,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (replyStarted && !replySent) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndReply();
+    }
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -580,6 +775,19 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string rv(std::min(evbuffer_get_length(buf), nMaxSize), '\0');
+    if (rv.empty())
+        return rv;
+    ev_ssize_t nCopied = evbuffer_copyout(buf, &rv[0], rv.size());
+    rv.resize(std::max(nCopied, (ev_ssize_t)0));
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -594,7 +802,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStarted && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -606,6 +814,161 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/** State of a chunked reply, shared between the worker producing it and the
+ * main http thread sending it. When the connection goes away libevent only
+ * detaches the started request from it, so chunk events check fClosed first
+ * and the final evhttp_send_reply_end still runs to free the request.
+ */
+struct HTTPReplyStream
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! Bytes handed to libevent and not yet written to the socket
+    size_t nBacklog;
+    //! Connection is gone (main http thread only)
+    bool fClosed;
+    //! Time the worker spent waiting for the client so far, in microseconds
+    int64_t nWaited;
+    //! Keeps this alive while registered as close callback (main http thread only)
+    std::shared_ptr<HTTPReplyStream> self;
+
+    HTTPReplyStream() : nBacklog(0), fClosed(false), nWaited(0) {}
+};
+
+struct HTTPReplyChunk
+{
+    std::string data;
+    std::shared_ptr<HTTPReplyStream> stream;
+};
+
+static void ReplyConnectionClosed(struct evhttp_connection* evcon, void* arg)
+{
+    std::shared_ptr<HTTPReplyStream> stream = static_cast<HTTPReplyStream*>(arg)->self;
+    stream->self.reset();
+    boost::unique_lock<boost::mutex> lock(stream->cs);
+    stream->fClosed = true;
+    stream->cond.notify_all();
+}
+
+static void SendReplyStart(struct evhttp_request* req, int nStatus, std::shared_ptr<HTTPReplyStream> stream)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        stream->self = stream;
+        evhttp_connection_set_closecb(evcon, ReplyConnectionClosed, stream.get());
+    }
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+static void ReleaseReplyChunk(const void* data, size_t datalen, void* extra)
+{
+    HTTPReplyChunk* chunk = static_cast<HTTPReplyChunk*>(extra);
+    {
+        boost::unique_lock<boost::mutex> lock(chunk->stream->cs);
+        chunk->stream->nBacklog -= chunk->data.size();
+        chunk->stream->cond.notify_all();
+    }
+    delete chunk;
+}
+
+static void SendReplyChunk(struct evhttp_request* req, struct evbuffer* evb, std::shared_ptr<HTTPReplyStream> stream)
+{
+    if (!stream->fClosed)
+        evhttp_send_reply_chunk(req, evb);
+    evbuffer_free(evb);
+}
+
+static void SendReplyEnd(struct evhttp_request* req, std::shared_ptr<HTTPReplyStream> stream)
+{
+    // On a closed connection this only frees the detached request
+    if (!stream->fClosed && stream->self) {
+        evhttp_connection_set_closecb(evhttp_request_get_connection(req), NULL, NULL);
+        stream->self.reset();
+    }
+    evhttp_send_reply_end(req);
+}
+
+static void SendReplyAbort(struct evhttp_request* req, std::shared_ptr<HTTPReplyStream> stream)
+{
+    struct evhttp_connection* evcon = stream->fClosed ? NULL : evhttp_request_get_connection(req);
+    if (!evcon) {
+        // Already detached from its connection, only the request is left to free
+        evhttp_send_reply_end(req);
+        return;
+    }
+    if (stream->self) {
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+        stream->self.reset();
+    }
+    // Frees the request along with the connection
+    evhttp_connection_free(evcon);
+}
+
+void HTTPRequest::StartReply(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    replyStream = std::make_shared<HTTPReplyStream>();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(SendReplyStart, req, nStatus, replyStream));
+    ev->trigger(0);
+    replyStarted = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(std::string& strChunk)
+{
+    assert(replyStarted && !replySent && req);
+    {
+        // Wait for the client to catch up, rather than buffering the whole reply.
+        // The timeout covers all waits of the reply together, so a client that
+        // keeps reading slowly cannot hold the worker much longer than that.
+        const int64_t nMaxWait = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT) * 1000000;
+        boost::unique_lock<boost::mutex> lock(replyStream->cs);
+        while (!replyStream->fClosed && replyStream->nBacklog > MAX_HTTP_REPLY_BACKLOG) {
+            if (replyStream->nWaited >= nMaxWait) {
+                LogPrint("http", "%s: client too slow, abandoning reply\n", __func__);
+                return false;
+            }
+            int64_t nStart = GetTimeMicros();
+            replyStream->cond.timed_wait(lock, boost::posix_time::microseconds(nMaxWait - replyStream->nWaited));
+            replyStream->nWaited += GetTimeMicros() - nStart;
+        }
+        if (replyStream->fClosed)
+            return false;
+        replyStream->nBacklog += strChunk.size();
+    }
+    if (strChunk.empty())
+        return true;
+    // Hand the memory to libevent instead of copying it, the chunk is
+    // released once it has been written out to the socket.
+    HTTPReplyChunk* chunk = new HTTPReplyChunk();
+    chunk->data.swap(strChunk);
+    chunk->stream = replyStream;
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add_reference(evb, chunk->data.data(), chunk->data.size(), ReleaseReplyChunk, chunk);
+    // Events are handled in the order they were triggered, so chunks go out in order
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(SendReplyChunk, req, evb, replyStream));
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::EndReply()
+{
+    assert(replyStarted && !replySent && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(SendReplyEnd, req, replyStream));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+void HTTPRequest::AbortReply()
+{
+    assert(replyStarted && !replySent && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(SendReplyAbort, req, replyStream));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -646,10 +1009,11 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPLaneClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
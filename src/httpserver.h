@@ -5,7 +5,9 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -14,10 +16,17 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Default number of threads that may run heavy requests at the same time */
+static const int DEFAULT_HTTP_HEAVY_THREADS=2;
+/** Default number of threads that may run wallet requests at the same time */
+static const int DEFAULT_HTTP_WALLET_THREADS=2;
+/** Chunked replies wait for the client once this many bytes are queued but not yet sent */
+static const size_t MAX_HTTP_REPLY_BACKLOG = 4 * 1024 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
+struct HTTPReplyStream;
 class HTTPRequest;
 
 /** Initialize HTTP server.
@@ -34,13 +43,32 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Lanes of the work queue. Each lane has its own queue depth and a budget of
+ * worker threads, so that expensive requests cannot hold up cheap ones.
+ * Lanes are ordered from cheapest to most expensive, idle workers serve them
+ * in this order.
+ */
+enum HTTPWorkLane {
+    HTTP_LANE_FAST,     //!< Cheap reads, health checks
+    HTTP_LANE_WALLET,   //!< Wallet operations
+    HTTP_LANE_HEAVY,    //!< Index and UTXO set scans, bulk data
+    HTTP_LANE_COUNT
+};
+/** Name of a lane, as shown in the queue statistics */
+const char* HTTPWorkLaneName(HTTPWorkLane lane);
+
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the lane for a request. Called on the event loop thread, so it must
+ * be quick and must not consume the request body.
+ */
+typedef boost::function<HTTPWorkLane(HTTPRequest* req, const std::string &)> HTTPLaneClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier, requests go to the fast lane.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler,
+                         const HTTPLaneClassifier &classifier = HTTPLaneClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -49,6 +77,30 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Run a task on one of the HTTP worker threads.
+ * When called from a worker, the task is queued in the lane and on behalf of
+ * the client of the request being served.
+ * Returns false if the work queue is full or the server is not running.
+ */
+bool QueueHTTPTask(const boost::function<void()>& task);
+
+/** Statistics of one work queue lane */
+struct HTTPWorkLaneStats
+{
+    HTTPWorkLane lane;
+    size_t nQueued;         //!< Items waiting for a worker
+    size_t nClients;        //!< Distinct clients with waiting items
+    int nRunning;           //!< Items being run right now
+    int nThreads;           //!< Thread budget of the lane
+    size_t nMaxDepth;       //!< Queue depth limit of the lane
+    uint64_t nProcessed;    //!< Items run since startup
+    uint64_t nRejected;     //!< Items refused since startup because the lane or client was full
+    int64_t nAvgWait;       //!< Moving average of the time items waited, in microseconds
+    int64_t nMaxWait;       //!< Longest time an item waited, in microseconds
+};
+/** Get the statistics of all work queue lanes, empty if the server is not running */
+std::vector<HTTPWorkLaneStats> GetHTTPWorkQueueStats();
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -56,10 +108,12 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    std::shared_ptr<HTTPReplyStream> replyStream;
 
     // For test access
 protected:
     bool replySent;
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -99,6 +153,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy of at most nMaxSize bytes from the start of the request body,
+     * without consuming it.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -115,6 +175,29 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies that are produced piecewise.
+     * Follow with any number of WriteReplyChunk calls and finish with EndReply.
+     *
+     * @note Call this instead of WriteReply, after writing the headers.
+     */
+    void StartReply(int nStatus);
+    /**
+     * Send a piece of a chunked reply. The contents of strChunk are taken over.
+     * Blocks while the client is too far behind, for at most -rpcservertimeout
+     * over the whole reply. Returns false if the client went away or is too
+     * slow, there is no point in producing more then.
+     */
+    bool WriteReplyChunk(std::string& strChunk);
+    /** Finish a chunked reply. Do not call any other HTTPRequest methods after this. */
+    void EndReply();
+    /**
+     * Cut a chunked reply short by closing the connection, so a client that
+     * was sent a Content-Length does not wait for the missing bytes. Do not
+     * call any other HTTPRequest methods after this.
+     */
+    void AbortReply();
 };
 
 /** Event handler closure.
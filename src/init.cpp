@@ -26,11 +26,14 @@
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
+#include "notificationqueue.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "txadmission.h"
+#include "txorphanpool.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -170,6 +173,9 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
+/** Set once the mempool was loaded from disk, so that a partially loaded mempool is never dumped */
+static std::atomic<bool> fDumpMempoolLater(false);
+
 static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
@@ -218,11 +224,16 @@ void Shutdown()
 #ifdef ENABLE_MINING
     GenerateBitcoins(false, 0, Params());
 #endif
+    txAdmissionQueue.Stop();
     StopNode();
     tor::StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
     UnregisterValidationInterface(dpos::getController()->getValidator());
 
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        DumpMempool();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -375,9 +386,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxperpeer=<n>", strprintf(_("Keep at most <n> unconnectable transactions from a single peer in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TX_PER_PEER));
+    strUsage += HelpMessageOpt("-mempooldumpinterval=<n>", strprintf(_("Save the mempool to disk every <n> seconds, 0 = only on shutdown (default: %d)"), DEFAULT_MEMPOOL_DUMP_INTERVAL));
     strUsage += HelpMessageOpt("-mempooltxinputlimit=<n>", _("[DEPRECATED FROM OVERWINTER] Set the maximum number of transparent inputs in a transaction that the mempool will accept (default: 0 = no limit applied)"));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-txadmissionthreads=<n>", strprintf(_("Set the number of threads verifying transactions received from peers before they are committed to the mempool (0 to %d, 0 = verify inline, default: %d)"),
+        MAX_TXADMISSION_THREADS, DEFAULT_TXADMISSION_THREADS));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "crypticcoind.pid"));
 #endif
@@ -406,6 +422,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Number of threads processing peer messages (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-tor_exe_path=<path>", strprintf(_("[if -listenonion] Path to tor executable. Daemon will execute it (default: '%s')"), ""));
     strUsage += HelpMessageOpt("-tor_obfs4_exe_path=<path>", strprintf(_("[if -tor_generate_config] Path to obfs4 executable. It'll be added in tor config (default: '%s')"), ""));
@@ -420,6 +437,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-tor_service_port=<port>", strprintf(_("[if -tor_exe_path] Executed tor will listen for connections on <port> (default: %u or testnet: %u)"), 23303, 23313));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select, epoll", DEFAULT_SOCKETEVENTS));
+#else
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), "select", DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), tor::DEFAULT_TOR_CONTROL));
@@ -461,6 +483,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawtxbatch=<address>", _("Enable publish raw transactions, several per message when they arrive in bursts, in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdposviceblock=<address>", _("Enable publish dPoS vice-blocks in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdposroundquorum=<address>", _("Enable publish dPoS round quorums in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdposinstanttx=<address>", _("Enable publish dPoS committed instant transactions in <address>"));
 #endif
 
 #if ENABLE_PROTON
@@ -469,6 +495,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-amqppubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-amqppubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-amqppubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-amqppubdposviceblock=<address>", _("Enable publish dPoS vice-blocks in <address>"));
+    strUsage += HelpMessageOpt("-amqppubdposroundquorum=<address>", _("Enable publish dPoS round quorums in <address>"));
+    strUsage += HelpMessageOpt("-amqppubdposinstanttx=<address>", _("Enable publish dPoS committed instant transactions in <address>"));
+#endif
+
+#if ENABLE_ZMQ || ENABLE_PROTON
+    strUsage += HelpMessageGroup(_("Notification queue options:"));
+    strUsage += HelpMessageOpt("-notifyqueuesize=<n>", strprintf(_("Keep at most <n> ZMQ or AMQP notifications waiting to be published, further ones are dropped (default: %u)"), DEFAULT_NOTIFY_QUEUE_SIZE));
+    strUsage += HelpMessageOpt("-notifyqueueblock", strprintf(_("Hold up validation instead of dropping notifications when the queue is full (default: %u)"), DEFAULT_NOTIFY_QUEUE_BLOCK));
+    strUsage += HelpMessageOpt("-notifytxbatch=<n>", strprintf(_("Publish at most <n> queued transactions together, 1 to disable batching (default: %u)"), DEFAULT_NOTIFY_TX_BATCH));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -548,8 +584,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 23202, 23212));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcheavythreads=<n>", strprintf(_("Set the number of RPC threads that may run address index and UTXO set scans at the same time (default: %d)"), DEFAULT_HTTP_HEAVY_THREADS));
+    strUsage += HelpMessageOpt("-rpcwalletthreads=<n>", strprintf(_("Set the number of RPC threads that may run wallet calls at the same time (default: %d)"), DEFAULT_HTTP_WALLET_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchconcurrency=<n>", strprintf(_("Set the number of requests of one read-only JSON-RPC batch that are executed at the same time (default: %d)"), DEFAULT_RPC_BATCH_CONCURRENCY));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of each lane of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -687,6 +726,17 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool();
+        fDumpMempoolLater = !fRequestShutdown;
+    }
+}
+
+static void PeriodicDumpMempool()
+{
+    if (fDumpMempoolLater)
+        DumpMempool();
 }
 
 void ThreadNotifyRecentlyAdded()
@@ -1111,7 +1161,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (!SetSocketEventsMode(GetArg("-socketevents", DEFAULT_SOCKETEVENTS)))
+        return InitError(strprintf(_("Unsupported -socketevents mode: '%s'"), GetArg("-socketevents", DEFAULT_SOCKETEVENTS)));
+    // select() can't watch descriptors beyond FD_SETSIZE
+    if (SocketEventsNeedSelectableSockets())
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1410,10 +1465,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    int nTxAdmissionThreads = std::min((int)GetArg("-txadmissionthreads", DEFAULT_TXADMISSION_THREADS), MAX_TXADMISSION_THREADS);
+    LogPrintf("Using %u threads for mempool admission\n", std::max(nTxAdmissionThreads, 0));
+    txAdmissionQueue.Start(threadGroup, nTxAdmissionThreads, &ProcessTransactionFromPeer);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
 
+    int64_t nMempoolDumpInterval = GetArg("-mempooldumpinterval", DEFAULT_MEMPOOL_DUMP_INTERVAL);
+    if (nMempoolDumpInterval > 0 && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        scheduler.scheduleEvery(&PeriodicDumpMempool, nMempoolDumpInterval);
+    }
+
     // Count uptime
     MarkStartTime();
 
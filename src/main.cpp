@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -21,7 +22,9 @@
 #include "metrics.h"
 #include "net.h"
 #include "pow.h"
+#include "txadmission.h"
 #include "txmempool.h"
+#include "txorphanpool.h"
 #include "ui_interface.h"
 #include "undo.h"
 #include "util.h"
@@ -34,7 +37,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <list>
 #include <sstream>
+#include <unordered_map>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -61,6 +66,10 @@ BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 static int64_t nTimeBestReceived = 0;
+/** Salts of the deterministic addr relay and tx trickle choices. Drawn in
+ *  RegisterNodeSignals, before any message handler thread runs. */
+static uint256 hashAddrRelaySalt;
+static uint256 hashTrickleSalt;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
@@ -92,20 +101,13 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 
 CTxMemPool mempool(::minRelayTxFee);
 
-struct COrphanTx {
-    CTransaction tx;
-    NodeId fromPeer;
-};
-map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);;
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
-
 /**
  * Returns true if there are nRequired or more blocks of minVersion or above
  * in the last Consensus::Params::nMajorityWindow blocks, starting at pstart and going backwards.
  */
 static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned nRequired, const Consensus::Params& consensusParams);
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
+static void ProcessOrphanTransactions(std::vector<uint256> vWorkQueue, CMasternodesViewCache& mnview);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -205,6 +207,7 @@ namespace {
         int64_t nTime;           //!< Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //!< The timeout for this block request (for disconnecting a slow peer)
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock; //!< Optional, set while a compact block waits for "blocktxn".
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -220,6 +223,14 @@ namespace {
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
 
+    /** Last published snapshot of chainActive, accessed with std::atomic_load/atomic_store. */
+    std::shared_ptr<const CChainSnapshot> chainSnapshot = std::make_shared<const CChainSnapshot>();
+
+    /** Guards mapActiveChainBlocks, never held for long. */
+    CCriticalSection cs_activeChainBlocks;
+    /** Blocks of the active chain by hash, kept in step with the published snapshot. */
+    std::unordered_map<uint256, const CBlockIndex*, BlockHasher> mapActiveChainBlocks;
+
     template<typename T>
     void ProcessInventoryCommand(const T& data,
                                  CNode* pfrom,
@@ -273,8 +284,14 @@ struct CNodeState {
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Smoothed time in microseconds this peer takes to deliver one requested block, or 0 if not measured yet.
+    int64_t nBlockDeliveryTime;
+    //! When this peer last delivered a block we requested (in microseconds), or 0.
+    int64_t nLastBlockDelivery;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer can give us compact blocks ("sendcmpct").
+    bool fProvidesHeaderAndIDs;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -287,7 +304,10 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockDeliveryTime = 0;
+        nLastBlockDelivery = 0;
         fPreferredDownload = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -344,18 +364,47 @@ void FinalizeNode(NodeId nodeid) {
 
     BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
-    EraseOrphansFor(nodeid);
+    orphanTxPool.EraseForPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
 }
 
+// Requires cs_main.
+void UpdateBlockDeliveryTime(CNodeState *state, int64_t nTime) {
+    // Exponential moving average over roughly the last 8 blocks
+    if (state->nBlockDeliveryTime == 0)
+        state->nBlockDeliveryTime = nTime;
+    else
+        state->nBlockDeliveryTime = (7 * state->nBlockDeliveryTime + nTime) / 8;
+    state->nBlockDeliveryTime = std::max<int64_t>(state->nBlockDeliveryTime, 1);
+}
+
+// Requires cs_main.
+// Number of blocks that may be in flight from this peer: as many as it delivers in
+// BLOCK_DOWNLOAD_TARGET_TIME, so fast peers get deep pipelines and slow peers can't
+// hold on to large parts of the download window.
+int GetBlocksInTransitLimit(const CNodeState *state) {
+    if (state->nBlockDeliveryTime == 0)
+        return DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nLimit = BLOCK_DOWNLOAD_TARGET_TIME / state->nBlockDeliveryTime;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, nLimit));
+}
+
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
-bool MarkBlockAsReceived(const uint256& hash) {
+// If nodeFrom is the peer we requested the block from, the delivery is accounted to it.
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        if (nodeFrom == itInFlight->second.first) {
+            // Blocks are pipelined, so a delivery takes the time since the previous one
+            // unless the peer was idle when we asked for this block.
+            int64_t nNow = GetTimeMicros();
+            UpdateBlockDeliveryTime(state, nNow - std::max(itInFlight->second.second->nTime, state->nLastBlockDelivery));
+            state->nLastBlockDelivery = nNow;
+        }
         nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->vBlocksInFlight.erase(itInFlight->second.second);
@@ -469,6 +518,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
     std::vector<CBlockIndex*> vToFetch;
     CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
+    CBlockIndex *pindexWaiting = NULL;
     // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
@@ -505,7 +555,17 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
-                        nodeStaller = waitingfor;
+                        // If the block holding back the window has been in flight from the other peer for much
+                        // longer than this peer takes to deliver one, fetch it from here instead of waiting.
+                        // pindexWaiting is NULL when nothing in the window is in flight.
+                        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itWaiting =
+                            pindexWaiting ? mapBlocksInFlight.find(pindexWaiting->GetBlockHash()) : mapBlocksInFlight.end();
+                        if (itWaiting != mapBlocksInFlight.end() && state->nBlockDeliveryTime > 0 &&
+                            GetTimeMicros() - itWaiting->second.second->nTime > BLOCK_REASSIGN_SPEEDUP * state->nBlockDeliveryTime) {
+                            vBlocks.push_back(pindexWaiting);
+                        } else {
+                            nodeStaller = waitingfor;
+                        }
                     }
                     return;
                 }
@@ -516,6 +576,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaiting = pindex;
             }
         }
     }
@@ -531,6 +592,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlockDeliveryTime = state->nBlockDeliveryTime;
+    stats.nBlocksInTransitLimit = GetBlocksInTransitLimit(state);
     BOOST_FOREACH(const QueuedBlock& queue, state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -540,6 +603,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
+    hashAddrRelaySalt = GetRandHash();
+    hashTrickleSalt = GetRandHash();
     nodeSignals.GetHeight.connect(&GetHeight);
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
@@ -579,92 +644,6 @@ CBlockTreeDB *pblocktree = nullptr;
 CMasternodesView *pmasternodesview = nullptr;
 CDposDB * pdposdb = nullptr;
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// mapOrphanTransactions
-//
-
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    unsigned int sz = GetSerializeSize(tx, SER_NETWORK, tx.nVersion);
-    if (sz > 5000)
-    {
-        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
-
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
-    {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
-        }
-    }
-    if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
-
 bool IsStandardTx(const CTransaction& tx, string& reason, const CChainParams& chainparams, const int nHeight)
 {
     bool overwinterActive = chainparams.GetConsensus().NetworkUpgradeActive(nHeight,  Consensus::UPGRADE_OVERWINTER);
@@ -1390,8 +1369,8 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
 }
 
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, std::function<bool(const CTransaction &, const Consensus::Params&, int)> mntxChecker, bool fRejectAbsurdFee)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, std::function<bool(const CTransaction &, const Consensus::Params&, int)> mntxChecker, bool fRejectAbsurdFee)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1414,14 +1393,24 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
-    if (!CheckTransaction(tx, state, verifier))
-        return error("AcceptToMemoryPool: CheckTransaction failed");
+    // Reuse the verdict of the lock-free pre-validation stage if it was
+    // computed against the same next block height.
+    CValidationState statePrecheck;
+    if (txPrecheckCache.Take(tx.GetHash(), nextBlockHeight, statePrecheck)) {
+        if (!statePrecheck.IsValid()) {
+            state = statePrecheck;
+            return error("AcceptToMemoryPool: pre-validation failed");
+        }
+    } else {
+        auto verifier = libzcash::ProofVerifier::Strict();
+        if (!CheckTransaction(tx, state, verifier))
+            return error("AcceptToMemoryPool: CheckTransaction failed");
 
-    // DoS level set to 10 to be more forgiving.
-    // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
-    if (!ContextualCheckTransaction(tx, state, Params(), nextBlockHeight, 10)) {
-        return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
+        // DoS level set to 10 to be more forgiving.
+        // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
+        if (!ContextualCheckTransaction(tx, state, Params(), nextBlockHeight, 10)) {
+            return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
+        }
     }
 
     // DoS mitigation: reject transactions expiring soon
@@ -1561,7 +1550,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // it has passed ContextualCheckInputs and therefore this is correct.
         auto consensusBranchId = CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), mempool.HasNoInputsOf(tx), fSpendsCoinbase, consensusBranchId);
         unsigned int nSize = entry.GetTxSize();
 
         // Accept a tx if it contains joinsplits and has at least the default fee specified by z_sendmany.
@@ -1655,6 +1644,174 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return true;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, std::function<bool(const CTransaction &, const Consensus::Params&, int)> mntxChecker, bool fRejectAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), mntxChecker, fRejectAbsurdFee);
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+bool LoadMempool()
+{
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t failed = 0;
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            return false;
+        }
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransaction tx;
+            int64_t nTime;
+            double dPriorityDelta;
+            CAmount nFeeDelta;
+            file >> tx;
+            file >> nTime;
+            file >> dPriorityDelta;
+            file >> nFeeDelta;
+
+            if (dPriorityDelta != 0 || nFeeDelta != 0) {
+                mempool.PrioritiseTransaction(tx.GetHash(), tx.GetHash().ToString(), dPriorityDelta, nFeeDelta);
+            }
+            {
+                LOCK(cs_main);
+                // Instant transactions are handed back to the dPoS controller
+                // first, like when they are received from a peer.
+                if (tx.fInstant) {
+                    CValidationState state_dpos;
+                    dpos::getController()->proceedTransaction(tx, state_dpos);
+                }
+                // Transactions which expired in the meantime are rejected as
+                // expiring soon by AcceptToMemoryPool.
+                CValidationState state;
+                CMasternodesViewCache mnview(pmasternodesview);
+                if (AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime, boost::bind(CheckMasternodeTx, boost::ref(mnview), _1, _2, _3, true))) {
+                    ++count;
+                } else {
+                    ++failed;
+                }
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+
+        for (const auto& i : mapDeltas) {
+            mempool.PrioritiseTransaction(i.first, i.first.ToString(), i.second.first, i.second.second);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed\n", count, failed);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t start = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<CTxMemPoolEntry> vEntries;
+
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vEntries.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry& entry : mempool.mapTx) {
+            vEntries.push_back(entry);
+        }
+    }
+
+    // Write parents before their children, so that LoadMempool can accept
+    // the transactions back one by one.
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        mapIndex[vEntries[i].GetTx().GetHash()] = i;
+    }
+    std::vector<size_t> vParentsLeft(vEntries.size(), 0);
+    std::multimap<size_t, size_t> mapChildren;
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vEntries[i].GetTx().vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && setParents.insert(it->second).second) {
+                mapChildren.insert(std::make_pair(it->second, i));
+            }
+        }
+        vParentsLeft[i] = setParents.size();
+    }
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vEntries.size());
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        if (vParentsLeft[i] == 0)
+            vOrder.push_back(i);
+    }
+    for (size_t n = 0; n < vOrder.size(); n++) {
+        auto range = mapChildren.equal_range(vOrder[n]);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (--vParentsLeft[it->second] == 0)
+                vOrder.push_back(it->second);
+        }
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vOrder.size();
+        for (size_t i : vOrder) {
+            const CTxMemPoolEntry& entry = vEntries[i];
+            const uint256 hash = entry.GetTx().GetHash();
+            std::pair<double, CAmount> deltas(0, 0);
+            auto it = mapDeltas.find(hash);
+            if (it != mapDeltas.end()) {
+                deltas = it->second;
+                mapDeltas.erase(it);
+            }
+            file << entry.GetTx();
+            file << (int64_t)entry.GetTime();
+            file << deltas.first;
+            file << deltas.second;
+        }
+
+        // Deltas of transactions that are not in the mempool (yet)
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*0.000001, (last-mid)*0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
     std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
@@ -1707,6 +1864,41 @@ bool GetAddressUnspent(const uint160& addressHash, int type,
     return true;
 }
 
+bool ScanAddressIndex(const CAddressIndexKey& keyFrom, int end,
+                      boost::function<bool(const CAddressIndexDbEntry&)> fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressIndex(keyFrom, end, fn))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ScanAddressUnspent(const CAddressUnspentKey& keyFrom,
+                        boost::function<bool(const CAddressUnspentDbEntry&)> fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressUnspentIndex(keyFrom, fn))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressBalance(addressHash, type, value))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1834,6 +2026,79 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/**
+ * Open the block file at the metadata WriteBlockToDisk stores in front of the
+ * block at pos, check it and the header, and set nSize to the size of the
+ * block. Returns NULL on failure.
+ */
+static FILE* OpenRawBlock(unsigned int& nSize, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const unsigned int nMetaSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nMetaSize) {
+        error("ReadRawBlockFromDisk: Invalid block position %s", pos.ToString());
+        return NULL;
+    }
+    CDiskBlockPos metaPos(pos.nFile, pos.nPos - nMetaSize);
+
+    CAutoFile filein(OpenBlockFile(metaPos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        return NULL;
+    }
+
+    CMessageHeader::MessageStartChars blockStart;
+    filein >> FLATDATA(blockStart) >> nSize;
+    if (memcmp(blockStart, messageStart, MESSAGE_START_SIZE) != 0) {
+        error("ReadRawBlockFromDisk: Block magic mismatch at %s", pos.ToString());
+        return NULL;
+    }
+    if (nSize > MAX_SIZE) {
+        error("ReadRawBlockFromDisk: Block too large at %s", pos.ToString());
+        return NULL;
+    }
+
+    CBlockHeader header;
+    filein >> header;
+    if (header.GetHash() != hash) {
+        error("ReadRawBlockFromDisk: GetHash() doesn't match %s at %s", hash.ToString(), pos.ToString());
+        return NULL;
+    }
+    return filein.release();
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart)
+{
+    block.clear();
+
+    try {
+        unsigned int nSize;
+        CAutoFile filein(OpenRawBlock(nSize, pos, hash, messageStart), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return false;
+        if (fseek(filein.Get(), pos.nPos, SEEK_SET))
+            return error("ReadRawBlockFromDisk: fseek failed for %s", pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        block.clear();
+        return error("%s: Read error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockSizeFromDisk(unsigned int& nSize, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart)
+{
+    try {
+        CAutoFile filein(OpenRawBlock(nSize, pos, hash, messageStart), SER_DISK, CLIENT_VERSION);
+        return !filein.IsNull();
+    }
+    catch (const std::exception& e) {
+        return error("%s: Read error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+}
+
 CAmount GetBlockSubsidyRegTest(int nHeight, const Consensus::Params& consensusParams)
 {
     CAmount nSubsidy = 12.5 * COIN;
@@ -3325,9 +3590,44 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot()
+{
+    return std::atomic_load(&chainSnapshot);
+}
+
+const CBlockIndex* LookupActiveChainBlock(const uint256& hash)
+{
+    LOCK(cs_activeChainBlocks);
+    auto it = mapActiveChainBlocks.find(hash);
+    return it != mapActiveChainBlocks.end() ? it->second : NULL;
+}
+
+/** Publish chainActive for lock-free readers, call after every change of its tip. */
+static void PublishChainSnapshot()
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexOld = GetChainSnapshot()->Tip();
+    const CBlockIndex* pindexNew = chainActive.Tip();
+    {
+        LOCK(cs_activeChainBlocks);
+        if (!pindexNew) {
+            mapActiveChainBlocks.clear();
+        } else {
+            // Only the blocks above the fork point change
+            const CBlockIndex* pindexFork = pindexOld ? chainActive.FindFork(pindexOld) : NULL;
+            for (const CBlockIndex* pindex = pindexOld; pindex != pindexFork; pindex = pindex->pprev)
+                mapActiveChainBlocks.erase(pindex->GetBlockHash());
+            for (const CBlockIndex* pindex = pindexNew; pindex != pindexFork; pindex = pindex->pprev)
+                mapActiveChainBlocks[pindex->GetBlockHash()] = pindex;
+        }
+    }
+    std::atomic_store(&chainSnapshot, std::make_shared<const CChainSnapshot>(pindexNew));
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -3494,6 +3794,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Remove conflicting transactions from the mempool.
     list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload(chainparams));
+    orphanTxPool.EraseForBlock(*pblock);
 
     // Remove transactions that expire at new block height from mempool
     mempool.removeExpired(pindexNew->nHeight);
@@ -4431,7 +4732,7 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
                 return false; // check dPoS sigs before block is written on disk
         }
 
-        bool fRequested = MarkBlockAsReceived(pblock->GetHash());
+        bool fRequested = MarkBlockAsReceived(pblock->GetHash(), pfrom ? pfrom->GetId() : -1);
         fRequested |= fForceProcessing;
         if (!checked) {
             return error("%s: CheckBlock FAILED", __func__);
@@ -4451,6 +4752,14 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
     if (!ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed", __func__);
 
+    // Orphans whose parents were just confirmed can enter the mempool now
+    std::vector<uint256> vReadyParents = orphanTxPool.TakeReadyParents();
+    if (!vReadyParents.empty()) {
+        LOCK(cs_main);
+        CMasternodesViewCache mnview(pmasternodesview);
+        ProcessOrphanTransactions(vReadyParents, mnview);
+    }
+
     int height = chainActive.Height();
     if (NetworkUpgradeActive(height, Params().GetConsensus(), Consensus::UPGRADE_SAPLING))
     {
@@ -4816,6 +5125,17 @@ bool static LoadBlockIndexDB()
     fSpentIndex = fInsightExplorer;
     fTimestampIndex = fInsightExplorer;
 
+    // Address balances are maintained along with the address index, an older
+    // index has to get them summed up once
+    bool fAddressBalanceIndex = false;
+    pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+    if (fAddressIndex && !fAddressBalanceIndex) {
+        LogPrintf("%s: building address balance index...\n", __func__);
+        if (!pblocktree->RebuildAddressBalanceIndex())
+            return error("%s: failed to build address balance index", __func__);
+        pblocktree->WriteFlag("addressbalanceindex", true);
+    }
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -4835,6 +5155,7 @@ bool static LoadBlockIndexDB()
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
     // Set hashFinalSproutRoot for the end of best chain
     it->second->hashFinalSproutRoot = pcoinsTip->GetBestAnchor(SPROUT);
 
@@ -5106,11 +5427,11 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    orphanTxPool.Clear();
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -5158,6 +5479,7 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -insightexplorer in the new database
     fInsightExplorer = GetBoolArg("-insightexplorer", false);
     pblocktree->WriteFlag("insightexplorer", fInsightExplorer);
+    pblocktree->WriteFlag("addressbalanceindex", fInsightExplorer);
     fAddressIndex = fInsightExplorer;
     fSpentIndex = fInsightExplorer;
     fTimestampIndex = fInsightExplorer;
@@ -5570,7 +5892,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
 //                   dpos::getController()->findTx(inv.hash, nullptr) || @todo @egorl ensure that it doesn't break mempool syncing
-                   mapOrphanTransactions.count(inv.hash) ||
+                   orphanTxPool.HaveTx(inv.hash) ||
                    pcoinsTip->HaveCoins(inv.hash);
         }
     case MSG_BLOCK:
@@ -5589,6 +5911,86 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Inventory to request a block with. Approved dPoS blocks are fetched without
+ * their transactions when we already have the vice-block. Otherwise, if
+ * fAllowCompact is set, a compact block is asked from peers providing them.
+ */
+static CInv GetBlockRequest(const CNode* pnode, const uint256& hash, bool fAllowCompact) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (pnode->nVersion >= DPOS_BLOCK_VERSION && dpos::getController()->findViceBlock(hash))
+        return CInv(MSG_DPOS_BLOCK, hash);
+    if (fAllowCompact && State(pnode->GetId())->fProvidesHeaderAndIDs)
+        return CInv(MSG_CMPCT_BLOCK, hash);
+    return CInv(MSG_BLOCK, hash);
+}
+
+/** Whether inv requests a block, in any of its encodings */
+static bool IsBlockInv(const CInv& inv)
+{
+    return inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK ||
+           inv.type == MSG_DPOS_BLOCK || inv.type == MSG_CMPCT_BLOCK;
+}
+
+namespace {
+
+/**
+ * LRU of "block" messages read raw from the block files. Peers syncing from
+ * us tend to request the same blocks, those are read and checksummed once.
+ */
+class CServedBlockCache
+{
+public:
+    std::shared_ptr<const CSerializeData> Get(const uint256& hash)
+    {
+        LOCK(cs);
+        auto it = mapBlocks.find(hash);
+        if (it == mapBlocks.end())
+            return nullptr;
+        lruBlocks.splice(lruBlocks.begin(), lruBlocks, it->second);
+        return it->second->second;
+    }
+
+    void Put(const uint256& hash, const std::shared_ptr<const CSerializeData>& msg)
+    {
+        LOCK(cs);
+        if (mapBlocks.count(hash))
+            return;
+        lruBlocks.emplace_front(hash, msg);
+        mapBlocks.emplace(hash, lruBlocks.begin());
+        while (lruBlocks.size() > MAX_SERVED_BLOCK_CACHE) {
+            mapBlocks.erase(lruBlocks.back().first);
+            lruBlocks.pop_back();
+        }
+    }
+
+private:
+    typedef std::list<std::pair<uint256, std::shared_ptr<const CSerializeData>>> BlockList;
+
+    CCriticalSection cs;
+    BlockList lruBlocks;
+    std::map<uint256, BlockList::iterator> mapBlocks;
+};
+
+CServedBlockCache servedBlockCache;
+
+/** The "block" message for the block at pos, from the cache or the block file */
+std::shared_ptr<const CSerializeData> GetServedBlockMessage(const uint256& hash, const CDiskBlockPos& pos)
+{
+    std::shared_ptr<const CSerializeData> msg = servedBlockCache.Get(hash);
+    if (msg)
+        return msg;
+
+    std::vector<unsigned char> block;
+    if (!ReadRawBlockFromDisk(block, pos, hash, Params().MessageStart()))
+        return nullptr;
+    msg = std::make_shared<const CSerializeData>(MakeRawMessage("block", block));
+    servedBlockCache.Put(hash, msg);
+    return msg;
+}
+
+} // anon namespace
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     int currentHeight = GetHeight();
@@ -5597,8 +5999,8 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
+    // cs_main is only taken for index and dPoS lookups, so a peer
+    // downloading old blocks doesn't stall the other message handlers
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -5609,37 +6011,78 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (IsBlockInv(inv))
             {
                 bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                CDiskBlockPos blockPos;
+                uint256 hashTip;
+                int nDepth = std::numeric_limits<int>::max();
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    LOCK(cs_main);
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                                (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    send = send && (mi->second->nStatus & BLOCK_HAVE_DATA);
+                    if (send) {
+                        blockPos = mi->second->GetBlockPos();
+                        hashTip = chainActive.Tip()->GetBlockHash();
+                        if (chainActive.Contains(mi->second))
+                            nDepth = chainActive.Height() - mi->second->nHeight;
+                    }
                 }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                // Full blocks are sent as stored in the block file, without
+                // deserializing and serializing them again
+                const bool fRawBlock = inv.type == MSG_BLOCK ||
+                    (inv.type == MSG_CMPCT_BLOCK && nDepth > MAX_CMPCTBLOCK_DEPTH);
+                std::shared_ptr<const CSerializeData> pmsgBlock;
+                CBlock block;
+                if (send)
+                {
+                    if (fRawBlock) {
+                        pmsgBlock = GetServedBlockMessage(inv.hash, blockPos);
+                        send = pmsgBlock != nullptr;
+                    } else {
+                        send = ReadBlockFromDisk(block, blockPos, consensusParams) && block.GetHash() == inv.hash;
+                    }
+                    // The block file may have been pruned since the lookup
+                    if (!send)
+                        LogPrintf("%s: cannot load block %s requested by peer=%i\n", __func__, inv.hash.ToString(), pfrom->GetId());
+                }
+                if (send)
                 {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                    if (fRawBlock)
+                        pfrom->PushRawMessage(*pmsgBlock);
+                    else if (inv.type == MSG_DPOS_BLOCK)
+                    {
+                        // The peer has the vice-block, only the signatures are missing.
+                        // Blocks that weren't approved by dPoS are sent in full.
+                        if (block.vSig.empty())
+                            pfrom->PushMessage("block", block);
+                        else
+                            pfrom->PushMessage(inv.GetCommand(), dpos::CApprovedBlock_p2p{block});
+                    }
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                        // Deeper blocks are sent in full (fRawBlock), peers are
+                        // unlikely to have their transactions in the mempool
+                        pfrom->PushMessage(inv.GetCommand(), CBlockHeaderAndShortTxIDs(block));
                     else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
@@ -5655,7 +6098,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                if (!pfrom->IsInventoryKnown(CInv(MSG_TX, pair.second)))
                                     pfrom->PushMessage("tx", block.vtx[pair.first]);
                         }
                         // else
@@ -5669,15 +6112,15 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     // and we want it right after the last block so they don't
                     // wait for other stuff first.
                     vector<CInv> vInv;
-                    vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                    vInv.push_back(CInv(MSG_BLOCK, hashTip));
                     pfrom->PushMessage("inv", vInv);
                     pfrom->hashContinue.SetNull();
                 }
             }
         } else if (inv.IsKnownType()) {
             bool pushed{false};
+            // mapRelay entries are copied, they may expire once cs_mapRelay is released
             CDataStream ss{SER_NETWORK, PROTOCOL_VERSION};
-            const CDataStream* msg{&ss};
             ss.reserve(1000);
 
             if (inv.type == MSG_HEARTBEAT ||
@@ -5689,11 +6132,12 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                    LOCK(cs_mapRelay);
                    const auto mit{mapRelay.find(inv)};
                    if (mit != mapRelay.end()) {
-                       msg = &mit->second;
+                       ss = mit->second;
                        pushed = true;
                    }
                }
                if (!pushed) {
+                   LOCK(cs_main);
                    if (inv.type == MSG_HEARTBEAT) {
                        CHeartBeatMessage message{};
                        if (CHeartBeatTracker::getInstance().findReceivedMessage(inv.hash, &message)) {
@@ -5738,7 +6182,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         LOCK(cs_mapRelay);
                         map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
                         if (mi != mapRelay.end()) {
-                            msg = &mi->second;
+                            ss = mi->second;
                             pushed = true;
                         }
                     }
@@ -5748,14 +6192,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         pushed = true;
                     }
                     // Send from dPoS controller
-                    if (!pushed && inv.type == MSG_TX && dpos::getController()->findTx(inv.hash, &tx)) {
-                        ss << tx;
-                        pushed = true;
+                    if (!pushed && inv.type == MSG_TX) {
+                        LOCK(cs_main);
+                        if (dpos::getController()->findTx(inv.hash, &tx)) {
+                            ss << tx;
+                            pushed = true;
+                        }
                     }
                 }
             }
             if (pushed) {
-                pfrom->PushMessage(inv.GetCommand(), *msg);
+                pfrom->PushMessage(inv.GetCommand(), ss);
             } else {
                 vNotFound.push_back(inv);
             }
@@ -5764,7 +6211,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
         // Track requests for our stuff.
         GetMainSignals().Inventory(inv.hash);
 
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+        if (IsBlockInv(inv))
             break;
     }
 
@@ -5784,6 +6231,179 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/**
+ * Try to accept the orphans spending outputs of the transactions in vWorkQueue,
+ * and recursively their own orphan children.
+ */
+static void ProcessOrphanTransactions(vector<uint256> vWorkQueue, CMasternodesViewCache& mnview) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    vector<uint256> vEraseQueue;
+    set<NodeId> setMisbehaving;
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++)
+    {
+        for (const auto& orphan : orphanTxPool.GetChildren(vWorkQueue[i]))
+        {
+            const CTransaction& orphanTx = orphan.first;
+            const uint256 orphanHash = orphanTx.GetHash();
+            NodeId fromPeer = orphan.second;
+            bool fMissingInputs2 = false;
+            // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+            // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+            // anyone relaying LegitTxX banned)
+            CValidationState stateDummy;
+
+
+            if (setMisbehaving.count(fromPeer))
+                continue;
+            if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2, boost::bind(CheckMasternodeTx, boost::ref(mnview), _1, _2, _3, true)))
+            {
+                LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                RelayTransaction(orphanTx);
+                vWorkQueue.push_back(orphanHash);
+                vEraseQueue.push_back(orphanHash);
+            }
+            else if (!fMissingInputs2)
+            {
+                int nDos = 0;
+                if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                {
+                    // Punish peer that gave us an invalid orphan tx
+                    Misbehaving(fromPeer, nDos);
+                    setMisbehaving.insert(fromPeer);
+                    LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
+                }
+                // Has inputs but not accepted to mempool
+                // Probably non-standard or insufficient fee/priority
+                LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                vEraseQueue.push_back(orphanHash);
+                assert(recentRejects);
+                recentRejects->insert(orphanHash);
+            }
+            mempool.check(pcoinsTip);
+        }
+    }
+
+    BOOST_FOREACH(uint256 hash, vEraseQueue)
+        orphanTxPool.EraseTx(hash);
+}
+
+/**
+ * Commit stage of mempool admission for a transaction received from a peer:
+ * accept it to the dPoS controller and the mempool, relay it, resolve
+ * dependent orphans and punish the peer for invalid data.
+ */
+void ProcessTransactionFromPeer(CNode* pfrom, const CTransaction& tx)
+{
+    vector<uint256> vWorkQueue;
+    CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK(cs_main);
+
+    bool fMissingInputs = false;
+    CValidationState state; // mempool validation state
+    CValidationState state_dpos; // dpos validation state
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv);
+
+    const bool areadyHad = AlreadyHave(inv);
+
+    // accept to dPoS controller
+    if (tx.fInstant) {
+        dpos::getController()->proceedTransaction(tx, state_dpos);
+    }
+
+    CMasternodesViewCache mnview(pmasternodesview);
+    if (!areadyHad && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, boost::bind(CheckMasternodeTx, boost::ref(mnview), _1, _2, _3, true)))
+    {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+        vWorkQueue.push_back(inv.hash);
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
+            pfrom->id, pfrom->cleanSubVer,
+            tx.GetHash().ToString(),
+            mempool.mapTx.size());
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTransactions(vWorkQueue, mnview);
+    }
+    // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
+    else if (fMissingInputs &&
+             tx.vJoinSplit.empty() &&
+             tx.vShieldedSpend.empty() &&
+             tx.vShieldedOutput.empty())
+    {
+        unsigned int nMaxOrphanTxPerPeer = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantxperpeer", DEFAULT_MAX_ORPHAN_TX_PER_PEER));
+        orphanTxPool.AddTx(tx, pfrom->GetId(), GetTime(), nMaxOrphanTxPerPeer);
+
+        // DoS prevention: do not allow the orphan pool to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = orphanTxPool.Limit(nMaxOrphanTx, GetTime());
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else {
+        assert(recentRejects);
+        recentRejects->insert(tx.GetHash());
+
+        if (pfrom->fWhitelisted) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
+                RelayTransaction(tx);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
+                    tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
+            }
+        }
+    }
+    // consider instant tx as faulty only if both dpos and mempool said so
+    int nDoS = 0;
+    int nDoS_dpos = 0;
+    if (state.IsInvalid(nDoS) && (!tx.fInstant || state_dpos.IsInvalid(nDoS_dpos)))
+    {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            state.GetRejectReason());
+        pfrom->PushMessage("reject", string("tx"), state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS + nDoS_dpos);
+    }
+}
+
+/** Validate and store a block received from a peer, punishing the peer for invalid data */
+static void ProcessBlockFromPeer(CNode* pfrom, CBlock& block, const std::string& strCommand, const CChainParams& chainparams)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    CValidationState state;
+    // Process all blocks from whitelisted peers, even if not requested,
+    // unless we're still syncing with the network.
+    // Such an unrequested block may still be processed, subject to the
+    // conditions in AcceptBlock().
+    bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload(chainparams);
+    ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -5947,6 +6567,26 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // We don't push unsolicited compact blocks, so ask the peer to keep
+            // announcing with inv and request compact blocks with getdata instead
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+        }
     }
 
 
@@ -5999,11 +6639,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the addrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(hashSalt) ^ (hashAddr<<32) ^ ((GetTime()+hashAddr)/(24*60*60)));
+                    uint256 hashRand = ArithToUint256(UintToArith256(hashAddrRelaySalt) ^ (hashAddr<<32) ^ ((GetTime()+hashAddr)/(24*60*60)));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     multimap<uint256, CNode*> mapMix;
                     BOOST_FOREACH(CNode* pnode, vNodes)
@@ -6075,8 +6712,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     CNodeState *nodestate = State(pfrom->GetId());
 
                     if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - chainparams.GetConsensus().PoWTargetSpacing(pindexBestHeader->nHeight) * 20 &&
-                        nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        nodestate->nBlocksInFlight < GetBlocksInTransitLimit(nodestate)) {
+                        vToFetch.push_back(GetBlockRequest(pfrom, inv.hash, true));
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -6170,182 +6807,70 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-
-        if (IsInitialBlockDownload(chainparams))
-            return true;
-
-        CBlockIndex* pindex = NULL;
-        if (locator.IsNull())
-        {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
-                return true;
-            pindex = (*mi).second;
-        }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
-            if (pindex)
-                pindex = chainActive.Next(pindex);
-        }
-
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex))
         {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
+            LOCK(cs_main);
+
+            if (IsInitialBlockDownload(chainparams))
+                return true;
+
+            CBlockIndex* pindex = NULL;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi == mapBlockIndex.end())
+                    return true;
+                pindex = (*mi).second;
+            }
+            else
+            {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(chainActive, locator);
+                if (pindex)
+                    pindex = chainActive.Next(pindex);
+            }
+
+            int nLimit = MAX_HEADERS_RESULTS;
+            LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+            for (; pindex; pindex = chainActive.Next(pindex))
+            {
+                vHeaders.push_back(pindex->GetBlockHeader());
+                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+                    break;
+            }
         }
+        // Serialize the headers after releasing cs_main
         pfrom->PushMessage("headers", vHeaders);
     }
 
 
     else if (strCommand == "tx")
     {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
         vRecv >> tx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
-        bool fMissingInputs = false;
-        CValidationState state; // mempool validation state
-        CValidationState state_dpos; // dpos validation state
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv);
-
-        const bool areadyHad = AlreadyHave(inv);
-
-        // accept to dPoS controller
-        if (tx.fInstant) {
-            dpos::getController()->proceedTransaction(tx, state_dpos);
-        }
-
-        CMasternodesViewCache mnview(pmasternodesview);
-        if (!areadyHad && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, boost::bind(CheckMasternodeTx, boost::ref(mnview), _1, _2, _3, true)))
-        {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u)\n",
-                pfrom->id, pfrom->cleanSubVer,
-                tx.GetHash().ToString(),
-                mempool.mapTx.size());
-
-            // Recursively process any orphan transactions that depended on this one
-            set<NodeId> setMisbehaving;
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2, boost::bind(CheckMasternodeTx, boost::ref(mnview), _1, _2, _3, true)))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
-        else if (fMissingInputs &&
-                 tx.vJoinSplit.empty() &&
-                 tx.vShieldedSpend.empty() &&
-                 tx.vShieldedOutput.empty())
-        {
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else {
-            assert(recentRejects);
-            recentRejects->insert(tx.GetHash());
-
-            if (pfrom->fWhitelisted) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
-                        tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
-                }
-            }
+        // Proof and signature verification runs on the admission workers,
+        // off cs_main; without them AcceptToMemoryPool does it inline.
+        switch (txAdmissionQueue.Push(pfrom, tx)) {
+        case CTxAdmissionQueue::QUEUED:
+            break;
+        case CTxAdmissionQueue::DROPPED: {
+            // Forget the request, so the transaction is fetched again as
+            // soon as it is announced by another peer.
+            LogPrint("mempool", "admission queue full, dropping tx %s from peer=%d\n", tx.GetHash().ToString(), pfrom->id);
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(inv.hash);
+            mapAlreadyAskedFor.erase(inv);
+            break;
         }
-        // consider instant tx as faulty only if both dpos and mempool said so
-        int nDoS = 0;
-        int nDoS_dpos = 0;
-        if (state.IsInvalid(nDoS) && (!tx.fInstant || state_dpos.IsInvalid(nDoS_dpos)))
-        {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS + nDoS_dpos);
+        case CTxAdmissionQueue::NOT_RUNNING:
+            ProcessTransactionFromPeer(pfrom, tx);
+            break;
         }
     }
 
@@ -6410,28 +6935,175 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CBlock block;
         vRecv >> block;
 
-        CInv inv(MSG_BLOCK, block.GetHash());
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        LogPrint("net", "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
+        ProcessBlockFromPeer(pfrom, block, strCommand, chainparams);
+    }
 
-        pfrom->AddInventoryKnown(inv);
 
-        CValidationState state;
-        // Process all blocks from whitelisted peers, even if not requested,
-        // unless we're still syncing with the network.
-        // Such an unrequested block may still be processed, subject to the
-        // conditions in AcceptBlock().
-        bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload(chainparams);
-        ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
-        int nDoS;
-        if (state.IsInvalid(nDoS)) {
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-            if (nDoS > 0) {
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256 hash = cmpctblock.header.GetHash();
+        LogPrint("net", "received cmpctblock %s (%u txn) peer=%d\n", hash.ToString(), cmpctblock.BlockTxCount(), pfrom->id);
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            // Compact blocks are only accepted in response to our getdata
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "ignoring unrequested cmpctblock %s from peer=%d\n", hash.ToString(), pfrom->id);
+                return true;
+            }
+
+            if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock)) {
+                // Doesn't connect to our headers, fetch them along with the full block
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hash);
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+                return true;
+            }
+
+            QueuedBlock& queuedBlock = *itInFlight->second.second;
+            queuedBlock.partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            // Committed instant transactions may have left the mempool already
+            ReadStatus status = queuedBlock.partialBlock->InitData(cmpctblock, dpos::getController()->listCommittedTxs());
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block %s\n", pfrom->id, hash.ToString());
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Short ID collision, the block is still in flight so just ask for all of it
+                queuedBlock.partialBlock.reset();
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            req.blockhash = hash;
+            req.indexes = queuedBlock.partialBlock->GetMissingIndexes();
+            if (!req.indexes.empty()) {
+                pfrom->PushMessage("getblocktxn", req);
+                return true;
+            }
+
+            status = queuedBlock.partialBlock->FillBlock(block, std::vector<CTransaction>());
+            queuedBlock.partialBlock.reset();
+            if (status != READ_STATUS_OK) {
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hash)));
+                return true;
+            }
+        }
+
+        ProcessBlockFromPeer(pfrom, block, strCommand, chainparams);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CDiskBlockPos blockPos;
+        bool fRecent = false;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(mi->second)) {
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have in the main chain\n", pfrom->id);
+                return true;
+            }
+            blockPos = mi->second->GetBlockPos();
+            fRecent = mi->second->nHeight >= chainActive.Height() - MAX_BLOCKTXN_DEPTH;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, blockPos, chainparams.GetConsensus()) || block.GetHash() != req.blockhash) {
+            LogPrintf("%s: cannot load block %s requested by peer=%i\n", __func__, req.blockhash.ToString(), pfrom->GetId());
+            return true;
+        }
+
+        if (!fRecent) {
+            // We never send compact blocks this deep, the peer gets the whole block
+            pfrom->PushMessage("block", block);
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
                 LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), nDoS);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(resp.blockhash);
+            if (itInFlight == mapBlocksInFlight.end() || !itInFlight->second.second->partialBlock ||
+                    itInFlight->second.first != pfrom->GetId()) {
+                LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            QueuedBlock& queuedBlock = *itInFlight->second.second;
+            ReadStatus status = queuedBlock.partialBlock->FillBlock(block, resp.txn);
+            queuedBlock.partialBlock.reset();
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+                return true;
             }
         }
 
+        LogPrint("net", "received blocktxn %s (%u txn) peer=%d\n", resp.blockhash.ToString(), resp.txn.size(), pfrom->id);
+        ProcessBlockFromPeer(pfrom, block, strCommand, chainparams);
+    }
+
+
+    else if (strCommand == CInv{MSG_DPOS_BLOCK, uint256{}}.GetCommand() && !fImporting && !fReindex)
+    {
+        dpos::CApprovedBlock_p2p approvedBlock{};
+        vRecv >> approvedBlock;
+        const uint256 hash{approvedBlock.GetHash()};
+
+        CBlock block{};
+        bool fReconstructed{false};
+        {
+            LOCK(cs_main);
+            CBlock viceBlock{};
+            fReconstructed = dpos::getController()->findViceBlock(hash, &viceBlock) &&
+                             approvedBlock.reconstruct(viceBlock, block);
+        }
+        if (!fReconstructed) {
+            // The vice-block was dropped since we asked for the approved block
+            LogPrint("net", "can't reconstruct dpos block %s, requesting it in full from peer=%d\n", hash.ToString(), pfrom->id);
+            pfrom->PushMessage("getdata", std::vector<CInv>{CInv(MSG_BLOCK, hash)});
+            return true;
+        }
+
+        LogPrint("net", "received dpos block %s (%u signature bytes) peer=%d\n", hash.ToString(), approvedBlock.vSig.size(), pfrom->id);
+        ProcessBlockFromPeer(pfrom, block, strCommand, chainparams);
     }
 
 
@@ -6461,7 +7133,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     {
         int currentHeight = GetHeight();
 
-        LOCK2(cs_main, pfrom->cs_filter);
+        // The mempool has its own lock, no need for cs_main
+        LOCK(pfrom->cs_filter);
 
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
@@ -6694,14 +7367,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> tipHash >> interestedTxs;
         std::set<TxId> setOfInterestedTxs{interestedTxs.begin(), interestedTxs.end()};
 
-        for (const auto& vote : dpos::getController()->listTxVotes()) {
-            if (vote.tip == tipHash) {
-                for (const auto& choice : vote.choices) {
-                    if (setOfInterestedTxs.empty() || setOfInterestedTxs.count(choice.subject)) {
-                        reply.emplace_back(MSG_TX_VOTE, vote.GetHash());
-                    }
-                }
-            }
+        for (const auto& voteHash : dpos::getController()->listTxVoteHashes(tipHash, setOfInterestedTxs)) {
+            reply.emplace_back(MSG_TX_VOTE, voteHash);
         }
         pfrom->PushMessage("inv", reply);
     } else if (strCommand == "getrvotes") {
@@ -6709,10 +7376,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 tipHash{};
         vRecv >> tipHash;
 
-        for (const auto& vote : dpos::getController()->listRoundVotes()) {
-            if (vote.tip == tipHash) {
-                reply.emplace_back(MSG_ROUND_VOTE, vote.GetHash());
-            }
+        for (const auto& voteHash : dpos::getController()->listRoundVoteHashes(tipHash)) {
+            reply.emplace_back(MSG_ROUND_VOTE, voteHash);
         }
         pfrom->PushMessage("inv", reply);
     } else if (strCommand == "getvblocks") {
@@ -6720,10 +7385,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 tipHash{};
         vRecv >> tipHash;
 
-        for (const auto& block : dpos::getController()->listViceBlocks()) {
-            if (block.hashPrevBlock == tipHash) {
-                reply.emplace_back(MSG_VICE_BLOCK, block.GetHash());
-            }
+        for (const auto& blockHash : dpos::getController()->listViceBlockHashes(tipHash)) {
+            reply.emplace_back(MSG_VICE_BLOCK, blockHash);
         }
         pfrom->PushMessage("inv", reply);
     } else if (strCommand == CInv{MSG_HEARTBEAT, uint256{}}.GetCommand()) {
@@ -6844,6 +7507,7 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        const int64_t nTimeStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
@@ -6876,6 +7540,9 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        const int64_t nTimeEnd = GetTimeMicros();
+        pfrom->RecordMsgRecv(strCommand, nMessageSize + CMessageHeader::HEADER_SIZE, nTimeEnd - nTimeStart, nTimeStart - msg.nTime);
+
         if (!fRet)
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
 
@@ -6933,21 +7600,24 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             return true;
 
         // Address refresh broadcast
-        static int64_t nLastRebroadcast;
-        if (!IsInitialBlockDownload(chainParams) && (GetTime() - nLastRebroadcast > 24 * 60 * 60))
+        // Shared by all message handler threads; only the thread that moves
+        // the timestamp forward does the rebroadcast.
+        static std::atomic<int64_t> nLastRebroadcast(0);
+        int64_t nLastRebroadcastSeen = nLastRebroadcast.load();
+        const int64_t nRebroadcastTime = GetTime();
+        if (!IsInitialBlockDownload(chainParams) && (nRebroadcastTime - nLastRebroadcastSeen > 24 * 60 * 60) &&
+            nLastRebroadcast.compare_exchange_strong(nLastRebroadcastSeen, nRebroadcastTime))
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodes)
             {
                 // Periodically clear addrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
+                if (nLastRebroadcastSeen)
                     pnode->addrKnown.reset();
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
             }
-            if (!vNodes.empty())
-                nLastRebroadcast = GetTime();
         }
 
         //
@@ -7022,25 +7692,52 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: inventory
         //
+        // Inventory is batched for INVENTORY_BROADCAST_INTERVAL, so bursts of
+        // relayed votes and heartbeats go out in a few large inv messages
         vector<CInv> vInv;
         vector<CInv> vInvWait;
+        // The peer's trickle turn rarely coincides with a flush, so the
+        // waiting tx inventory goes out with the flush that follows it
+        if (fSendTrickle)
+            pto->fTrickleInvNext = true;
+        const int64_t nNowInv = GetTimeMicros();
+        if (pto->fSendInvNow || nNowInv >= pto->nNextInvSend)
         {
+            pto->nNextInvSend = nNowInv + INVENTORY_BROADCAST_INTERVAL * 1000;
+            const bool fTrickleInv = pto->fTrickleInvNext;
+            pto->fTrickleInvNext = false;
+
+            // Pick up the inventory relayed to all peers since the last flush
+            for (const CRelayInv& relay : relayInvQueue.Read(pto->nRelayInvPos))
+            {
+                if (pto->nVersion < relay.nMinVersion)
+                    continue;
+                if (relay.tx)
+                {
+                    if (!pto->fRelayTxes)
+                        continue;
+                    LOCK(pto->cs_filter);
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*relay.tx))
+                        continue;
+                }
+                pto->PushInventory(relay.inv);
+            }
+
             LOCK(pto->cs_inventory);
+            pto->fSendInvNow = false;
             vInv.reserve(pto->vInventoryToSend.size());
             vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                const std::vector<unsigned char> vKey = CNode::GetInventoryKnownKey(inv);
+                if (pto->filterInventoryKnown.contains(vKey))
                     continue;
 
                 // trickle out tx inv to protect privacy
-                if (inv.type == MSG_TX && !fSendTrickle)
+                if (inv.type == MSG_TX && !fTrickleInv)
                 {
                     // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
+                    uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashTrickleSalt));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
 
@@ -7051,15 +7748,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+                pto->filterInventoryKnown.insert(vKey);
+                vInv.push_back(inv);
+                if (vInv.size() >= MAX_INV_SZ)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
             }
             pto->vInventoryToSend = vInvWait;
@@ -7103,12 +7797,20 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload(chainParams)) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInTransitLimit = GetBlocksInTransitLimit(&state);
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload(chainParams)) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
-                vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindex->GetBlockHash());
+                if (itInFlight != mapBlocksInFlight.end()) {
+                    // Taken over from a slow peer, which is accounted the time it has held the block so far
+                    UpdateBlockDeliveryTime(State(itInFlight->second.first), nNow - itInFlight->second.second->nTime);
+                    LogPrint("net", "Reassigning block %s (%d) from peer=%d to peer=%d\n", pindex->GetBlockHash().ToString(),
+                        pindex->nHeight, itInFlight->second.first, pto->id);
+                }
+                vGetData.push_back(GetBlockRequest(pto, pindex->GetBlockHash(), false));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
                 LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->id);
@@ -7166,10 +7868,6 @@ public:
         for (; it1 != mapBlockIndex.end(); it1++)
             delete (*it1).second;
         mapBlockIndex.clear();
-
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
     }
 } instance_of_cmaincleanup;
 
@@ -36,6 +36,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -76,6 +77,10 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempooldumpinterval, in seconds between periodic mempool dumps (0 = only at shutdown) */
+static const int64_t DEFAULT_MEMPOOL_DUMP_INTERVAL = 15 * 60;
 /** Default for -txexpirydelta, in number of blocks */
 static const unsigned int DEFAULT_PRE_BLOSSOM_TX_EXPIRY_DELTA = 20;
 static const unsigned int DEFAULT_POST_BLOSSOM_TX_EXPIRY_DELTA = DEFAULT_PRE_BLOSSOM_TX_EXPIRY_DELTA * Consensus::BLOSSOM_POW_TARGET_SPACING_RATIO;
@@ -92,7 +97,15 @@ static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** Number of blocks requested from a peer whose throughput hasn't been measured yet. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Number of blocks that can always be requested from a peer, however slow it is. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Per-peer download windows are sized to hold about this many microseconds of block deliveries. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_TIME = 10 * 1000000;
+/** A block holding back the download window is requested again from a peer that delivers this many times faster. */
+static const int BLOCK_REASSIGN_SPEEDUP = 4;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -103,6 +116,8 @@ static const unsigned int MAX_HEADERS_RESULTS = 160;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Number of recently served blocks kept as ready-to-send "block" messages */
+static const unsigned int MAX_SERVED_BLOCK_CACHE = 16;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -119,11 +134,6 @@ BOOST_STATIC_ASSERT(DEFAULT_BLOCK_PRIORITY_SIZE <= DEFAULT_BLOCK_MAX_SIZE);
     ((CBlockHeader::HEADER_SIZE + equihash_solution_size(N, K))*MAX_HEADERS_RESULTS < \
      MAX_PROTOCOL_MESSAGE_LENGTH-1000)
 
-struct BlockHasher
-{
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
-
 extern boost::optional<unsigned int> expiryDeltaArg;
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
@@ -289,12 +299,23 @@ void PruneAndFlush();
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, std::function<bool(CTransaction const &, Consensus::Params const &, int)> mntxChecker, bool fRejectAbsurdFee=false);
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, std::function<bool(CTransaction const &, Consensus::Params const &, int)> mntxChecker, bool fRejectAbsurdFee=false);
+/** Dump the mempool to disk. */
+bool DumpMempool();
+/** Load the mempool from disk. */
+bool LoadMempool();
+/** Commit a transaction received from a peer to the memory pool (takes cs_main) */
+void ProcessTransactionFromPeer(CNode* pfrom, const CTransaction& tx);
 
 
 struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
+    int64_t nBlockDeliveryTime;
+    int nBlocksInTransitLimit;
     std::vector<int> vHeightInFlight;
 };
 
@@ -451,6 +472,12 @@ bool GetAddressIndex(const uint160& addressHash, int type,
         int start = 0, int end = 0);
 bool GetAddressUnspent(const uint160& addressHash, int type,
         std::vector<CAddressUnspentDbEntry>& unspentOutputs);
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value);
+/** Visit address index entries from keyFrom on, see CBlockTreeDB::ScanAddressIndex */
+bool ScanAddressIndex(const CAddressIndexKey& keyFrom, int end,
+        boost::function<bool(const CAddressIndexDbEntry&)> fn);
+bool ScanAddressUnspent(const CAddressUnspentKey& keyFrom,
+        boost::function<bool(const CAddressUnspentDbEntry&)> fn);
 bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
     std::vector<std::pair<uint256, unsigned int> > &hashes);
 
@@ -458,6 +485,13 @@ bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read the serialized block at pos without deserializing it. Only the header
+ * is parsed, to check that it is the block with the given hash.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart);
+/** Size of the serialized block at pos, after the same checks as ReadRawBlockFromDisk */
+bool ReadRawBlockSizeFromDisk(unsigned int& nSize, const CDiskBlockPos& pos, const uint256& hash, const CMessageHeader::MessageStartChars& messageStart);
 
 struct DposValidationRules {
     size_t nMaxInstsSize = MAX_INST_SECTION_SIZE;
@@ -586,6 +620,20 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * Snapshot of chainActive as of the last tip change. It is published after
+ * every tip update and can be read without cs_main, for read-only queries that
+ * should not wait for block validation. Never NULL.
+ */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
+/**
+ * Find a block of the active chain by hash without taking cs_main.
+ * Returns NULL if the block is unknown or not in the active chain, the result
+ * may lag behind GetChainSnapshot() while the tip is being updated.
+ */
+const CBlockIndex* LookupActiveChainBlock(const uint256& hash);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -13,6 +13,7 @@
 #include "../txdb.h"
 #include "../wallet/wallet.h"
 #include "../snark/libsnark/common/utils.hpp"
+#include <algorithm>
 #include <mutex>
 #include <future>
 #include <boost/thread.hpp>
@@ -279,6 +280,7 @@ void CDposController::loadDB()
     assert(pdposdb != nullptr);
     assert(!this->voter->checkAmIVoter());
     assert(this->initialVotesDownload);
+    LOCK(cs_main);
 
     voter->minQuorum = Params().GetConsensus().dpos.nMinQuorum;
     voter->numOfVoters = Params().GetConsensus().dpos.nTeamSize;
@@ -307,7 +309,7 @@ void CDposController::loadDB()
             roundVote.nRound = vote.nRound;
             roundVote.choice = vote.choice;
 
-            this->receivedRoundVotes.emplace(vote.GetHash(), vote);
+            this->addRoundVote(vote.GetHash(), vote);
             this->voter->insertRoundVote(roundVote);
         }
     });
@@ -329,7 +331,7 @@ void CDposController::loadDB()
 
                 this->voter->insertTxVote(txVote);
             }
-            this->receivedTxVotes.emplace(vote.GetHash(), vote);
+            this->addTxVote(vote.GetHash(), vote);
         }
     });
     if (!success)
@@ -337,6 +339,16 @@ void CDposController::loadDB()
 
     if (!this->voter->verifyVotingState())
         throw std::runtime_error("dPoS database is corrupted (voting state verification failed)! Please restart with -reindex to recover.");
+
+    // the loaded votes were inserted without voting, so the commits are looked up here
+    const int64_t nNow{GetTime()};
+    for (const auto& votingPair : this->voter->v) {
+        for (const auto& txVotingPair : votingPair.second.txVotes) {
+            if (this->voter->calcTxVotingStats(txVotingPair.first, votingPair.first, 1).pro >= this->voter->minQuorum) {
+                logCommittedTx(txVotingPair.first, votingPair.first, nNow);
+            }
+        }
+    }
 }
 
 void CDposController::onChainTipUpdated(const BlockHash& tip)
@@ -356,6 +368,7 @@ void CDposController::onChainTipUpdated(const BlockHash& tip)
 
     CValidationState state;
     this->voter->updateTip(tip);
+    updateCommitLog();
     handleVoterOutput(this->voter->requestMissingTxs() + this->voter->doTxsVoting() + this->voter->doRoundVoting(), state);
 
     // periodically rm waste data from old blocks
@@ -399,11 +412,11 @@ void CDposController::proceedRoundVote(const CRoundVote_p2p& vote, CValidationSt
     LOCK(cs_main);
     {
         if (!findRoundVote(voteHash)) {
-            this->receivedRoundVotes.emplace(voteHash, vote); // emplace before to be able to find signature to submit block
+            this->addRoundVote(voteHash, vote); // emplace before to be able to find signature to submit block
             if (acceptRoundVote(vote, state)) {
                 success = true;
             } else {
-                this->receivedRoundVotes.erase(voteHash);
+                this->eraseRoundVote(voteHash);
             }
         }
     }
@@ -421,12 +434,12 @@ void CDposController::proceedTxVote(const CTxVote_p2p& vote, CValidationState& s
         LOCK(cs_main);
         if (!findTxVote(voteHash)) {
             if (acceptTxVote(vote, state)) {
+                this->addTxVote(voteHash, vote);
                 success = true;
             }
         }
     }
     if (success) {
-        this->receivedTxVotes.emplace(voteHash, vote);
         storeEntity(vote, &CDposDB::WriteTxVote, voteHash);
         relayEntity(vote, MSG_TX_VOTE);
     }
@@ -532,6 +545,57 @@ std::vector<CTxVote_p2p> CDposController::listTxVotes() const
     return rv;
 }
 
+std::vector<BlockHash> CDposController::listViceBlockHashes(const BlockHash& tip) const
+{
+    std::vector<BlockHash> rv{};
+    LOCK(cs_main);
+
+    const auto it{this->voter->v.find(tip)};
+    if (it != this->voter->v.end()) {
+        rv.reserve(it->second.viceBlocks.size());
+        for (const auto& pair : it->second.viceBlocks) {
+            rv.push_back(pair.first);
+        }
+    }
+
+    return rv;
+}
+
+std::vector<uint256> CDposController::listRoundVoteHashes(const BlockHash& tip) const
+{
+    LOCK(cs_main);
+    const auto it{this->roundVotesByTip.find(tip)};
+    if (it == this->roundVotesByTip.end()) {
+        return {};
+    }
+    return {it->second.begin(), it->second.end()};
+}
+
+std::vector<uint256> CDposController::listTxVoteHashes(const BlockHash& tip, const std::set<TxId>& subjects) const
+{
+    std::set<uint256> rv{};
+    LOCK(cs_main);
+
+    const auto it{this->txVotesByTip.find(tip)};
+    if (it == this->txVotesByTip.end()) {
+        return {};
+    }
+    if (subjects.empty()) {
+        for (const auto& pair : it->second) {
+            rv.insert(pair.second.begin(), pair.second.end());
+        }
+    } else {
+        for (const TxId& subject : subjects) {
+            const auto itSubject{it->second.find(subject)};
+            if (itSubject != it->second.end()) {
+                rv.insert(itSubject->second.begin(), itSubject->second.end());
+            }
+        }
+    }
+
+    return {rv.begin(), rv.end()};
+}
+
 std::vector<CTransaction> CDposController::listCommittedTxs(uint32_t maxdeep) const
 {
     LOCK(cs_main);
@@ -593,6 +657,16 @@ CTxVotingDistribution CDposController::calcTxVotingStats(const TxId& txid) const
     return this->voter->calcTxVotingStats(txid, this->voter->getTip(), 1);
 }
 
+boost::optional<CCommittedTx> CDposController::getCommittedTx(const TxId& txid) const
+{
+    return this->commitLog.get(txid);
+}
+
+std::vector<CCommittedTx> CDposController::listCommittedTxsSince(uint64_t nSequence, uint64_t* pnLastSequence, bool* pfComplete) const
+{
+    return this->commitLog.listSince(nSequence, pnLastSequence, pfComplete);
+}
+
 bool CDposController::isMinableTx(const CTransaction& tx, uint32_t maxdeep) const
 {
     LOCK(cs_main);
@@ -602,6 +676,18 @@ bool CDposController::isMinableTx(const CTransaction& tx, uint32_t maxdeep) cons
 bool CDposController::handleVoterOutput(const CDposVoterOutput& out, CValidationState& state)
 {
     AssertLockHeld(cs_main);
+    // pass the voting events on to the subscribers, they are reported even along with errors
+    for (const auto& viceBlock : out.vViceBlocks) {
+        GetMainSignals().DposViceBlock(viceBlock.hash, viceBlock.tip, viceBlock.nRound);
+    }
+    for (const auto& quorum : out.vRoundQuorums) {
+        GetMainSignals().DposRoundQuorum(quorum.tip, quorum.nRound, quorum.viceBlock, quorum.nVotes);
+    }
+    for (const auto& commit : out.vTxCommits) {
+        logCommittedTx(commit.txid, commit.tip, GetTime());
+        GetMainSignals().DposTxCommitted(commit.txid, commit.tip);
+    }
+
     if (!out.vErrors.empty()) {
         for (const auto& error : out.vErrors) {
             LogPrintf("dpos: %s: %s\n", __func__, error);
@@ -624,7 +710,7 @@ bool CDposController::handleVoterOutput(const CDposVoterOutput& out, CValidation
                     LogPrintf("dpos: %s: Can't sign round vote\n", __func__);
                 } else {
                     const uint256 voteHash{vote.GetHash()};
-                    this->receivedRoundVotes.emplace(voteHash, vote);
+                    this->addRoundVote(voteHash, vote);
                     storeEntity(vote, &CDposDB::WriteRoundVote, voteHash);
                     relayEntity(vote, MSG_ROUND_VOTE);
                 }
@@ -639,7 +725,7 @@ bool CDposController::handleVoterOutput(const CDposVoterOutput& out, CValidation
                     LogPrintf("dpos: %s: Can't sign tx vote\n", __func__);
                 } else {
                     const uint256 voteHash{vote.GetHash()};
-                    this->receivedTxVotes.emplace(voteHash, vote);
+                    this->addTxVote(voteHash, vote);
                     storeEntity(vote, &CDposDB::WriteTxVote, voteHash);
                     relayEntity(vote, MSG_TX_VOTE);
                 }
@@ -810,6 +896,168 @@ boost::optional<CMasternode::ID> CDposController::authenticateMsg(const CRoundVo
     return getIdOfTeamMember(vote.tip, pubKey.GetID(), state);
 }
 
+void CDposController::addRoundVote(const uint256& voteHash, const CRoundVote_p2p& vote)
+{
+    AssertLockHeld(cs_main);
+    if (this->receivedRoundVotes.emplace(voteHash, vote).second) {
+        this->roundVotesByTip[vote.tip].insert(voteHash);
+    }
+}
+
+void CDposController::eraseRoundVote(const uint256& voteHash)
+{
+    AssertLockHeld(cs_main);
+    const auto it{this->receivedRoundVotes.find(voteHash)};
+    if (it == this->receivedRoundVotes.end()) {
+        return;
+    }
+    const auto itTip{this->roundVotesByTip.find(it->second.tip)};
+    if (itTip != this->roundVotesByTip.end()) {
+        itTip->second.erase(voteHash);
+        if (itTip->second.empty()) {
+            this->roundVotesByTip.erase(itTip);
+        }
+    }
+    this->receivedRoundVotes.erase(it);
+}
+
+void CDposController::addTxVote(const uint256& voteHash, const CTxVote_p2p& vote)
+{
+    AssertLockHeld(cs_main);
+    if (this->receivedTxVotes.emplace(voteHash, vote).second) {
+        auto& bySubject = this->txVotesByTip[vote.tip];
+        for (const auto& choice : vote.choices) {
+            bySubject[choice.subject].insert(voteHash);
+        }
+    }
+}
+
+void CDposController::eraseTxVote(const uint256& voteHash)
+{
+    AssertLockHeld(cs_main);
+    const auto it{this->receivedTxVotes.find(voteHash)};
+    if (it == this->receivedTxVotes.end()) {
+        return;
+    }
+    const auto itTip{this->txVotesByTip.find(it->second.tip)};
+    if (itTip != this->txVotesByTip.end()) {
+        for (const auto& choice : it->second.choices) {
+            const auto itSubject{itTip->second.find(choice.subject)};
+            if (itSubject != itTip->second.end()) {
+                itSubject->second.erase(voteHash);
+                if (itSubject->second.empty()) {
+                    itTip->second.erase(itSubject);
+                }
+            }
+        }
+        if (itTip->second.empty()) {
+            this->txVotesByTip.erase(itTip);
+        }
+    }
+    this->receivedTxVotes.erase(it);
+}
+
+void CDposController::logCommittedTx(const TxId& txid, const BlockHash& tip, int64_t nTime)
+{
+    AssertLockHeld(cs_main);
+    const auto inserted = this->commitsByVoting[tip].emplace(txid, nTime);
+    if (inserted.second && this->commitLogVotings.count(tip) != 0) {
+        this->commitLog.add(txid, tip, nTime);
+    }
+}
+
+void CDposController::updateCommitLog()
+{
+    AssertLockHeld(cs_main);
+    const std::vector<BlockHash> votings{this->voter->listVotings(this->voter->getTip())};
+    this->commitLogVotings = std::set<BlockHash>{votings.begin(), votings.end()};
+
+    LOCK(this->commitLog.cs);
+    // the commits of votings which are too old now, or aren't in the chain anymore, are replaced by
+    // their removals, so that a client following the log learns about them
+    this->commitLog.removeExcept(this->commitLogVotings, GetTime());
+    // the commits of the newly included votings get logged, the oldest voting first.
+    // A tx committed at a dropped voting and at a newly included one is logged again.
+    for (auto itVot = votings.rbegin(); itVot != votings.rend(); ++itVot) {
+        const auto itCommits = this->commitsByVoting.find(*itVot);
+        if (itCommits == this->commitsByVoting.end())
+            continue;
+        for (const auto& commitPair : itCommits->second) {
+            this->commitLog.add(commitPair.first, *itVot, commitPair.second);
+        }
+    }
+}
+
+void CCommitLog::add(const TxId& txid, const BlockHash& tip, int64_t nTime)
+{
+    LOCK(cs);
+    if (this->commits.count(txid) != 0)
+        return;
+
+    CCommittedTx entry{};
+    entry.txid = txid;
+    entry.tip = tip;
+    entry.nSequence = ++this->nLastSequence;
+    entry.nTime = nTime;
+    this->commits.emplace(txid, entry.nSequence);
+    this->entriesBySequence.emplace(entry.nSequence, entry);
+}
+
+void CCommitLog::removeExcept(const std::set<BlockHash>& validTips, int64_t nTime)
+{
+    LOCK(cs);
+    std::vector<CCommittedTx> removed;
+    for (auto it = this->commits.begin(); it != this->commits.end();) {
+        const auto itEntry = this->entriesBySequence.find(it->second);
+        if (validTips.count(itEntry->second.tip) == 0) {
+            removed.push_back(itEntry->second);
+            this->entriesBySequence.erase(itEntry);
+            it = this->commits.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::sort(removed.begin(), removed.end(), [](const CCommittedTx& a, const CCommittedTx& b) {
+        return a.nSequence < b.nSequence;
+    });
+    for (CCommittedTx& entry : removed) {
+        entry.nSequence = ++this->nLastSequence;
+        entry.nTime = nTime;
+        entry.fRemoved = true;
+        this->entriesBySequence.emplace(entry.nSequence, entry);
+        this->removals.push_back(entry.nSequence);
+    }
+    while (this->removals.size() > this->nMaxRemovals) {
+        this->nForgottenRemovalSequence = this->removals.front();
+        this->entriesBySequence.erase(this->removals.front());
+        this->removals.pop_front();
+    }
+}
+
+boost::optional<CCommittedTx> CCommitLog::get(const TxId& txid) const
+{
+    LOCK(cs);
+    const auto it = this->commits.find(txid);
+    if (it == this->commits.end())
+        return boost::none;
+    return this->entriesBySequence.at(it->second);
+}
+
+std::vector<CCommittedTx> CCommitLog::listSince(uint64_t nSequence, uint64_t* pnLastSequence, bool* pfComplete) const
+{
+    std::vector<CCommittedTx> rv{};
+    LOCK(cs);
+    for (auto it = this->entriesBySequence.upper_bound(nSequence); it != this->entriesBySequence.end(); ++it) {
+        rv.push_back(it->second);
+    }
+    if (pnLastSequence != nullptr)
+        *pnLastSequence = this->nLastSequence;
+    // a listing from 0 holds every valid commit, forgotten removals don't matter to it
+    if (pfComplete != nullptr)
+        *pfComplete = nSequence == 0 || nSequence >= this->nForgottenRemovalSequence;
+    return rv;
+}
+
 void CDposController::cleanUpDb()
 {
     AssertLockHeld(cs_main);
@@ -821,25 +1069,18 @@ void CDposController::cleanUpDb()
 
         // if unknown, or old
         if (votingTipHeight < 0 || ((tipHeight - votingTipHeight) > MAX_BLOCKS_TO_KEEP)) {
-            for (auto it{this->receivedRoundVotes.begin()}; it != this->receivedRoundVotes.end();) {
-                if (it->second.tip == vot) {
-                    pdposdb->EraseRoundVote(it->first);
-                    it = this->receivedRoundVotes.erase(it);
-                } else {
-                    ++it;
-                }
+            for (const uint256& voteHash : listRoundVoteHashes(vot)) {
+                pdposdb->EraseRoundVote(voteHash);
+                eraseRoundVote(voteHash);
             }
-            for (auto it{this->receivedTxVotes.begin()}; it != this->receivedTxVotes.end();) {
-                if (it->second.tip == vot) {
-                    pdposdb->EraseTxVote(it->first);
-                    it = this->receivedTxVotes.erase(it);
-                } else {
-                    ++it;
-                }
+            for (const uint256& voteHash : listTxVoteHashes(vot, std::set<TxId>{})) {
+                pdposdb->EraseTxVote(voteHash);
+                eraseTxVote(voteHash);
             }
             for (const auto& bpair: itV->second.viceBlocks) {
                 pdposdb->EraseViceBlock(bpair.first);
             }
+            this->commitsByVoting.erase(vot);
             itV = this->voter->v.erase(itV);
         } else {
             ++itV;
@@ -6,11 +6,14 @@
 
 #include "dpos_p2p_messages.h"
 #include "dpos_voter.h"
+#include "../chain.h"
 #include "../primitives/block.h"
+#include <deque>
 #include <map>
 #include <memory>
 #include <protocol.h>
 #include <net.h>
+#include <boost/unordered_map.hpp>
 
 class CKeyID;
 class CBlockIndex;
@@ -46,6 +49,59 @@ namespace dpos
 class CDposVoter;
 struct CDposVoterOutput;
 
+/** Most removals the commit log remembers, older ones are forgotten */
+static const size_t MAX_COMMIT_LOG_REMOVALS = 10000;
+
+/** Entry of the commit log of instant transactions */
+struct CCommittedTx
+{
+    TxId txid;
+    BlockHash tip;          //!< tip of the voting the tx was committed at
+    uint64_t nSequence = 0; //!< position in the commit log, grows with every logged commit or removal
+    int64_t nTime = 0;      //!< when the commit (or its removal) was seen
+    bool fRemoved = false;  //!< the commit isn't valid at the current tip anymore
+};
+
+/**
+ * Log of the txs committed at the current tip, which clients follow by sequence number. Commits
+ * that stop being valid are replaced by their removals, of which the latest nMaxRemovals are
+ * remembered. Has its own lock, so the lookups don't wait for cs_main.
+ */
+class CCommitLog
+{
+public:
+    explicit CCommitLog(size_t nMaxRemovals = MAX_COMMIT_LOG_REMOVALS) : nMaxRemovals(nMaxRemovals) {}
+
+    /** Log the commit of txid at tip, unless txid is logged already */
+    void add(const TxId& txid, const BlockHash& tip, int64_t nTime);
+    /** Replace the commits at tips other than validTips by their removals, in the order they were logged */
+    void removeExcept(const std::set<BlockHash>& validTips, int64_t nTime);
+
+    boost::optional<CCommittedTx> get(const TxId& txid) const;
+    /**
+     * Commits logged after nSequence which are still valid, and the removals of commits logged
+     * after nSequence, in the order they happened.
+     * @param[out] pnLastSequence set to the sequence number of the latest logged commit or removal
+     * @param[out] pfComplete set to false if removals after nSequence (> 0) were already forgotten,
+     *             the caller has to start over from 0 then. A listing from 0 is always complete.
+     */
+    std::vector<CCommittedTx> listSince(uint64_t nSequence, uint64_t* pnLastSequence = nullptr, bool* pfComplete = nullptr) const;
+
+    //! held across several changes to publish them at once
+    mutable CCriticalSection cs;
+
+private:
+    const size_t nMaxRemovals;
+    // the valid commits and the remembered removals by sequence number
+    std::map<uint64_t, CCommittedTx> entriesBySequence;
+    // sequence numbers of the valid commits by txid, and of the remembered removals
+    boost::unordered_map<TxId, uint64_t, BlockHasher> commits;
+    std::deque<uint64_t> removals;
+    uint64_t nLastSequence = 0;
+    // sequence number of the latest forgotten removal
+    uint64_t nForgottenRemovalSequence = 0;
+};
+
 class CDposController
 {
     class Validator;
@@ -80,6 +136,13 @@ public:
     std::vector<CRoundVote_p2p> listRoundVotes() const;
     std::vector<CTxVote_p2p> listTxVotes() const;
 
+    /** Hashes of the vice-blocks built on top of tip */
+    std::vector<BlockHash> listViceBlockHashes(const BlockHash& tip) const;
+    /** Hashes of the round votes at tip */
+    std::vector<uint256> listRoundVoteHashes(const BlockHash& tip) const;
+    /** Hashes of the tx votes at tip voting for one of subjects, or all of them if subjects is empty */
+    std::vector<uint256> listTxVoteHashes(const BlockHash& tip, const std::set<TxId>& subjects) const;
+
     std::vector<CTransaction> listCommittedTxs(uint32_t maxdeep = CDposVoter::GUARANTEES_MEMORY) const;
     bool isCommittedTx(const TxId& txid, uint32_t maxdeep = CDposVoter::GUARANTEES_MEMORY) const;
     bool isNotCommittableTx(const TxId& txid) const;
@@ -87,6 +150,17 @@ public:
     bool isMinableTx(const CTransaction& tx, uint32_t maxdeep = CDposVoter::GUARANTEES_MEMORY) const;
     CTxVotingDistribution calcTxVotingStats(const TxId& txid) const;
 
+    /** Commit of txid if it is committed at the current tip (like isCommittedTx), looked up without cs_main */
+    boost::optional<CCommittedTx> getCommittedTx(const TxId& txid) const;
+    /**
+     * Commits logged after nSequence which are still valid at the current tip, and the removals
+     * of commits logged after nSequence, in the order they happened.
+     * @param[out] pnLastSequence set to the sequence number of the latest logged commit or removal
+     * @param[out] pfComplete set to false if removals after nSequence (> 0) were already forgotten,
+     *             the caller has to start over from 0 then. A listing from 0 is always complete.
+     */
+    std::vector<CCommittedTx> listCommittedTxsSince(uint64_t nSequence, uint64_t* pnLastSequence = nullptr, bool* pfComplete = nullptr) const;
+
 private:
     static boost::optional<CMasternode::ID> findMyMasternodeId();
     static boost::optional<CMasternode::ID> getIdOfTeamMember(const BlockHash& blockHash, const CKeyID& operatorAuth, CValidationState& state);
@@ -104,6 +178,15 @@ private:
     bool acceptRoundVote(const CRoundVote_p2p& vote, CValidationState& state);
     bool acceptTxVote(const CTxVote_p2p& vote, CValidationState& state);
 
+    void addRoundVote(const uint256& voteHash, const CRoundVote_p2p& vote);
+    void eraseRoundVote(const uint256& voteHash);
+    void addTxVote(const uint256& voteHash, const CTxVote_p2p& vote);
+    void eraseTxVote(const uint256& voteHash);
+
+    void logCommittedTx(const TxId& txid, const BlockHash& tip, int64_t nTime);
+    /** Rebuild the commit log from the votings of the current tip */
+    void updateCommitLog();
+
     void cleanUpDb();
 
     std::vector<TxId> getTxsFilter() const;
@@ -115,6 +198,13 @@ private:
     std::set<CInv> vReqs;
     std::map<uint256, CTxVote_p2p> receivedTxVotes;
     std::map<uint256, CRoundVote_p2p> receivedRoundVotes;
+    // received votes indexed by tip (and subject), to answer getrvotes/gettxvotes without copying them
+    std::map<BlockHash, std::set<uint256>> roundVotesByTip;
+    std::map<BlockHash, std::map<TxId, std::set<uint256>>> txVotesByTip;
+    // every known commit (and the time it was seen) indexed by voting tip, and the votings of the current tip
+    std::map<BlockHash, std::map<TxId, int64_t>> commitsByVoting;
+    std::set<BlockHash> commitLogVotings;
+    CCommitLog commitLog;
 };
 
 
@@ -92,4 +92,28 @@ uint256 CRoundVote_p2p::GetSignatureHash() const
     return Hash(ss.begin(), ss.end());
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// \brief CApprovedBlock_p2p::CApprovedBlock_p2p
+
+CApprovedBlock_p2p::CApprovedBlock_p2p(const CBlock& block) :
+    header{block.GetBlockHeader()},
+    vSig{block.vSig}
+{
+}
+
+uint256 CApprovedBlock_p2p::GetHash() const
+{
+    return header.GetHash();
+}
+
+bool CApprovedBlock_p2p::reconstruct(const CBlock& viceBlock, CBlock& block) const
+{
+    if (viceBlock.GetHash() != header.GetHash()) {
+        return false;
+    }
+    block = viceBlock;
+    block.vSig = vSig;
+    return true;
+}
+
 }
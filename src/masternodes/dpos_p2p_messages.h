@@ -6,6 +6,7 @@
 
 #include "../uint256.h"
 #include "../serialize.h"
+#include "../primitives/block.h"
 #include "../primitives/transaction.h"
 #include "dpos_types.h"
 
@@ -109,6 +110,35 @@ public:
     uint256 GetSignatureHash() const;
 };
 
+/**
+ * Approved dPoS block without its transactions, relayed to peers that already
+ * have the vice-block. vSig isn't hashed, so the vice-block and the approved
+ * block share the same hash and header.
+ */
+class CApprovedBlock_p2p
+{
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vSig;
+
+    CApprovedBlock_p2p() = default;
+    explicit CApprovedBlock_p2p(const CBlock& block);
+
+    ADD_SERIALIZE_METHODS;
+
+    template<typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(header);
+        READWRITE(vSig);
+    }
+
+    uint256 GetHash() const;
+
+    /** Attach the signatures to the matching vice-block. Returns false if viceBlock doesn't match the header. */
+    bool reconstruct(const CBlock& viceBlock, CBlock& block) const;
+};
+
 }
 
 #endif //MASTERNODES_DPOS_P2P_MESSAGES_H
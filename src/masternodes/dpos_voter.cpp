@@ -59,6 +59,9 @@ CDposVoterOutput& CDposVoterOutput::operator+=(const CDposVoterOutput& r)
     std::copy(r.vTxReqs.begin(), r.vTxReqs.end(), std::back_inserter(this->vTxReqs));
     std::copy(r.vViceBlockReqs.begin(), r.vViceBlockReqs.end(), std::back_inserter(this->vViceBlockReqs));
     std::copy(r.vErrors.begin(), r.vErrors.end(), std::back_inserter(this->vErrors));
+    std::copy(r.vViceBlocks.begin(), r.vViceBlocks.end(), std::back_inserter(this->vViceBlocks));
+    std::copy(r.vRoundQuorums.begin(), r.vRoundQuorums.end(), std::back_inserter(this->vRoundQuorums));
+    std::copy(r.vTxCommits.begin(), r.vTxCommits.end(), std::back_inserter(this->vTxCommits));
     if (r.blockToSubmit) {
         this->blockToSubmit = r.blockToSubmit;
     }
@@ -283,7 +286,14 @@ CDposVoter::Output CDposVoter::applyViceBlock(const CBlock& viceBlock)
     insertViceBlock(viceBlock);
 
     LogPrintf("dpos: %s: Received vice-block %s \n", __func__, viceBlock.GetHash().GetHex());
-    return doRoundVoting();
+    Output out{};
+    CAcceptedViceBlock accepted{};
+    accepted.hash = viceBlock.GetHash();
+    accepted.tip = viceBlock.hashPrevBlock;
+    accepted.nRound = viceBlock.nRound;
+    out.vViceBlocks.push_back(accepted);
+    out += doRoundVoting();
+    return out;
 }
 
 CDposVoter::Output CDposVoter::applyTxVote(const CTxVote& vote)
@@ -329,6 +339,11 @@ CDposVoter::Output CDposVoter::applyTxVote(const CTxVote& vote)
     insertTxVote(vote);
 
     Output out{};
+    // report the commit once, by the vote which completes the quorum
+    if (vote.choice.decision == CVoteChoice::Decision::YES &&
+        calcTxVotingStats(txid, vote.tip, vote.nRound).pro == minQuorum) {
+        out.vTxCommits.push_back(CTxCommit{txid, vote.tip});
+    }
     if (txs.count(txid) == 0) {
         // request the missing tx
         out.vTxReqs.push_back(txid);
@@ -382,6 +397,16 @@ CDposVoter::Output CDposVoter::applyRoundVote(const CRoundVote& vote)
 
     // check voting result after emplaced
     if (vote.choice.decision == CVoteChoice::Decision::YES) {
+        // report the quorum once, by the vote which completes it
+        const size_t nVotes = calcRoundVotingStats(vote.tip, vote.nRound).pro[vote.choice.subject];
+        if (nVotes == minQuorum) {
+            CRoundQuorum quorum{};
+            quorum.tip = vote.tip;
+            quorum.nRound = vote.nRound;
+            quorum.viceBlock = vote.choice.subject;
+            quorum.nVotes = nVotes;
+            out.vRoundQuorums.push_back(quorum);
+        }
         out += tryToSubmitBlock(vote.choice.subject, vote.nRound);
     }
 
@@ -803,6 +828,15 @@ bool CDposVoter::isCommittedTx(const TxId& txid, BlockHash start, uint32_t votin
     return committed;
 }
 
+std::vector<BlockHash> CDposVoter::listVotings(BlockHash start, uint32_t votingsSkip, uint32_t votingsDeep) const
+{
+    std::vector<BlockHash> res{};
+    forEachVoting(start, votingsSkip, votingsDeep, [&](BlockHash vot) {
+        res.push_back(vot);
+    });
+    return res;
+}
+
 bool CDposVoter::isTxApprovedByMe(const TxId& txid, BlockHash vot) const
 {
     if (v.count(vot) == 0 || v[vot].txVotes.count(txid) == 0)
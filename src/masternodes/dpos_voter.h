@@ -61,9 +61,40 @@ struct CBlockToSubmit
     std::vector<CMasternode::ID> vApprovedBy;
 };
 
+/**
+ * When a vice-block is accepted, voter reports this object (as a part of CDposVoterOutput)
+ */
+struct CAcceptedViceBlock
+{
+    BlockHash hash;
+    BlockHash tip;
+    Round nRound = 0;
+};
+
+/**
+ * When a vice-block gets the quorum of round votes, voter reports this object (as a part of CDposVoterOutput)
+ */
+struct CRoundQuorum
+{
+    BlockHash tip;
+    Round nRound = 0;
+    BlockHash viceBlock;
+    size_t nVotes = 0;
+};
+
+/**
+ * When an instant tx gets the quorum of tx votes, voter reports this object (as a part of CDposVoterOutput)
+ */
+struct CTxCommit
+{
+    TxId txid;
+    BlockHash tip;
+};
+
 /**
  * Result of applying a new message to the voter agent.
  * Voter agent returns a new messages, which should be broadcasted to other agents.
+ * It also reports the events caused by the message, each one only once, so they may be passed on to subscribers.
  */
 struct CDposVoterOutput
 {
@@ -74,6 +105,12 @@ struct CDposVoterOutput
     boost::optional<CBlockToSubmit> blockToSubmit;
     std::vector<std::string> vErrors;
 
+    // Events
+    std::vector<CAcceptedViceBlock> vViceBlocks;
+    std::vector<CRoundQuorum> vRoundQuorums;
+    std::vector<CTxCommit> vTxCommits;
+
+    /// @return true if there is nothing to act on. Events aren't taken into account
     bool empty() const;
 
     CDposVoterOutput& operator+=(const CDposVoterOutput& r);
@@ -248,6 +285,8 @@ public:
     CommittedTxs listCommittedTxs(BlockHash start, uint32_t votingsSkip = 0, uint32_t votingsDeep = 1) const;
 
     bool isCommittedTx(const TxId& txid, BlockHash start, uint32_t votingsSkip = 0, uint32_t votingsDeep = GUARANTEES_MEMORY, Round nRound = 1) const;
+    /// @return tips of the votings [start - votingsSkip, start - votingsDeep], starting from the most recent one
+    std::vector<BlockHash> listVotings(BlockHash start, uint32_t votingsSkip = 0, uint32_t votingsDeep = GUARANTEES_MEMORY) const;
     bool isTxApprovedByMe(const TxId& txid, BlockHash vot) const;
 
     CTxVotingDistribution calcTxVotingStats(TxId txid, BlockHash vot, Round nRound) const;
@@ -158,13 +158,12 @@ CHeartBeatMessage CHeartBeatTracker::postMessage(const CKey& signKey, time_ms ti
 bool CHeartBeatTracker::recieveMessage(const CHeartBeatMessage& message, CValidationState& state)
 {
     bool rv{false};
-    CPubKey pubKey{};
+    CKeyID masternodeKey{};
     const time_ms now{GetTimeMillis()};
     const uint256 hash{message.GetHash()};
 
-    if (message.GetPubKey(pubKey)) {
+    if (recoverSigner(message, hash, masternodeKey)) {
         AssertLockHeld(cs_main);
-        const CKeyID masternodeKey{pubKey.GetID()};
 
         if (!checkMasternodeKeyAndStatus(masternodeKey))
             return state.DoS(IsInitialBlockDownload(Params()) ? 0 : 1,
@@ -189,12 +188,49 @@ bool CHeartBeatTracker::recieveMessage(const CHeartBeatMessage& message, CValida
                 it->second = messageList.cbegin();
                 rv = true;
             }
+
+            if (rv) {
+                ages.update(masternodeKey, message.GetTimestamp(), now);
+            }
         }
     }
 
     return rv;
 }
 
+bool CHeartBeatTracker::recoverSigner(const CHeartBeatMessage& message, const uint256& hash, CKeyID& keyId)
+{
+    if (message.IsNull()) {
+        return false;
+    }
+
+    {
+        LOCK(cs);
+        const auto it{signerCache.find(hash)};
+        if (it != signerCache.end()) {
+            keyId = it->second;
+            return true;
+        }
+    }
+
+    // The same heartbeat is relayed by many peers, recover its signer once
+    CPubKey pubKey{};
+    if (!message.GetPubKey(pubKey)) {
+        return false;
+    }
+    keyId = pubKey.GetID();
+
+    LOCK(cs);
+    if (signerCache.emplace(hash, keyId).second) {
+        signerCacheOrder.push_back(hash);
+        if (signerCacheOrder.size() > maxCachedSigners) {
+            signerCache.erase(signerCacheOrder.front());
+            signerCacheOrder.pop_front();
+        }
+    }
+    return true;
+}
+
 bool CHeartBeatTracker::relayMessage(const CHeartBeatMessage& message, CValidationState& state)
 {
     AssertLockHeld(cs_main);
@@ -287,32 +323,134 @@ time_ms CHeartBeatTracker::getMaxPeriod() const
 CMasternodes CHeartBeatTracker::filterMasternodes(AgeFilter ageFilter) const
 {
     AssertLockHeld(cs_main);
+    LOCK(cs);
     CMasternodes rv{};
-    const auto bounds{std::make_pair(getAvgPeriod() * 2, getMaxPeriod())};
+    const time_ms now{GetTimeMillis()};
+    const uint256 tip{chainActive.Tip() != nullptr ? chainActive.Tip()->GetBlockHash() : uint256{}};
+
+    // masternodes and the age bounds only change with the chain tip
+    if (tip != agesTip || startupTime != agesStartupTime) {
+        ages.reset(std::make_pair(getAvgPeriod() * 2, getMaxPeriod()));
+        for (const auto& mnPair : pmasternodesview->GetMasternodesByOperator()) {
+            const CMasternode& mn{pmasternodesview->GetMasternodes().at(mnPair.second)};
+            if (mn.deadSinceHeight != -1) {
+                // skip if masternode is already dead
+                continue;
+            }
+            assert(chainActive[mn.height] != nullptr);
 
-    for (const auto& mnPair : pmasternodesview->GetMasternodesByOperator()) {
-        const CMasternode& mn{pmasternodesview->GetMasternodes().at(mnPair.second)};
-        if (mn.deadSinceHeight != -1) {
-            // skip if masternode is already dead
-            continue;
+            const auto it{keyMessageMap.find(mnPair.first)};
+            const time_ms previousTime{(it != keyMessageMap.end() ? it->second->GetTimestamp() : startupTime)};
+            ages.add(mnPair.first, mnPair.second, chainActive[mn.height]->GetBlockTime() * sec, previousTime, now);
         }
-        assert(chainActive[mn.height] != nullptr);
+        agesTip = tip;
+        agesStartupTime = startupTime;
+    } else {
+        ages.advance(now);
+    }
 
-        const auto it{keyMessageMap.find(mnPair.first)};
-        const time_ms previousTime{(it != keyMessageMap.end() ? it->second->GetTimestamp() : startupTime)};
-        const time_ms previousMaxTime{std::max(previousTime, chainActive[mn.height]->GetBlockTime() * sec)};
-        const time_ms elapsed{GetTimeMillis() - previousMaxTime};
+    for (const CKeyID& keyId : ages.get(ageFilter)) {
+        const CMasternode::ID& id{ages.getId(keyId)};
+        rv.emplace(std::make_pair(id, pmasternodesview->GetMasternodes().at(id)));
+    }
 
-        const bool recently = elapsed < bounds.first && ageFilter == RECENTLY;
-        const bool stale = elapsed >= bounds.first && elapsed < bounds.second && ageFilter == STALE;
-        const bool outdated = elapsed > bounds.second && ageFilter == OUTDATED;
-        if (recently || outdated || stale)
-        {
-            rv.emplace(std::make_pair(mnPair.second, mn));
+    return rv;
+}
+
+boost::optional<CHeartBeatTracker::AgeFilter> CHeartBeatTracker::Ages::classify(time_ms elapsed, const std::pair<time_ms, time_ms>& bounds)
+{
+    if (elapsed < bounds.first)
+        return RECENTLY;
+    if (elapsed < bounds.second)
+        return STALE;
+    if (elapsed > bounds.second)
+        return OUTDATED;
+    return boost::none;
+}
+
+void CHeartBeatTracker::Ages::reset(const std::pair<time_ms, time_ms>& bounds)
+{
+    this->bounds = bounds;
+    mnAges.clear();
+    for (auto& mns : mnsByAge) {
+        mns.clear();
+    }
+    ageTimes.clear();
+}
+
+void CHeartBeatTracker::Ages::add(const CKeyID& keyId, const CMasternode::ID& id, time_ms announcedTime, time_ms lastSeenTime, time_ms now)
+{
+    MasternodeAge mnAge{};
+    mnAge.id = id;
+    mnAge.announcedTime = announcedTime;
+    mnAge.lastSeenTime = std::max(lastSeenTime, announcedTime);
+    schedule(keyId, mnAges.emplace(keyId, mnAge).first->second, now);
+}
+
+void CHeartBeatTracker::Ages::advance(time_ms now)
+{
+    while (!ageTimes.empty() && ageTimes.begin()->first <= now) {
+        const CKeyID keyId{ageTimes.begin()->second};
+        ageTimes.erase(ageTimes.begin());
+
+        MasternodeAge& mnAge{mnAges.at(keyId)};
+        if (mnAge.age) {
+            mnsByAge[*mnAge.age].erase(keyId);
         }
+        schedule(keyId, mnAge, now);
     }
+}
 
-    return rv;
+void CHeartBeatTracker::Ages::update(const CKeyID& keyId, time_ms heartbeatTime, time_ms now)
+{
+    const auto it{mnAges.find(keyId)};
+    if (it == mnAges.end()) {
+        return; // ages aren't built yet
+    }
+
+    MasternodeAge& mnAge{it->second};
+    if (mnAge.nextAgeTime != 0) {
+        ageTimes.erase(std::make_pair(mnAge.nextAgeTime, keyId));
+    }
+    if (mnAge.age) {
+        mnsByAge[*mnAge.age].erase(keyId);
+    }
+    mnAge.lastSeenTime = std::max(heartbeatTime, mnAge.announcedTime);
+    schedule(keyId, mnAge, now);
+}
+
+const std::set<CKeyID>& CHeartBeatTracker::Ages::get(AgeFilter ageFilter) const
+{
+    return mnsByAge[ageFilter];
+}
+
+const CMasternode::ID& CHeartBeatTracker::Ages::getId(const CKeyID& keyId) const
+{
+    return mnAges.at(keyId).id;
+}
+
+void CHeartBeatTracker::Ages::schedule(const CKeyID& keyId, MasternodeAge& mnAge, time_ms now)
+{
+    const time_ms elapsed{now - mnAge.lastSeenTime};
+
+    mnAge.age = classify(elapsed, bounds);
+    // the first moment at which classify() gives another age
+    if (elapsed < bounds.first) {
+        mnAge.nextAgeTime = mnAge.lastSeenTime + bounds.first;
+    } else if (elapsed < bounds.second) {
+        mnAge.nextAgeTime = mnAge.lastSeenTime + bounds.second;
+    } else if (elapsed == bounds.second) {
+        mnAge.nextAgeTime = mnAge.lastSeenTime + bounds.second + 1;
+    } else {
+        mnAge.nextAgeTime = 0;
+    }
+
+    if (mnAge.age) {
+        mnsByAge[*mnAge.age].insert(keyId);
+    }
+    if (mnAge.nextAgeTime != 0) {
+        ageTimes.emplace(mnAge.nextAgeTime, keyId);
+    }
 }
 
 CHeartBeatTracker::CHeartBeatTracker()
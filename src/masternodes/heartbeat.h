@@ -6,7 +6,10 @@
 
 #include "masternodes.h"
 #include "../serialize.h"
+#include <deque>
 #include <list>
+#include <set>
+#include <boost/optional.hpp>
 
 class CKey;
 class CInv;
@@ -55,6 +58,7 @@ class CHeartBeatTracker
     using MessageList = std::list<CHeartBeatMessage>;
     static constexpr time_ms sec{1000ll};
     static constexpr time_ms maxHeartbeatInFuture{1 * 30 * 60 * sec};
+    static constexpr size_t maxCachedSigners{10000};
 
 
 public:
@@ -77,15 +81,68 @@ public:
 
     CMasternodes filterMasternodes(AgeFilter ageFilter) const;
 
+    /**
+    * Ages of the active masternodes, kept in one bucket per age and advanced in
+    * time by a queue of the moments they change, so a filter is O(result)
+    */
+    class Ages
+    {
+    public:
+        /**
+        * Age of a masternode last seen elapsed ago: RECENTLY below the first bound,
+        * STALE up to the second one, and OUTDATED above it. Exactly at the second
+        * bound it has none, like in the original full scan.
+        */
+        static boost::optional<AgeFilter> classify(time_ms elapsed, const std::pair<time_ms, time_ms>& bounds);
+
+        void reset(const std::pair<time_ms, time_ms>& bounds);
+        /// the time a masternode was last seen at is the latest of lastSeenTime and announcedTime
+        void add(const CKeyID& keyId, const CMasternode::ID& id, time_ms announcedTime, time_ms lastSeenTime, time_ms now);
+        void advance(time_ms now);
+        /// a new heartbeat of a masternode, ignored if it isn't known
+        void update(const CKeyID& keyId, time_ms heartbeatTime, time_ms now);
+
+        const std::set<CKeyID>& get(AgeFilter ageFilter) const;
+        const CMasternode::ID& getId(const CKeyID& keyId) const;
+
+    private:
+        struct MasternodeAge
+        {
+            CMasternode::ID id;
+            time_ms announcedTime;
+            time_ms lastSeenTime;
+            boost::optional<AgeFilter> age;
+            time_ms nextAgeTime; // when the age changes next, 0 if OUTDATED
+        };
+
+        void schedule(const CKeyID& keyId, MasternodeAge& mnAge, time_ms now);
+
+        std::pair<time_ms, time_ms> bounds;
+        std::map<CKeyID, MasternodeAge> mnAges;
+        std::set<CKeyID> mnsByAge[OUTDATED + 1];
+        std::set<std::pair<time_ms, CKeyID>> ageTimes;
+    };
+
 private:
     CHeartBeatTracker();
     ~CHeartBeatTracker();
 
+    bool recoverSigner(const CHeartBeatMessage& message, const uint256& hash, CKeyID& keyId);
+
 private:
-    time_ms startupTime;
+    time_ms startupTime{0};
     MessageList messageList;
     std::map<CKeyID, MessageList::const_iterator> keyMessageMap;
     std::map<uint256, MessageList::const_iterator> hashMessageMap;
+
+    // operator keys of the heartbeats with a verified signature
+    std::map<uint256, CKeyID> signerCache;
+    std::deque<uint256> signerCacheOrder;
+
+    // Ages of the active masternodes, rebuilt when the chain tip changes
+    mutable uint256 agesTip;
+    mutable time_ms agesStartupTime{0};
+    mutable Ages ages;
 };
 
 #endif // MASTERNODES_HEARTBEAT_H
@@ -16,6 +16,7 @@
 
 #include <boost/thread.hpp>
 #include <boost/thread/synchronized_value.hpp>
+#include <memory>
 #include <string>
 #ifdef WIN32
 #include <io.h>
@@ -81,6 +82,13 @@ AtomicTimer miningTimer;
 
 static boost::synchronized_value<std::list<uint256>> trackedBlocks;
 
+struct MinerThreadMetrics {
+    AtomicCounter solutionTargetChecks;
+    AtomicTimer timer;
+};
+static std::mutex cs_minerThreadMetrics;
+static std::vector<std::unique_ptr<MinerThreadMetrics>> minerThreadMetrics;
+
 static boost::synchronized_value<std::list<std::string>> messageBox;
 static boost::synchronized_value<std::string> initMessage;
 static bool loaded = false;
@@ -94,6 +102,49 @@ void TrackMinedBlock(uint256 hash)
     trackedBlocks->push_back(hash);
 }
 
+void ResetMinerThreadMetrics(size_t nThreads)
+{
+    std::unique_lock<std::mutex> lock(cs_minerThreadMetrics);
+    minerThreadMetrics.clear();
+    for (size_t i = 0; i < nThreads; i++) {
+        minerThreadMetrics.emplace_back(new MinerThreadMetrics());
+    }
+}
+
+void MinerThreadTimerStart(size_t nThread)
+{
+    std::unique_lock<std::mutex> lock(cs_minerThreadMetrics);
+    if (nThread < minerThreadMetrics.size()) {
+        minerThreadMetrics[nThread]->timer.start();
+    }
+}
+
+void MinerThreadTimerStop(size_t nThread)
+{
+    std::unique_lock<std::mutex> lock(cs_minerThreadMetrics);
+    if (nThread < minerThreadMetrics.size()) {
+        minerThreadMetrics[nThread]->timer.stop();
+    }
+}
+
+void MinerThreadSolutionChecked(size_t nThread)
+{
+    std::unique_lock<std::mutex> lock(cs_minerThreadMetrics);
+    if (nThread < minerThreadMetrics.size()) {
+        minerThreadMetrics[nThread]->solutionTargetChecks.increment();
+    }
+}
+
+std::vector<double> GetLocalSolPSPerThread()
+{
+    std::unique_lock<std::mutex> lock(cs_minerThreadMetrics);
+    std::vector<double> rates;
+    for (const auto& metrics : minerThreadMetrics) {
+        rates.push_back(metrics->timer.rate(metrics->solutionTargetChecks));
+    }
+    return rates;
+}
+
 void MarkStartTime()
 {
     *nNodeStartTime = GetTime();
@@ -227,6 +278,15 @@ int printStats(bool mining)
     if (mining && miningTimer.running()) {
         std::cout << "    " << _("Local solution rate") << " | " << strprintf("%.4f Sol/s", localsolps) << std::endl;
         lines++;
+        auto threadsolps = GetLocalSolPSPerThread();
+        if (threadsolps.size() > 1) {
+            std::string strRates;
+            for (size_t i = 0; i < threadsolps.size(); i++) {
+                strRates += strprintf("%s%.2f", i == 0 ? "" : " / ", threadsolps[i]);
+            }
+            std::cout << "             " << _("Per thread") << " | " << strRates << " Sol/s" << std::endl;
+            lines++;
+        }
     }
     std::cout << std::endl;
 
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <mutex>
 #include <string>
+#include <vector>
 
 struct AtomicCounter {
     std::atomic<uint64_t> value;
@@ -62,6 +63,13 @@ extern AtomicTimer miningTimer;
 
 void TrackMinedBlock(uint256 hash);
 
+/** Per-thread miner metrics, indexed by the miner thread number */
+void ResetMinerThreadMetrics(size_t nThreads);
+void MinerThreadTimerStart(size_t nThread);
+void MinerThreadTimerStop(size_t nThread);
+void MinerThreadSolutionChecked(size_t nThread);
+std::vector<double> GetLocalSolPSPerThread();
+
 void MarkStartTime();
 double GetLocalSolPS();
 int EstimateNetHeight(const Consensus::Params& params, int currentBlockHeight, int64_t currentBlockTime);
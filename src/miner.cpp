@@ -35,6 +35,7 @@
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #ifdef ENABLE_MINING
+#include <atomic>
 #include <functional>
 #endif
 #include <mutex>
@@ -621,17 +622,112 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-void static BitcoinMiner(const CChainParams& chainparams)
+/** Age in seconds after which the shared block template is rebuilt to pick up new transactions */
+static const int64_t MINER_TEMPLATE_MAX_AGE = 5;
+
+/**
+ * Builds one block template per chain tip (or mempool change, at most every
+ * MINER_TEMPLATE_MAX_AGE seconds) and hands out disjoint nonce ranges of it
+ * to the miner threads, so that the threads don't each run CreateNewBlock
+ * and contend on cs_main. The top 16 bits of the template nonce select the
+ * range, the bottom 16 bits are the per-thread counter.
+ */
+class CMiningCoordinator
 {
-    LogPrintf("CrypticcoinMiner started\n");
-    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    RenameThread("crypticcoin-miner");
+public:
+    CMiningCoordinator(const CChainParams& chainparamsIn, boost::shared_ptr<CReserveScript> coinbaseScriptIn)
+        : chainparams(chainparamsIn), coinbaseScript(coinbaseScriptIn), nGeneration(0), fStale(false), pindexPrev(nullptr),
+          nTransactionsUpdatedLast(0), nTemplateTime(0), nExtraNonce(0), nNextRange(0)
+    {
+    }
+
+    /**
+     * Copy the current template into block with a fresh nonce range, rebuilding
+     * the template first if it is stale. Returns false if no template could be built.
+     */
+    bool GetWork(CBlock& block, CBlockIndex*& pindexPrevOut, uint64_t& nGenerationOut)
+    {
+        std::lock_guard<std::mutex> lock{cs};
+        if (fStale.exchange(false) || !pblocktemplate || NeedsRebuild()) {
+            nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+            pindexPrev = chainActive.Tip();
+            pblocktemplate.reset(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
+            if (!pblocktemplate)
+                return false;
+            IncrementExtraNonce(&pblocktemplate->block, pindexPrev, nExtraNonce);
+            nTemplateTime = GetTime();
+            nNextRange = 0;
+            ++nGeneration;
+
+            LogPrintf("Running CrypticcoinMiner with %u transactions in block (%u bytes)\n", pblocktemplate->block.vtx.size(),
+                ::GetSerializeSize(pblocktemplate->block, SER_NETWORK, PROTOCOL_VERSION));
+        }
+
+        block = pblocktemplate->block;
+        arith_uint256 nonce = UintToArith256(block.nNonce);
+        nonce |= arith_uint256(nNextRange++ & 0xffff) << 240;
+        block.nNonce = ArithToUint256(nonce);
+        UpdateTime(&block, chainparams.GetConsensus(), pindexPrev);
+
+        pindexPrevOut = pindexPrev;
+        nGenerationOut = nGeneration;
+        return true;
+    }
 
-    // Each thread has its own counter
-    unsigned int nExtraNonce = 0;
+    /** Whether work handed out for nGenerationIn is still worth mining */
+    bool IsCurrent(uint64_t nGenerationIn) const
+    {
+        return nGenerationIn == nGeneration.load();
+    }
+
+    /**
+     * Drop the current template and cancel the solvers working on it. Lock-free,
+     * so it is safe to call from NotifyBlockTip handlers.
+     */
+    void Invalidate()
+    {
+        fStale = true;
+        ++nGeneration;
+    }
+
+    void KeepScript()
+    {
+        std::lock_guard<std::mutex> lock{cs};
+        coinbaseScript->KeepScript();
+    }
+
+private:
+    bool NeedsRebuild() const
+    {
+        if (pindexPrev != chainActive.Tip())
+            return true;
+        if (GetTime() - nTemplateTime <= MINER_TEMPLATE_MAX_AGE)
+            return false;
+        // Instant transactions may become minable once committed, without any mempool update
+        return mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast ||
+               dpos::getController()->isEnabled(GetAdjustedTime(), pindexPrev) ||
+               nNextRange > 0xffff;
+    }
 
+    const CChainParams& chainparams;
     boost::shared_ptr<CReserveScript> coinbaseScript;
-    GetMainSignals().ScriptForMining(coinbaseScript);
+
+    std::mutex cs;
+    std::atomic<uint64_t> nGeneration;
+    std::atomic<bool> fStale;
+    unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdatedLast;
+    int64_t nTemplateTime;
+    unsigned int nExtraNonce;
+    uint64_t nNextRange;
+};
+
+void static BitcoinMiner(const CChainParams& chainparams, CMiningCoordinator& coordinator, size_t nThread)
+{
+    LogPrintf("CrypticcoinMiner started\n");
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("crypticcoin-miner");
 
     unsigned int n = chainparams.GetConsensus().nEquihashN;
     unsigned int k = chainparams.GetConsensus().nEquihashK;
@@ -640,26 +736,16 @@ void static BitcoinMiner(const CChainParams& chainparams)
     assert(solver == "tromp" || solver == "default");
     LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
 
-    std::mutex m_cs;
-    bool cancelSolver = false;
-    boost::signals2::connection c = uiInterface.NotifyBlockTip.connect(
-        [&m_cs, &cancelSolver](const uint256& hashNewTip) mutable {
-            std::lock_guard<std::mutex> lock{m_cs};
-            cancelSolver = true;
-        }
-    );
     miningTimer.start();
+    MinerThreadTimerStart(nThread);
 
     try {
-        //throw an error if no script was provided
-        if (!coinbaseScript->reserveScript.size())
-            throw std::runtime_error("No coinbase script available (mining requires a wallet or -mineraddress)");
-
         while (true) {
             if (chainparams.MiningRequiresPeers()) {
                 // Busy-wait for the network to come online so we don't waste time mining
                 // on an obsolete chain. In regtest mode we expect to fly solo.
                 miningTimer.stop();
+                MinerThreadTimerStop(nThread);
                 do {
                     bool fvNodesEmpty;
                     {
@@ -671,16 +757,17 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     MilliSleep(1000);
                 } while (true);
                 miningTimer.start();
+                MinerThreadTimerStart(nThread);
             }
 
             //
-            // Create new block
+            // Get a nonce range of the shared block template
             //
-            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            CBlockIndex* pindexPrev = chainActive.Tip();
-
-            unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
-            if (!pblocktemplate.get())
+            CBlock block;
+            CBlock *pblock = &block;
+            CBlockIndex* pindexPrev = nullptr;
+            uint64_t nGeneration = 0;
+            if (!coordinator.GetWork(block, pindexPrev, nGeneration))
             {
                 if (GetArg("-mineraddress", "").empty()) {
                     LogPrintf("Error in CrypticcoinMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
@@ -688,13 +775,10 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     // Should never reach here, because -mineraddress validity is checked in init.cpp
                     LogPrintf("Error in CrypticcoinMiner: Invalid -mineraddress\n");
                 }
+                miningTimer.stop();
+                MinerThreadTimerStop(nThread);
                 return;
             }
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-
-            LogPrintf("Running CrypticcoinMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-                ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
 
             //
             // Search
@@ -702,19 +786,20 @@ void static BitcoinMiner(const CChainParams& chainparams)
             int64_t nStart = GetTime();
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
 
-            while (true) {
-                // Hash state
-                crypto_generichash_blake2b_state state;
-                EhInitialiseState(n, k, state);
+            // Hash state
+            crypto_generichash_blake2b_state state;
+            EhInitialiseState(n, k, state);
 
-                // I = the block header minus nonce and solution.
-                CEquihashInput I{*pblock};
-                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                ss << I;
+            // I = the block header minus nonce and solution.
+            // Shared by all nonces of the range until nTime changes.
+            CEquihashInput I{*pblock};
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << I;
 
-                // H(I||...
-                crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+            // H(I||...
+            crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
 
+            while (true) {
                 // H(I||V||...
                 crypto_generichash_blake2b_state curr_state;
                 curr_state = state;
@@ -727,12 +812,13 @@ void static BitcoinMiner(const CChainParams& chainparams)
                          solver, pblock->nNonce.ToString());
 
                 std::function<bool(std::vector<unsigned char>)> validBlock =
-                        [&pblock, &hashTarget, &chainparams, &m_cs, &cancelSolver, &coinbaseScript]
+                        [&pblock, &hashTarget, &chainparams, &coordinator, nThread]
                         (std::vector<unsigned char> soln) {
                     // Write the solution to the hash and compute the result.
                     LogPrint("pow", "- Checking solution against target\n");
                     pblock->nSolution = soln;
                     solutionTargetChecks.increment();
+                    MinerThreadSolutionChecked(nThread);
 
                     if (UintToArith256(pblock->GetHash()) > hashTarget) {
                         return false;
@@ -742,13 +828,11 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
                     LogPrintf("CrypticcoinMiner:\n");
                     LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", pblock->GetHash().GetHex(), hashTarget.GetHex());
-                    if (ProcessBlockFound(pblock, chainparams)) {
-                        // Ignore chain updates caused by us
-                        std::lock_guard<std::mutex> lock{m_cs};
-                        cancelSolver = false;
-                    }
+                    ProcessBlockFound(pblock, chainparams);
+                    // The template is spent, let every thread move on to a new one
+                    coordinator.Invalidate();
                     SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                    coinbaseScript->KeepScript();
+                    coordinator.KeepScript();
 
                     // In regression test mode, stop mining after a block is found.
                     if (chainparams.MineBlocksOnDemand()) {
@@ -759,9 +843,8 @@ void static BitcoinMiner(const CChainParams& chainparams)
 
                     return true;
                 };
-                std::function<bool(EhSolverCancelCheck)> cancelled = [&m_cs, &cancelSolver](EhSolverCancelCheck pos) {
-                    std::lock_guard<std::mutex> lock{m_cs};
-                    return cancelSolver;
+                std::function<bool(EhSolverCancelCheck)> cancelled = [&coordinator, nGeneration](EhSolverCancelCheck pos) {
+                    return !coordinator.IsCurrent(nGeneration);
                 };
 
                 // TODO: factor this out into a function with the same API for each solver.
@@ -781,8 +864,6 @@ void static BitcoinMiner(const CChainParams& chainparams)
                         }
                     } catch (EhSolverCancelledException&) {
                         LogPrint("pow", "Equihash solver cancelled\n");
-                        std::lock_guard<std::mutex> lock{m_cs};
-                        cancelSolver = false;
                     }
                 }
 
@@ -793,18 +874,23 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     break;
                 if ((UintToArith256(pblock->nNonce) & 0xffff) == 0xffff)
                     break;
-                //TODO: add dpos controller method with check of commited transactions update time
-                //if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-                //    break;
-                if (GetTime() - nStart > 5)
+                if (GetTime() - nStart > MINER_TEMPLATE_MAX_AGE)
                     break;
-                if (pindexPrev != chainActive.Tip())
+                if (!coordinator.IsCurrent(nGeneration) || pindexPrev != chainActive.Tip())
                     break;
 
                 // Update nNonce and nTime
                 //FIXME: first call of solver always fail
                 pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
+                const int64_t nOldTime = pblock->nTime;
                 UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+                if (pblock->nTime != nOldTime) {
+                    EhInitialiseState(n, k, state);
+                    CEquihashInput I{*pblock};
+                    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                    ss << I;
+                    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+                }
                 if (chainparams.GetConsensus().nPowAllowMinDifficultyBlocksAfterHeight != boost::none)
                 {
                     // Changing pblock->nTime can change work required on testnet:
@@ -816,24 +902,26 @@ void static BitcoinMiner(const CChainParams& chainparams)
     catch (const boost::thread_interrupted&)
     {
         miningTimer.stop();
-        c.disconnect();
+        MinerThreadTimerStop(nThread);
         LogPrintf("CrypticcoinMiner terminated\n");
         throw;
     }
     catch (const std::runtime_error &e)
     {
         miningTimer.stop();
-        c.disconnect();
+        MinerThreadTimerStop(nThread);
         LogPrintf("CrypticcoinMiner runtime error: %s\n", e.what());
         return;
     }
     miningTimer.stop();
-    c.disconnect();
+    MinerThreadTimerStop(nThread);
 }
 
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams)
 {
     static boost::thread_group* minerThreads = NULL;
+    static std::unique_ptr<CMiningCoordinator> coordinator;
+    static boost::signals2::connection tipConnection;
 
     if (nThreads < 0)
         nThreads = GetNumCores();
@@ -845,13 +933,30 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
         delete minerThreads;
         minerThreads = NULL;
     }
+    tipConnection.disconnect();
+    coordinator.reset();
 
     if (nThreads == 0 || !fGenerate)
         return;
 
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+    GetMainSignals().ScriptForMining(coinbaseScript);
+    //throw an error if no script was provided
+    if (!coinbaseScript || !coinbaseScript->reserveScript.size()) {
+        LogPrintf("CrypticcoinMiner runtime error: %s\n", "No coinbase script available (mining requires a wallet or -mineraddress)");
+        return;
+    }
+
+    coordinator.reset(new CMiningCoordinator(chainparams, coinbaseScript));
+    CMiningCoordinator* pcoordinator = coordinator.get();
+    tipConnection = uiInterface.NotifyBlockTip.connect([pcoordinator](const uint256& hashNewTip) {
+        pcoordinator->Invalidate();
+    });
+
+    ResetMinerThreadMetrics(nThreads);
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++) {
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(*coordinator), i));
     }
 }
 
@@ -24,6 +24,11 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -95,7 +100,11 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
+// Wakes the message handler workers. The counter is the wake-up predicate,
+// each worker sleeps until it changes from the value it saw before its pass.
+static boost::mutex messageHandlerMutex;
 static boost::condition_variable messageHandlerCondition;
+static uint64_t nMessageHandlerWakeups = 0;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -321,8 +330,12 @@ void AddressCurrentlyConnected(const CService& addr)
 }
 
 
+CRelayInvQueue relayInvQueue;
+
 uint64_t CNode::nTotalBytesRecv = 0;
 uint64_t CNode::nTotalBytesSent = 0;
+mapMsgTypeStats CNode::mapTotalRecvStats;
+mapMsgTypeStats CNode::mapTotalSendStats;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
 
@@ -362,6 +375,12 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+/** Whether the socket handler can wait for events on hSocket */
+static bool IsUsableSocket(SOCKET hSocket)
+{
+    return !SocketEventsNeedSelectableSockets() || IsSelectableSocket(hSocket);
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
 {
     if (pszDest == NULL) {
@@ -388,7 +407,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsUsableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -561,6 +580,11 @@ void CNode::copyStats(CNodeStats &stats)
     stats.nSendBytes = nSendBytes;
     stats.nRecvBytes = nRecvBytes;
     stats.fWhitelisted = fWhitelisted;
+    {
+        LOCK(cs_msgStats);
+        stats.mapSendStats = mapSendStats;
+        stats.mapRecvStats = mapRecvStats;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -613,7 +637,12 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            // Only the worker this peer is pinned to can process the message
+            {
+                boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
+                nMessageHandlerWakeups++;
+            }
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -907,6 +936,48 @@ static bool AttemptToEvictConnection(bool fPreferNewConnection) {
     return true;
 }
 
+static bool fUseEpoll = false;
+#ifdef USE_EPOLL
+/** Maximum number of events fetched by one epoll_wait() call */
+static const int MAX_EPOLL_EVENTS = 256;
+static int epollFd = -1;
+/** eventfd polled alongside the sockets, written by WakeSocketHandler() */
+static int wakeupFd = -1;
+static std::atomic<bool> fWakeupPending(false);
+#endif
+
+bool SetSocketEventsMode(const std::string& strMode)
+{
+    if (strMode == "select") {
+        fUseEpoll = false;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        fUseEpoll = true;
+        return true;
+    }
+#endif
+    return false;
+}
+
+bool SocketEventsNeedSelectableSockets()
+{
+    return !fUseEpoll;
+}
+
+void WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (wakeupFd != -1 && !fWakeupPending.exchange(true)) {
+        uint64_t nOne = 1;
+        // Can only fail if the counter would overflow, which still leaves it readable
+        ssize_t ret = write(wakeupFd, &nOne, sizeof(nOne));
+        (void)ret;
+    }
+#endif
+}
+
 static void AcceptConnection(const ListenSocket& hListenSocket) {
     struct sockaddr_storage sockaddr;
     socklen_t len = sizeof(sockaddr);
@@ -935,7 +1006,7 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsUsableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -980,9 +1051,243 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+/**
+ * Wait up to 50ms for socket events with select() and accept new connections.
+ * Sets the readiness flags of the nodes whose sockets can be serviced.
+ */
+static void SocketEventsSelect()
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET || !IsSelectableSocket(pnode->hSocket))
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signaling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty()) {
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                    continue;
+                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec/1000);
+    }
+
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+    {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+        {
+            AcceptConnection(hListenSocket);
+        }
+    }
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        if (pnode->hSocket == INVALID_SOCKET || !IsSelectableSocket(pnode->hSocket))
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            pnode->fSocketRecvReady = true;
+        if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            pnode->fSocketSendReady = true;
+    }
+}
+
+#ifdef USE_EPOLL
+/** Create the epoll instance and register the wakeup eventfd and the listening sockets */
+static bool SocketEventsEpollInit()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupFd == -1) {
+        LogPrintf("eventfd failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeupFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event) != 0) {
+        LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    // Listening sockets stay level-triggered, one connection is accepted per event
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Wait for socket events with epoll and accept new connections. Peer sockets
+ * are registered edge-triggered, so the readiness flags set here persist
+ * until the socket would block. Waits up to 50ms unless fMoreWork is set.
+ */
+static void SocketEventsEpoll(bool fMoreWork)
+{
+    std::map<SOCKET, CNode*> mapSocketNodes;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            if (!pnode->fSocketRegistered) {
+                struct epoll_event event = {};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.fd = pnode->hSocket;
+                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+                    LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+                    pnode->fDisconnect = true;
+                    continue;
+                }
+                // Closing the socket removes it from the epoll set again
+                pnode->fSocketRegistered = true;
+            }
+            mapSocketNodes[pnode->hSocket] = pnode;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, fMoreWork ? 0 : 50);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0)
+    {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            MilliSleep(50);
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++)
+    {
+        const SOCKET hSocket = events[i].data.fd;
+        if (hSocket == wakeupFd) {
+            // Clear the flag first, so a wakeup racing with the read isn't lost
+            fWakeupPending = false;
+            uint64_t nCount;
+            ssize_t ret = read(wakeupFd, &nCount, sizeof(nCount));
+            (void)ret;
+            continue;
+        }
+
+        bool fListenSocket = false;
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        {
+            if (hListenSocket.socket == hSocket) {
+                AcceptConnection(hListenSocket);
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket)
+            continue;
+
+        std::map<SOCKET, CNode*>::iterator it = mapSocketNodes.find(hSocket);
+        if (it == mapSocketNodes.end())
+            continue;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            it->second->fSocketRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            it->second->fSocketSendReady = true;
+    }
+}
+#else
+static void SocketEventsEpoll(bool fMoreWork)
+{
+    assert(false);
+}
+#endif
+
 void ThreadSocketHandler()
 {
+#ifdef USE_EPOLL
+    if (fUseEpoll && epollFd == -1 && !SocketEventsEpollInit()) {
+        LogPrintf("Falling back to select() for socket events\n");
+        fUseEpoll = false;
+    }
+#endif
+
     unsigned int nPrevNodeCount = 0;
+    // Some sockets may still have data to read, poll without waiting
+    bool fMoreWork = false;
     while (true)
     {
         //
@@ -1049,97 +1354,13 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signaling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
-
-        //
-        // Accept new connections
+        // Wait for socket events and accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
-        {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
-        }
+        if (fUseEpoll)
+            SocketEventsEpoll(fMoreWork);
+        else
+            SocketEventsSelect();
+        fMoreWork = false;
 
         //
         // Service each socket
@@ -1160,10 +1381,15 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (pnode->fSocketRecvReady)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                // select() only reported the socket if there was room to receive,
+                // with epoll a throttled peer stays ready until the message handler
+                // drained its buffer and woke us up
+                if (lockRecv && (!fUseEpoll ||
+                    pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
                 {
                     {
                         // typical socket buffer is 8K-64K
@@ -1176,6 +1402,8 @@ void ThreadSocketHandler()
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+                            // Edge-triggered: keep reading until recv() would block
+                            fMoreWork = true;
                         }
                         else if (nBytes == 0)
                         {
@@ -1188,7 +1416,11 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEWOULDBLOCK)
+                            {
+                                pnode->fSocketRecvReady = false;
+                            }
+                            else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
@@ -1197,6 +1429,8 @@ void ThreadSocketHandler()
                         }
                     }
                 }
+                if (!fUseEpoll)
+                    pnode->fSocketRecvReady = false;
             }
 
             //
@@ -1204,11 +1438,18 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fSocketSendReady)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend && !pnode->vSendMsg.empty())
+                {
                     SocketSendData(pnode);
+                    // The socket buffer is full, wait for the next EPOLLOUT
+                    if (fUseEpoll && !pnode->vSendMsg.empty())
+                        pnode->fSocketSendReady = false;
+                }
+                if (!fUseEpoll)
+                    pnode->fSocketSendReady = false;
             }
 
             //
@@ -1531,20 +1772,29 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+/**
+ * Process messages of the peers pinned to worker nWorker out of nWorkers.
+ * A peer is always served by the same worker, which preserves the order of
+ * its messages and responses, while a peer stuck on slow requests only
+ * delays the other peers of its own worker.
+ */
+void ThreadMessageHandler(int nWorker, int nWorkers)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
+        uint64_t nWakeupsSeen;
+        {
+            boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
+            nWakeupsSeen = nMessageHandlerWakeups;
+        }
+
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (pnode->GetId() % nWorkers == nWorker)
+                    vNodesCopy.push_back(pnode->AddRef());
             }
         }
 
@@ -1568,6 +1818,10 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
+                    // Resume receiving from a peer whose receive buffer was full
+                    if (pnode->fSocketRecvReady && pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                        WakeSocketHandler();
+
                     if (pnode->nSendSize < SendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
@@ -1594,8 +1848,14 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        if (fSleep) {
+            boost::unique_lock<boost::mutex> lock(messageHandlerMutex);
+            const boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(100);
+            while (nMessageHandlerWakeups == nWakeupsSeen) {
+                if (!messageHandlerCondition.timed_wait(lock, timeout))
+                    break;
+            }
+        }
     }
 }
 
@@ -1626,7 +1886,7 @@ bool BindListenPort(const CService &addrBind, string& strError, bool fWhiteliste
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!IsUsableSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -1797,7 +2057,12 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
+    nMessageHandlerThreads = std::max(std::min(nMessageHandlerThreads, MAX_MSGHAND_THREADS), 1);
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()>>, "msghand",
+                                              boost::function<void()>(boost::bind(&ThreadMessageHandler, i, nMessageHandlerThreads))));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpAddresses, DUMP_ADDRESSES_INTERVAL);
@@ -1834,6 +2099,12 @@ public:
             if (hListenSocket.socket != INVALID_SOCKET)
                 if (!CloseSocket(hListenSocket.socket))
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+#ifdef USE_EPOLL
+        if (wakeupFd != -1)
+            close(wakeupFd);
+        if (epollFd != -1)
+            close(epollFd);
+#endif
 
         // clean up some globals (to help leak detection)
         BOOST_FOREACH(CNode *pnode, vNodes)
@@ -1886,21 +2157,38 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
         mapRelay.insert(std::make_pair(inv, ss));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
-    LOCK(cs_vNodes);
-    BOOST_FOREACH(CNode* pnode, vNodes)
-    {
-        if(!pnode->fRelayTxes)
-            continue;
-        LOCK(pnode->cs_filter);
-        if (pnode->pfilter)
-        {
-            if (pnode->pfilter->IsRelevantAndUpdate(tx))
-                pnode->PushInventory(inv);
-        } else
-            pnode->PushInventory(inv);
+    // fRelayTxes and the bloom filters are applied when each peer picks it up
+    relayInvQueue.Push(inv, std::make_shared<const CTransaction>(tx), 0);
+}
+
+void CRelayInvQueue::Push(const CInv& inv, const std::shared_ptr<const CTransaction>& tx, int nMinVersion)
+{
+    const int64_t nNow = GetTime();
+    LOCK(cs);
+    queue.push_back(CRelayInv{inv, tx, nMinVersion, nNow});
+    while (queue.size() > MAX_RELAY_QUEUE_SIZE || queue.front().nTime < nNow - RELAY_QUEUE_EXPIRE) {
+        queue.pop_front();
+        nBegin++;
     }
 }
 
+uint64_t CRelayInvQueue::End() const
+{
+    LOCK(cs);
+    return nBegin + queue.size();
+}
+
+std::vector<CRelayInv> CRelayInvQueue::Read(uint64_t& nPos) const
+{
+    LOCK(cs);
+    std::vector<CRelayInv> vRelay;
+    if (nPos < nBegin)
+        nPos = nBegin;
+    vRelay.assign(queue.begin() + (nPos - nBegin), queue.end());
+    nPos = nBegin + queue.size();
+    return vRelay;
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -1925,6 +2213,58 @@ uint64_t CNode::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+/** Stats of strCommand in mapStats, peers can't add entries by sending unknown commands */
+static CMsgTypeStats& GetMsgTypeStats(mapMsgTypeStats& mapStats, const std::string& strCommand)
+{
+    if (getAllNetMessageTypes().count(strCommand))
+        return mapStats[strCommand];
+    return mapStats[NET_MESSAGE_COMMAND_OTHER];
+}
+
+void CNode::RecordMsgSent(const std::string& strCommand, uint64_t nBytes)
+{
+    {
+        LOCK(cs_msgStats);
+        CMsgTypeStats& stats = GetMsgTypeStats(mapSendStats, strCommand);
+        stats.nMessages++;
+        stats.nBytes += nBytes;
+    }
+    LOCK(cs_totalBytesSent);
+    CMsgTypeStats& stats = GetMsgTypeStats(mapTotalSendStats, strCommand);
+    stats.nMessages++;
+    stats.nBytes += nBytes;
+}
+
+void CNode::RecordMsgRecv(const std::string& strCommand, uint64_t nBytes, int64_t nHandlerMicros, int64_t nWaitMicros)
+{
+    {
+        LOCK(cs_msgStats);
+        CMsgTypeStats& stats = GetMsgTypeStats(mapRecvStats, strCommand);
+        stats.nMessages++;
+        stats.nBytes += nBytes;
+        stats.nHandlerMicros += nHandlerMicros;
+        stats.nWaitMicros += nWaitMicros;
+    }
+    LOCK(cs_totalBytesRecv);
+    CMsgTypeStats& stats = GetMsgTypeStats(mapTotalRecvStats, strCommand);
+    stats.nMessages++;
+    stats.nBytes += nBytes;
+    stats.nHandlerMicros += nHandlerMicros;
+    stats.nWaitMicros += nWaitMicros;
+}
+
+mapMsgTypeStats CNode::GetTotalSendStats()
+{
+    LOCK(cs_totalBytesSent);
+    return mapTotalSendStats;
+}
+
+mapMsgTypeStats CNode::GetTotalRecvStats()
+{
+    LOCK(cs_totalBytesRecv);
+    return mapTotalRecvStats;
+}
+
 void CNode::Fuzz(int nChance)
 {
     if (!fSuccessfullyConnected) return; // Don't fuzz initial handshake
@@ -2067,7 +2407,7 @@ unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn) :
     ssSend(SER_NETWORK, INIT_PROTO_VERSION),
     addrKnown(5000, 0.001),
-    setInventoryKnown(SendBufferSize() / 1000)
+    filterInventoryKnown(INVENTORY_KNOWN_SIZE, 0.000001)
 {
     nServices = 0;
     hSocket = hSocketIn;
@@ -2092,6 +2432,13 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
+    fSocketRegistered = false;
+    nRelayInvPos = relayInvQueue.End();
+    nNextInvSend = 0;
+    fSendInvNow = false;
+    fTrickleInvNext = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     fGetAddr = false;
@@ -2214,6 +2561,10 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
+    CMessageHeader hdr(Params().MessageStart());
+    memcpy(hdr.pchCommand, &ssSend[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE);
+    RecordMsgSent(hdr.GetCommand(), ssSend.size());
+
     std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
@@ -2222,18 +2573,53 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     if (it == vSendMsg.begin())
         SocketSendData(this);
 
+    // Let the socket handler send the rest without waiting for its timeout
+    if (!vSendMsg.empty())
+        WakeSocketHandler();
+
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushRawMessage(const CSerializeData& msg)
+{
+    CMessageHeader hdr(Params().MessageStart());
+    memcpy(hdr.pchCommand, &msg[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE);
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", SanitizeString(hdr.GetCommand()),
+             msg.size() - CMessageHeader::HEADER_SIZE, id);
+    RecordMsgSent(hdr.GetCommand(), msg.size());
+
+    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), msg);
+    nSendSize += (*it).size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (it == vSendMsg.begin())
+        SocketSendData(this);
+
+    if (!vSendMsg.empty())
+        WakeSocketHandler();
+}
+
+CSerializeData MakeRawMessage(const char* pszCommand, const std::vector<unsigned char>& payload)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + payload.size());
+    ss << CMessageHeader(Params().MessageStart(), pszCommand, payload.size());
+    ss.write((const char*)payload.data(), payload.size());
+
+    // Set the checksum the same way EndMessage() does
+    uint256 hash = Hash(payload.begin(), payload.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    CSerializeData msg;
+    ss.GetAndClear(msg);
+    return msg;
+}
+
 void BroadcastInventory(const CInv& inv)
 {
-    LOCK(cs_vNodes);
-    for (auto&& node : vNodes) {
-        if (node != nullptr &&
-            !node->fDisconnect &&
-            node->nVersion >= PROTOCOL_VERSION)
-        {
-            node->PushInventory(inv);
-        }
-    }
+    relayInvQueue.Push(inv, nullptr, DPOS_INV_VERSION);
 }
@@ -10,7 +10,6 @@
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
-#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
@@ -19,7 +18,9 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -59,6 +60,24 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_EPOLL 1
+/** -socketevents default */
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** -msghandthreads default (number of message handler threads, each peer is served by one of them) */
+static const int DEFAULT_MSGHAND_THREADS = 2;
+/** Maximum number of message handler threads allowed */
+static const int MAX_MSGHAND_THREADS = 16;
+/** Number of recent inventory items remembered per peer, so they aren't announced to it again */
+static const unsigned int INVENTORY_KNOWN_SIZE = 25000;
+/** Minimum time in milliseconds between two inventory flushes to a peer, relayed inventory is batched in between */
+static const int64_t INVENTORY_BROADCAST_INTERVAL = 100;
+/** Relayed inventory is dropped from the shared relay queue after this many seconds, or when the queue is full */
+static const int64_t RELAY_QUEUE_EXPIRE = 60;
+static const size_t MAX_RELAY_QUEUE_SIZE = 4 * MAX_INV_SZ;
 /** The period before a network upgrade activates, where connections to upgrading peers are preferred (in blocks). */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 24 * 24 * 3;
 
@@ -83,6 +102,12 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Select the socket event backend ("select" or, if available, "epoll"). Returns false for unsupported modes. */
+bool SetSocketEventsMode(const std::string& strMode);
+/** Whether sockets need to fit into an fd_set, which limits the number of connections to FD_SETSIZE */
+bool SocketEventsNeedSelectableSockets();
+/** Interrupt the socket handler's wait, e.g. because there is new data to send */
+void WakeSocketHandler();
 
 typedef int NodeId;
 
@@ -174,6 +199,19 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Traffic of unknown message types is accounted under this command */
+const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
+
+/** Traffic of one message type, including the message headers */
+struct CMsgTypeStats
+{
+    uint64_t nMessages = 0;
+    uint64_t nBytes = 0;
+    int64_t nHandlerMicros = 0; // time spent processing received messages
+    int64_t nWaitMicros = 0; // time received messages were queued before processing
+};
+typedef std::map<std::string, CMsgTypeStats> mapMsgTypeStats;
+
 class CNodeStats
 {
 public:
@@ -194,6 +232,8 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    mapMsgTypeStats mapSendStats;
+    mapMsgTypeStats mapRecvStats;
 };
 
 
@@ -241,6 +281,39 @@ public:
 
 
 
+class CTransaction;
+
+/** Inventory relayed to all peers */
+struct CRelayInv
+{
+    CInv inv;
+    std::shared_ptr<const CTransaction> tx; // set for transactions, to apply the peers' relay flags and filters
+    int nMinVersion;
+    int64_t nTime;
+};
+
+/**
+ * Inventory relayed to all peers is appended once to this queue, instead of
+ * to the vInventoryToSend of every peer. Each peer keeps its position in the
+ * queue and picks up the new entries whenever its inventory is flushed.
+ */
+class CRelayInvQueue
+{
+public:
+    void Push(const CInv& inv, const std::shared_ptr<const CTransaction>& tx, int nMinVersion);
+    /** Position after the last entry, where a new peer starts reading */
+    uint64_t End() const;
+    /** Entries from nPos on, nPos is advanced past them. Expired entries are skipped. */
+    std::vector<CRelayInv> Read(uint64_t& nPos) const;
+
+private:
+    mutable CCriticalSection cs;
+    std::deque<CRelayInv> queue;
+    uint64_t nBegin = 0; // position of queue.front()
+};
+
+extern CRelayInvQueue relayInvQueue;
+
 /** Information about a peer */
 class CNode
 {
@@ -261,6 +334,12 @@ public:
     uint64_t nRecvBytes;
     int nRecvVersion;
 
+    // Socket readiness reported by the socket event backend. With epoll these
+    // are edge-triggered and stay set until a recv/send would block.
+    std::atomic<bool> fSocketRecvReady;
+    std::atomic<bool> fSocketSendReady;
+    bool fSocketRegistered; // added to the epoll set (socket handler thread only)
+
     int64_t nLastSend;
     int64_t nLastRecv;
     int64_t nTimeConnected;
@@ -318,9 +397,13 @@ public:
     std::set<uint256> setKnown;
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
+    uint64_t nRelayInvPos; // position in relayInvQueue
+    int64_t nNextInvSend; // time in microseconds of the next inventory flush
+    std::atomic<bool> fSendInvNow; // flush the inventory without waiting, e.g. for a new block
+    bool fTrickleInvNext; // trickled tx inventory goes out with the next flush (under cs_vSend)
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
 
@@ -345,6 +428,13 @@ private:
     static CCriticalSection cs_totalBytesSent;
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
+    static mapMsgTypeStats mapTotalRecvStats;
+    static mapMsgTypeStats mapTotalSendStats;
+
+    // Per message type traffic of this peer
+    CCriticalSection cs_msgStats;
+    mapMsgTypeStats mapSendStats;
+    mapMsgTypeStats mapRecvStats;
 
     CNode(const CNode&);
     void operator=(const CNode&);
@@ -418,19 +508,36 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(GetInventoryKnownKey(inv));
         }
     }
 
+    bool IsInventoryKnown(const CInv& inv)
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.contains(GetInventoryKnownKey(inv));
+    }
+
     void PushInventory(const CInv& inv)
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(GetInventoryKnownKey(inv))) {
                 vInventoryToSend.push_back(inv);
+                if (inv.type == MSG_BLOCK)
+                    fSendInvNow = true;
+            }
         }
     }
 
+    // The type is part of the key, a vice-block has the same hash as the block approved from it
+    static std::vector<unsigned char> GetInventoryKnownKey(const CInv& inv)
+    {
+        std::vector<unsigned char> vKey(inv.hash.begin(), inv.hash.end());
+        vKey.push_back(inv.type & 0xff);
+        return vKey;
+    }
+
     void AskFor(const CInv& inv);
 
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
@@ -442,6 +549,9 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    /** Queue a complete message built by MakeRawMessage(), without serializing it again */
+    void PushRawMessage(const CSerializeData& msg);
+
     void PushVersion();
 
 
@@ -639,13 +749,22 @@ public:
 
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
+
+    /** Account a queued message of nBytes, header included */
+    void RecordMsgSent(const std::string& strCommand, uint64_t nBytes);
+    /** Account a received message, processed nHandlerMicros after waiting nWaitMicros in vRecvMsg */
+    void RecordMsgRecv(const std::string& strCommand, uint64_t nBytes, int64_t nHandlerMicros, int64_t nWaitMicros);
+
+    static mapMsgTypeStats GetTotalSendStats();
+    static mapMsgTypeStats GetTotalRecvStats();
 };
 
 
 
-class CTransaction;
 void RelayTransaction(const CTransaction& tx);
 void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/** Frame an already serialized payload as a network message for CNode::PushRawMessage() */
+CSerializeData MakeRawMessage(const char* pszCommand, const std::vector<unsigned char>& payload);
 
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
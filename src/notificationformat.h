@@ -0,0 +1,21 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NOTIFICATIONFORMAT_H
+#define BITCOIN_NOTIFICATIONFORMAT_H
+
+#include "uint256.h"
+
+/**
+ * Write a hash into a ZMQ or AMQP notification payload, in the byte order it
+ * is displayed in. Returns the position right after it.
+ */
+inline unsigned char* WriteNotificationHash(unsigned char *data, const uint256 &hash)
+{
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return data + 32;
+}
+
+#endif // BITCOIN_NOTIFICATIONFORMAT_H
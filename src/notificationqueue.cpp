@@ -0,0 +1,173 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notificationqueue.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+//! Live queues, for the statistics
+static CCriticalSection cs_notificationQueues;
+static std::set<CNotificationQueue*> setNotificationQueues;
+
+CNotificationQueue::CNotificationQueue(const std::string& name, const TransactionHandler& txHandler,
+                                       size_t nMaxSize, size_t nMaxTxBatch, bool fBlockWhenFull) :
+    name(name), txHandler(txHandler), nMaxSize(std::max(nMaxSize, (size_t)1)),
+    nMaxTxBatch(std::max(nMaxTxBatch, (size_t)1)), fBlockWhenFull(fBlockWhenFull), fStopping(false)
+{
+    stats.name = name;
+    stats.nQueued = 0;
+    stats.nMaxQueued = 0;
+    stats.nMaxSize = this->nMaxSize;
+    stats.nPublished = 0;
+    stats.nTransactions = 0;
+    stats.nDropped = 0;
+    stats.nBlocked = 0;
+    stats.nBlockedTime = 0;
+
+    LOCK(cs_notificationQueues);
+    setNotificationQueues.insert(this);
+}
+
+CNotificationQueue::~CNotificationQueue()
+{
+    {
+        LOCK(cs_notificationQueues);
+        setNotificationQueues.erase(this);
+    }
+    Stop();
+}
+
+void CNotificationQueue::Start()
+{
+    assert(!thread.joinable());
+    thread = boost::thread(boost::bind(&CNotificationQueue::ThreadPublish, this));
+}
+
+void CNotificationQueue::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStopping = true;
+        condItems.notify_all();
+        condRoom.notify_all();
+    }
+    if (thread.joinable())
+        thread.join();
+}
+
+bool CNotificationQueue::MakeRoom(boost::unique_lock<boost::mutex>& lock)
+{
+    if (queue.size() < nMaxSize)
+        return true;
+
+    if (fBlockWhenFull && !fStopping) {
+        stats.nBlocked++;
+        int64_t nStart = GetTimeMicros();
+        while (queue.size() >= nMaxSize && !fStopping)
+            condRoom.wait(lock);
+        stats.nBlockedTime += GetTimeMicros() - nStart;
+        if (queue.size() < nMaxSize)
+            return true;
+    }
+
+    if (stats.nDropped++ == 0)
+        LogPrintf("%s: %s publisher is falling behind, dropping notifications\n", __func__, name);
+    return false;
+}
+
+bool CNotificationQueue::Push(const Notification& notification)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (!MakeRoom(lock))
+        return false;
+
+    Item item;
+    item.notification = notification;
+    queue.push_back(item);
+    // Transactions after this notification must be published after it
+    openBatch.reset();
+    stats.nMaxQueued = std::max(stats.nMaxQueued, queue.size());
+    condItems.notify_one();
+    return true;
+}
+
+bool CNotificationQueue::PushTransaction(const CTransaction& tx)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (openBatch && openBatch->size() < nMaxTxBatch) {
+        openBatch->push_back(tx);
+        return true;
+    }
+    if (!MakeRoom(lock))
+        return false;
+
+    Item item;
+    item.vtx = std::make_shared<std::vector<CTransaction> >(1, tx);
+    queue.push_back(item);
+    openBatch = item.vtx;
+    stats.nMaxQueued = std::max(stats.nMaxQueued, queue.size());
+    condItems.notify_one();
+    return true;
+}
+
+CNotificationQueueStats CNotificationQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    CNotificationQueueStats result = stats;
+    result.nQueued = queue.size();
+    return result;
+}
+
+void CNotificationQueue::ThreadPublish()
+{
+    RenameThread(("crypticcoin-" + name + "notify").c_str());
+
+    while (true) {
+        std::deque<Item> items;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fStopping && queue.empty())
+                condItems.wait(lock);
+            // Whatever was queued is still published when stopping
+            if (queue.empty())
+                break;
+            // Take everything at once, the queue is free for validation again
+            // while the publisher works through it
+            items.swap(queue);
+            openBatch.reset();
+            stats.nPublished += items.size();
+            BOOST_FOREACH(const Item& item, items) {
+                if (item.vtx)
+                    stats.nTransactions += item.vtx->size();
+            }
+            condRoom.notify_all();
+        }
+
+        BOOST_FOREACH(const Item& item, items) {
+            try {
+                if (item.vtx)
+                    txHandler(*item.vtx);
+                else
+                    item.notification();
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s notification failed: %s\n", __func__, name, e.what());
+            }
+        }
+    }
+}
+
+std::vector<CNotificationQueueStats> GetNotificationQueueStats()
+{
+    std::vector<CNotificationQueueStats> vStats;
+    LOCK(cs_notificationQueues);
+    BOOST_FOREACH(CNotificationQueue* queue, setNotificationQueues)
+        vStats.push_back(queue->GetStats());
+    return vStats;
+}
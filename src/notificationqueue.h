@@ -0,0 +1,109 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NOTIFICATIONQUEUE_H
+#define BITCOIN_NOTIFICATIONQUEUE_H
+
+#include "primitives/transaction.h"
+#include "sync.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/** Default number of notifications a publisher may fall behind before new ones are dropped */
+static const unsigned int DEFAULT_NOTIFY_QUEUE_SIZE = 10000;
+/** Default for the most transactions that are handed to the publisher at once */
+static const unsigned int DEFAULT_NOTIFY_TX_BATCH = 100;
+/** Default for -notifyqueueblock */
+static const bool DEFAULT_NOTIFY_QUEUE_BLOCK = false;
+
+struct CNotificationQueueStats
+{
+    std::string name;
+    size_t nQueued;             //!< Notifications waiting for the publisher
+    size_t nMaxQueued;          //!< Most notifications that were waiting at once
+    size_t nMaxSize;            //!< Queue size limit
+    uint64_t nPublished;        //!< Notifications handed to the publisher, a transaction batch counts once
+    uint64_t nTransactions;     //!< Transactions handed to the publisher
+    uint64_t nDropped;          //!< Notifications dropped because the queue was full
+    uint64_t nBlocked;          //!< Times validation had to wait for room in the queue
+    int64_t nBlockedTime;       //!< Total time validation waited for room, in microseconds
+};
+
+/**
+ * Bounded queue of outgoing notifications with a dedicated publisher thread,
+ * so that validation does not wait for ZMQ or AMQP consumers.
+ *
+ * Notifications are published in the order they are pushed. Transactions
+ * pushed back to back while the publisher is busy are collected and handed to
+ * the transaction handler together, up to the batch size at a time.
+ *
+ * When the queue is full, new notifications are dropped, or, when created
+ * with fBlockWhenFull, the caller waits until there is room.
+ */
+class CNotificationQueue
+{
+public:
+    typedef boost::function<void()> Notification;
+    typedef boost::function<void(const std::vector<CTransaction>& vtx)> TransactionHandler;
+
+    CNotificationQueue(const std::string& name, const TransactionHandler& txHandler,
+                       size_t nMaxSize = DEFAULT_NOTIFY_QUEUE_SIZE,
+                       size_t nMaxTxBatch = DEFAULT_NOTIFY_TX_BATCH,
+                       bool fBlockWhenFull = DEFAULT_NOTIFY_QUEUE_BLOCK);
+    /** Stops the publisher thread if it is still running */
+    ~CNotificationQueue();
+
+    /** Start the publisher thread */
+    void Start();
+    /** Publish what is queued and stop the publisher thread */
+    void Stop();
+
+    /** Queue a notification. Returns false if it was dropped. */
+    bool Push(const Notification& notification);
+    /** Queue a transaction for the transaction handler. Returns false if it was dropped. */
+    bool PushTransaction(const CTransaction& tx);
+
+    CNotificationQueueStats GetStats();
+
+private:
+    struct Item
+    {
+        Notification notification;
+        //! Transactions of a batch, null for other notifications
+        std::shared_ptr<std::vector<CTransaction> > vtx;
+    };
+
+    const std::string name;
+    const TransactionHandler txHandler;
+    const size_t nMaxSize;
+    const size_t nMaxTxBatch;
+    const bool fBlockWhenFull;
+
+    CWaitableCriticalSection cs;
+    CConditionVariable condItems;
+    CConditionVariable condRoom;
+    std::deque<Item> queue;
+    //! Batch at the back of the queue that more transactions may join
+    std::shared_ptr<std::vector<CTransaction> > openBatch;
+    bool fStopping;
+    boost::thread thread;
+    CNotificationQueueStats stats;
+
+    /** Wait for room if the queue is full and that is the policy, cs must be held.
+     * Returns false if the notification has to be dropped.
+     */
+    bool MakeRoom(boost::unique_lock<boost::mutex>& lock);
+    void ThreadPublish();
+};
+
+/** Statistics of all notification queues */
+std::vector<CNotificationQueueStats> GetNotificationQueueStats();
+
+#endif // BITCOIN_NOTIFICATIONQUEUE_H
@@ -11,6 +11,8 @@
 #include "txmempool.h"
 #include "util.h"
 
+#include <algorithm>
+
 void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
                                 unsigned int maxConfirms, double _decay, std::string _dataTypeString)
 {
@@ -19,45 +21,53 @@ void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
 
     buckets.insert(buckets.end(), defaultBuckets.begin(), defaultBuckets.end());
     buckets.push_back(std::numeric_limits<double>::infinity());
-
-    for (unsigned int i = 0; i < buckets.size(); i++) {
-        bucketMap[buckets[i]] = i;
-    }
+    weight = 1;
 
     confAvg.resize(maxConfirms);
-    curBlockConf.resize(maxConfirms);
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         confAvg[i].resize(buckets.size());
-        curBlockConf[i].resize(buckets.size());
         unconfTxs[i].resize(buckets.size());
     }
 
     oldUnconfTxs.resize(buckets.size());
-    curBlockTxCt.resize(buckets.size());
     txCtAvg.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
     avg.resize(buckets.size());
 }
 
-// Zero out the data for the current block
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
+{
+    std::vector<int>& unconfRow = unconfTxs[nBlockHeight % unconfTxs.size()];
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        oldUnconfTxs[j] += unconfRow[j];
+        unconfRow[j] = 0;
+    }
+
+    // Decaying all stored averages is the same as giving the data points
+    // of this block a larger weight
+    weight /= decay;
+    if (weight > MAX_STATS_WEIGHT)
+        Rescale();
+}
+
+void TxConfirmStats::Rescale()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
-        for (unsigned int i = 0; i < curBlockConf.size(); i++)
-            curBlockConf[i][j] = 0;
-        curBlockTxCt[j] = 0;
-        curBlockVal[j] = 0;
+        for (unsigned int i = 0; i < confAvg.size(); i++)
+            confAvg[i][j] /= weight;
+        avg[j] /= weight;
+        txCtAvg[j] /= weight;
     }
+    weight = 1;
 }
 
 unsigned int TxConfirmStats::FindBucketIndex(double val)
 {
-    auto it = bucketMap.lower_bound(val);
-    assert(it != bucketMap.end());
-    return it->second;
+    // buckets is sorted and ends with infinity, so this never runs off the end
+    // (except for NaN, which compares false and lands in the first bucket)
+    auto it = std::lower_bound(buckets.begin(), buckets.end(), val);
+    assert(it != buckets.end());
+    return it - buckets.begin();
 }
 
 void TxConfirmStats::Record(int blocksToConfirm, double val)
@@ -66,21 +76,11 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = FindBucketIndex(val);
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
-    curBlockTxCt[bucketindex]++;
-    curBlockVal[bucketindex] += val;
-}
-
-void TxConfirmStats::UpdateMovingAverages()
-{
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
-        avg[j] = avg[j] * decay + curBlockVal[j];
-        txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+    for (size_t i = blocksToConfirm; i <= confAvg.size(); i++) {
+        confAvg[i - 1][bucketindex] += weight;
     }
+    txCtAvg[bucketindex] += weight;
+    avg[bucketindex] += val * weight;
 }
 
 // returns -1 on error conditions
@@ -127,8 +127,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
         // will be looking at the same amount of data and same bucket breaks)
-        if (totalNum >= sufficientTxVal / (1 - decay)) {
-            double curPct = nConf / (totalNum + extraNum);
+        if (totalNum >= weight * sufficientTxVal / (1 - decay)) {
+            // nConf and totalNum carry the stats weight, the mempool counts don't
+            double curPct = nConf / (totalNum + extraNum * weight);
 
             // Check to see if we are no longer getting confirmed at the success rate
             if (requireGreater && curPct < successBreakPoint)
@@ -177,13 +178,15 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     LogPrint("estimatefee", "%3d: For conf success %s %4.2f need %s %s: %12.5g from buckets %8g - %8g  Cur Bucket stats %6.2f%%  %8.1f/(%.1f+%d mempool)\n",
              confTarget, requireGreater ? ">" : "<", successBreakPoint, dataTypeString,
              requireGreater ? ">" : "<", median, buckets[minBucket], buckets[maxBucket],
-             100 * nConf / (totalNum + extraNum), nConf, totalNum, extraNum);
+             100 * nConf / (totalNum + extraNum * weight), nConf / weight, totalNum / weight, extraNum);
 
     return median;
 }
 
 void TxConfirmStats::Write(CAutoFile& fileout)
 {
+    // The file stores the plain moving averages
+    Rescale();
     fileout << decay;
     fileout << buckets;
     fileout << avg;
@@ -209,6 +212,8 @@ void TxConfirmStats::Read(CAutoFile& filein)
     numBuckets = fileBuckets.size();
     if (numBuckets <= 1 || numBuckets > 1000)
         throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 fee/pri buckets");
+    if (!std::is_sorted(fileBuckets.begin(), fileBuckets.end()))
+        throw std::runtime_error("Corrupt estimates file. Fee/pri buckets must be sorted");
     filein >> fileAvg;
     if (fileAvg.size() != numBuckets)
         throw std::runtime_error("Corrupt estimates file. Mismatch in fee/pri average bucket count");
@@ -230,26 +235,16 @@ void TxConfirmStats::Read(CAutoFile& filein)
     avg = fileAvg;
     confAvg = fileConfAvg;
     txCtAvg = fileTxCtAvg;
-    bucketMap.clear();
+    weight = 1;
 
-    // Resize the current block variables which aren't stored in the data file
+    // Resize the mempool counters which aren't stored in the data file
     // to match the number of confirms and buckets
-    curBlockConf.resize(maxConfirms);
-    for (unsigned int i = 0; i < maxConfirms; i++) {
-        curBlockConf[i].resize(buckets.size());
-    }
-    curBlockTxCt.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
-
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         unconfTxs[i].resize(buckets.size());
     }
     oldUnconfTxs.resize(buckets.size());
 
-    for (unsigned int i = 0; i < buckets.size(); i++)
-        bucketMap[buckets[i]] = i;
-
     LogPrint("estimatefee", "Reading estimates: %u %s buckets counting confirms up to %u blocks\n",
              numBuckets, dataTypeString, maxConfirms);
 }
@@ -329,6 +324,11 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     feeLikely = CFeeRate(INF_FEERATE);
     priUnlikely = 0;
     priLikely = INF_PRIORITY;
+
+    for (unsigned int i = 0; i < MAX_BLOCK_CONFIRMS; i++) {
+        feeEstimates[i] = -1;
+        priEstimates[i] = -1;
+    }
 }
 
 bool CBlockPolicyEstimator::isFeeDataPoint(const CFeeRate &fee, double pri)
@@ -482,29 +482,42 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     else
         feeUnlikely = CFeeRate(feeUnlikelyEst);
 
-    // Clear the current block states
+    // Decay the moving averages and start counting for the new block
     feeStats.ClearCurrent(nBlockHeight);
     priStats.ClearCurrent(nBlockHeight);
 
-    // Repopulate the current block states
+    // Add the confirmed transactions to their buckets
     for (unsigned int i = 0; i < entries.size(); i++)
         processBlockTx(nBlockHeight, entries[i]);
 
-    // Update all exponential averages with the current block states
-    feeStats.UpdateMovingAverages();
-    priStats.UpdateMovingAverages();
+    UpdateEstimates();
 
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
              entries.size(), mapMemPoolTxs.size());
 }
 
-CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
+void CBlockPolicyEstimator::UpdateEstimates()
+{
+    for (unsigned int i = 0; i < MAX_BLOCK_CONFIRMS; i++) {
+        int confTarget = i + 1;
+        if ((unsigned int)confTarget <= feeStats.GetMaxConfirms())
+            feeEstimates[i] = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        else
+            feeEstimates[i] = -1;
+        if ((unsigned int)confTarget <= priStats.GetMaxConfirms())
+            priEstimates[i] = priStats.EstimateMedianVal(confTarget, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        else
+            priEstimates[i] = -1;
+    }
+}
+
+CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
 {
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > MAX_BLOCK_CONFIRMS)
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = feeEstimates[confTarget - 1];
 
     if (median < 0)
         return CFeeRate(0);
@@ -512,13 +525,13 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
     return CFeeRate(median);
 }
 
-double CBlockPolicyEstimator::estimatePriority(int confTarget)
+double CBlockPolicyEstimator::estimatePriority(int confTarget) const
 {
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > priStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > MAX_BLOCK_CONFIRMS)
         return -1;
 
-    return priStats.EstimateMedianVal(confTarget, SUFFICIENT_PRITXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    return priEstimates[confTarget - 1];
 }
 
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
@@ -535,4 +548,5 @@ void CBlockPolicyEstimator::Read(CAutoFile& filein)
     feeStats.Read(filein);
     priStats.Read(filein);
     nBestSeenHeight = nFileBestSeenHeight;
+    UpdateEstimates();
 }
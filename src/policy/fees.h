@@ -8,6 +8,7 @@
 #include "amount.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
@@ -84,27 +85,26 @@ class TxConfirmStats
 {
 private:
     //Define the buckets we will group transactions into (both fee buckets and priority buckets)
-    std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
+    std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive), sorted
+
+    // The historical moving averages below are stored multiplied by weight.
+    // Instead of decaying every bucket on every block, weight is divided by
+    // decay once per block and new data points are added with the current
+    // weight, so only the buckets a transaction falls into are touched.
+    double weight = 1;
 
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
-    // and calcuate the total for the current block to update the moving average
-    std::vector<int> curBlockTxCt;
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calcuate the totals for the current block to update the moving averages
-    std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total priority/fee of all txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> avg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<double> curBlockVal;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg fee/priority per bucket
@@ -119,6 +119,9 @@ private:
     // transactions still unconfirmed after MAX_CONFIRMS for each bucket
     std::vector<int> oldUnconfTxs;
 
+    /** Fold weight back into the stored averages before it grows out of range */
+    void Rescale();
+
 public:
     /** Find the bucket index of a given value */
     unsigned int FindBucketIndex(double val);
@@ -135,7 +138,10 @@ public:
      */
     void Initialize(std::vector<double>& defaultBuckets, unsigned int maxConfirms, double decay, std::string dataTypeString);
 
-    /** Clear the state of the curBlock variables to start counting for the new block */
+    /**
+     * Start counting for a new block: decay the historical moving averages
+     * and age the mempool counts of the block falling out of the window
+     */
     void ClearCurrent(unsigned int nBlockHeight);
 
     /**
@@ -153,10 +159,6 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
                   unsigned int bucketIndex);
 
-    /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
-    void UpdateMovingAverages();
-
     /**
      * Calculate a fee or priority estimate.  Find the lowest value bucket (or range of buckets
      * to make sure we have enough data points) whose transactions still have sufficient likelihood
@@ -189,6 +191,9 @@ public:
 /** Track confirm delays up to 25 blocks, can't estimate beyond that */
 static const unsigned int MAX_BLOCK_CONFIRMS = 25;
 
+/** Rescale the stored moving averages once their weight exceeds this */
+static const double MAX_STATS_WEIGHT = 1e100;
+
 /** Require greater than 85% of X fee transactions to be confirmed within Y blocks for X to be big enough */
 static const double MIN_SUCCESS_PCT = .85;
 static const double UNLIKELY_PCT = .5;
@@ -246,11 +251,11 @@ public:
     /** Is this transaction likely included in a block because of its priority?*/
     bool isPriDataPoint(const CFeeRate &fee, double pri);
 
-    /** Return a fee estimate */
-    CFeeRate estimateFee(int confTarget);
+    /** Return a fee estimate. Does not require the mempool lock. */
+    CFeeRate estimateFee(int confTarget) const;
 
-    /** Return a priority estimate */
-    double estimatePriority(int confTarget);
+    /** Return a priority estimate. Does not require the mempool lock. */
+    double estimatePriority(int confTarget) const;
 
     /** Write estimation data to a file */
     void Write(CAutoFile& fileout);
@@ -279,5 +284,16 @@ private:
     /** Breakpoints to help determine whether a transaction was confirmed by priority or Fee */
     CFeeRate feeLikely, feeUnlikely;
     double priLikely, priUnlikely;
+
+    /**
+     * Fee and priority estimates for every confirmation target, recomputed
+     * once per block so that estimateFee/estimatePriority are plain atomic
+     * loads. A negative value means there is no estimate for that target.
+     */
+    std::atomic<double> feeEstimates[MAX_BLOCK_CONFIRMS];
+    std::atomic<double> priEstimates[MAX_BLOCK_CONFIRMS];
+
+    /** Recompute the estimate tables from the current stats */
+    void UpdateEstimates();
 };
 #endif /*BITCOIN_POLICYESTIMATOR_H */
@@ -21,7 +21,20 @@ static const char* ppszTypeName[] =
     "heartbeat",
     "vice_block",
     "round_vote",
-    "tx_vote"
+    "tx_vote",
+    "dpos_block",
+    "cmpctblock"
+};
+
+static const std::set<std::string> allNetMessageTypes
+{
+    "version", "verack", "addr", "getaddr", "inv", "getdata", "notfound",
+    "getblocks", "getheaders", "headers", "tx", "block", "merkleblock",
+    "mempool", "ping", "pong", "alert", "reject",
+    "filterload", "filteradd", "filterclear",
+    "sendcmpct", "cmpctblock", "getblocktxn", "blocktxn",
+    "gettxvotes", "getrvotes", "getvblocks",
+    "heartbeat", "vice_block", "round_vote", "tx_vote", "dpos_block"
 };
 
 CMessageHeader::CMessageHeader(const MessageStartChars& pchMessageStartIn)
@@ -144,3 +157,8 @@ std::string CInv::ToString() const
 {
     return strprintf("%s %s", GetCommand(), hash.ToString());
 }
+
+const std::set<std::string>& getAllNetMessageTypes()
+{
+    return allNetMessageTypes;
+}
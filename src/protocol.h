@@ -15,6 +15,7 @@
 #include "uint256.h"
 #include "version.h"
 
+#include <set>
 #include <stdint.h>
 #include <string>
 
@@ -157,7 +158,16 @@ enum {
     MSG_HEARTBEAT,
     MSG_VICE_BLOCK,
     MSG_ROUND_VOTE,
-    MSG_TX_VOTE
+    MSG_TX_VOTE,
+    // Approved dPoS block without transactions, requested in getdata by nodes
+    // that already have the vice-block. Like MSG_FILTERED_BLOCK it should not
+    // appear in invs.
+    MSG_DPOS_BLOCK,
+    // Compact block (BIP152), only requested in getdata from peers that sent "sendcmpct"
+    MSG_CMPCT_BLOCK
 };
 
+/** All the message types this node sends or handles, including the dPoS inventory types */
+const std::set<std::string>& getAllNetMessageTypes();
+
 #endif // BITCOIN_PROTOCOL_H
@@ -4,6 +4,7 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "chainparams.h"
+#include "clientversion.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
@@ -23,6 +24,9 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_BLOCKS = 2000; //max number of blocks in one /rest/blocks reply
+static const size_t MAX_REST_TXS = 100; //max number of transactions in one /rest/txs reply
+static const size_t REST_CHUNK_SIZE = 64 * 1024; //streamed replies are sent in pieces of this size
 
 enum RetFormat {
     RF_UNDEF,
@@ -108,6 +112,53 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+enum RangeResult {
+    RANGE_NONE,
+    RANGE_OK,
+    RANGE_UNSATISFIABLE,
+};
+
+/**
+ * Parse a "Range: bytes=first-last" header against a body of nTotal bytes.
+ * Only a single range is supported, anything else is ignored and the whole
+ * body is sent, as HTTP allows.
+ */
+static enum RangeResult ParseByteRange(const std::pair<bool, std::string>& header, uint64_t nTotal, uint64_t& nBegin, uint64_t& nEnd)
+{
+    nBegin = 0;
+    nEnd = nTotal;
+    const std::string& str = header.second;
+    if (!header.first || str.compare(0, 6, "bytes=") != 0 || str.find(',') != std::string::npos)
+        return RANGE_NONE;
+    size_t nDash = str.find('-', 6);
+    if (nDash == std::string::npos)
+        return RANGE_NONE;
+
+    int64_t nFirst, nLast;
+    const std::string strFirst = str.substr(6, nDash - 6);
+    const std::string strLast = str.substr(nDash + 1);
+    if (strFirst.empty()) {
+        // Suffix range: the last nLast bytes
+        if (!ParseInt64(strLast, &nLast) || nLast < 0)
+            return RANGE_NONE;
+        if (nLast == 0)
+            return RANGE_UNSATISFIABLE;
+        nBegin = nTotal - std::min((uint64_t)nLast, nTotal);
+        return RANGE_OK;
+    }
+    if (!ParseInt64(strFirst, &nFirst) || nFirst < 0)
+        return RANGE_NONE;
+    if (!strLast.empty()) {
+        if (!ParseInt64(strLast, &nLast) || nLast < nFirst)
+            return RANGE_NONE;
+        nEnd = std::min((uint64_t)nLast + 1, nTotal);
+    }
+    if ((uint64_t)nFirst >= nTotal)
+        return RANGE_UNSATISFIABLE;
+    nBegin = nFirst;
+    return RANGE_OK;
+}
+
 static bool CheckWarmup(HTTPRequest* req)
 {
     std::string statusmessage;
@@ -254,6 +305,119 @@ static bool rest_block(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Append bytes [nFrom, nTo) of a serialized block to chunk, sending the chunk
+ * whenever it is full.
+ */
+static bool WriteRawBlockData(HTTPRequest* req, std::string& chunk, const std::vector<unsigned char>& block, uint64_t nFrom, uint64_t nTo)
+{
+    while (nFrom < nTo) {
+        size_t nPart = std::min(nTo - nFrom, (uint64_t)(REST_CHUNK_SIZE - chunk.size()));
+        chunk.append((const char*)&block[nFrom], nPart);
+        nFrom += nPart;
+        if (chunk.size() >= REST_CHUNK_SIZE && !req->WriteReplyChunk(chunk))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Consecutive blocks of the active chain, copied straight from the block
+ * files without deserializing them. Supports single byte ranges, so an
+ * interrupted download can be resumed.
+ */
+static bool rest_blocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+
+    vector<string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/blocks/<start_height>/<count>.bin.");
+
+    int32_t nStart, nCount;
+    if (!ParseInt32(path[0], &nStart) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid start height: " + path[0]);
+    if (!ParseInt32(path[1], &nCount) || nCount < 1 || nCount > MAX_REST_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    // The snapshot pins the chain being served, even if the tip moves meanwhile
+    std::shared_ptr<const CChainSnapshot> snapshot = GetChainSnapshot();
+    if (nStart > snapshot->Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Start height out of range: " + path[0]);
+    nCount = std::min(nCount, snapshot->Height() - nStart + 1);
+
+    std::vector<std::pair<CDiskBlockPos, uint256> > vPos;
+    vPos.reserve(nCount);
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight < nStart + nCount; nHeight++) {
+            const CBlockIndex* pindex = (*snapshot)[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, strprintf("Block at height %d not available (pruned data)", nHeight));
+            vPos.push_back(std::make_pair(pindex->GetBlockPos(), pindex->GetBlockHash()));
+        }
+    }
+
+    std::vector<unsigned int> vSize;
+    vSize.reserve(vPos.size());
+    uint64_t nTotal = 0;
+    for (const auto& pos : vPos) {
+        unsigned int nSize;
+        if (!ReadRawBlockSizeFromDisk(nSize, pos.first, pos.second, Params().MessageStart()))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Can't read block from disk");
+        vSize.push_back(nSize);
+        nTotal += nSize;
+    }
+
+    uint64_t nBegin, nEnd;
+    const RangeResult range = ParseByteRange(req->GetHeader("range"), nTotal, nBegin, nEnd);
+    if (range == RANGE_UNSATISFIABLE) {
+        req->WriteHeader("Content-Range", strprintf("bytes */%u", nTotal));
+        return RESTERR(req, HTTP_RANGE_NOT_SATISFIABLE, "Requested range not satisfiable");
+    }
+
+    // With a known length libevent sends the reply as is, keeping the
+    // connection usable for the next request
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->WriteHeader("Accept-Ranges", "bytes");
+    req->WriteHeader("Content-Length", strprintf("%u", nEnd - nBegin));
+    if (range == RANGE_OK)
+        req->WriteHeader("Content-Range", strprintf("bytes %u-%u/%u", nBegin, nEnd - 1, nTotal));
+    req->StartReply(range == RANGE_OK ? HTTP_PARTIAL_CONTENT : HTTP_OK);
+
+    bool fOk = true;
+    std::string chunk;
+    chunk.reserve(REST_CHUNK_SIZE);
+    std::vector<unsigned char> block;
+    uint64_t nOffset = 0; // Position of block i in the reply
+    for (size_t i = 0; i < vPos.size() && nOffset < nEnd && fOk; i++) {
+        if (nOffset + vSize[i] > nBegin) {
+            // The reply must match the Content-Length sent up front
+            fOk = ReadRawBlockFromDisk(block, vPos[i].first, vPos[i].second, Params().MessageStart()) && block.size() == vSize[i];
+            if (fOk)
+                fOk = WriteRawBlockData(req, chunk, block, std::max(nBegin, nOffset) - nOffset, std::min(nEnd, nOffset + vSize[i]) - nOffset);
+        }
+        nOffset += vSize[i];
+    }
+    if (fOk && !chunk.empty())
+        fOk = req->WriteReplyChunk(chunk);
+    if (!fOk) {
+        // Finishing the reply would leave a keep-alive client waiting for
+        // the rest of the announced Content-Length
+        LogPrint("http", "%s: /rest/blocks/%s reply truncated, closing the connection\n", __func__, strURIPart);
+        req->AbortReply();
+        return false;
+    }
+    req->EndReply();
+    return true;
+}
+
 static bool rest_block_extended(HTTPRequest* req, const std::string& strURIPart)
 {
     return rest_block(req, strURIPart, true);
@@ -264,6 +428,54 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/** Several transactions at once, /rest/txs/<txid>,<txid>,...<.bin|.hex> */
+static bool rest_txs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    vector<string> vHashStr;
+    boost::split(vHashStr, params[0], boost::is_any_of(","));
+    if (vHashStr.size() > MAX_REST_TXS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max transactions exceeded (max: %d, tried: %d)", MAX_REST_TXS, vHashStr.size()));
+
+    std::vector<CTransaction> vtx(vHashStr.size());
+    for (size_t i = 0; i < vHashStr.size(); i++) {
+        uint256 hash;
+        if (!ParseHashStr(vHashStr[i], hash))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + vHashStr[i]);
+        uint256 hashBlock;
+        if (!GetTransaction(hash, vtx[i], Params().GetConsensus(), hashBlock, true))
+            return RESTERR(req, HTTP_NOT_FOUND, vHashStr[i] + " not found");
+    }
+
+    // Transactions are concatenated, or in hex one per line
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    std::string strHex;
+    BOOST_FOREACH(const CTransaction& tx, vtx) {
+        if (rf == RF_BINARY) {
+            ssTx << tx;
+        } else {
+            CDataStream ssOne(SER_NETWORK, PROTOCOL_VERSION);
+            ssOne << tx;
+            strHex += HexStr(ssOne.begin(), ssOne.end()) + "\n";
+        }
+    }
+
+    if (rf == RF_BINARY) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ssTx.str());
+    } else {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+    }
+    return true;
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 
@@ -594,21 +806,27 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    HTTPWorkLane lane;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
+      {"/rest/tx/", rest_tx, HTTP_LANE_FAST},
+      {"/rest/txs/", rest_txs, HTTP_LANE_FAST},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTP_LANE_FAST},
+      {"/rest/block/", rest_block_extended, HTTP_LANE_FAST},
+      {"/rest/chaininfo", rest_chaininfo, HTTP_LANE_FAST},
+      {"/rest/mempool/info", rest_mempool_info, HTTP_LANE_FAST},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTP_LANE_FAST},
+      {"/rest/headers/", rest_headers, HTTP_LANE_FAST},
+      {"/rest/blocks/", rest_blocks, HTTP_LANE_HEAVY},
+      {"/rest/getutxos", rest_getutxos, HTTP_LANE_FAST},
 };
 
 bool StartREST()
 {
-    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++) {
+        HTTPWorkLane lane = uri_prefixes[i].lane;
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler,
+                            [lane](HTTPRequest*, const std::string&) { return lane; });
+    }
     return true;
 }
 
@@ -11,6 +11,7 @@
 #include "key_io.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -99,14 +100,10 @@ static UniValue ValuePoolDesc(
     return rv;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+static UniValue blockheaderToJSON(const CBlockIndex* blockindex, int confirmations, const CBlockIndex* pnext)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
-    int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
@@ -121,12 +118,27 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     return result;
 }
 
+UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    int confirmations = -1;
+    // Only report confirmations if the block is on the main chain
+    if (chainActive.Contains(blockindex))
+        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    return blockheaderToJSON(blockindex, confirmations, chainActive.Next(blockindex));
+}
+
+static std::string blockheaderToHex(const CBlockIndex* blockindex)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << blockindex->GetBlockHeader();
+    return HexStr(ssBlock.begin(), ssBlock.end());
+}
+
 // insightexplorer
 UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
 {
@@ -277,8 +289,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -294,8 +305,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainSnapshot()->Tip()->GetBlockHash().GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -315,6 +325,61 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
     return GetNetworkDifficulty();
 }
 
+/**
+ * Same as blockToJSON with txDetails, writing one transaction at a time.
+ * result is blockToJSON without txDetails, computed beforehand under cs_main;
+ * writing needs no lock.
+ */
+static void blockToJSON(JSONWriter& writer, const CBlock& block, const UniValue& result)
+{
+    writer.beginObject();
+    for (size_t i = 0; i < result.size(); i++)
+    {
+        if (result.getKeys()[i] != "tx") {
+            writer.pushKV(result.getKeys()[i], result.getValues()[i]);
+            continue;
+        }
+        writer.key("tx");
+        writer.beginArray();
+        BOOST_FOREACH(const CTransaction&tx, block.vtx)
+        {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(), objTx);
+            writer.value(objTx);
+        }
+        writer.endArray();
+    }
+    writer.endObject();
+}
+
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -323,30 +388,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         UniValue o(UniValue::VOBJ);
         BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            o.push_back(Pair(e.GetTx().GetHash().ToString(), mempoolEntryToJSON(e)));
         }
         return o;
     }
@@ -404,6 +446,42 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+/** Mempool entries converted per lock while streaming verbose getrawmempool */
+static const size_t MEMPOOL_STREAM_BATCH_SIZE = 1000;
+
+static void getrawmempool_stream(const UniValue& params, JSONWriter& writer)
+{
+    // Only the verbose result is worth streaming
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool()) {
+        writer.value(getrawmempool(params, false));
+        return;
+    }
+
+    // Writing can wait for a slow client, so the entries are converted in
+    // batches under the locks and each batch is written with them released
+    std::vector<uint256> vtxid;
+    mempool.queryHashes(vtxid);
+
+    writer.beginObject();
+    std::vector<std::pair<uint256, UniValue> > vBatch;
+    for (size_t nStart = 0; nStart < vtxid.size(); nStart += MEMPOOL_STREAM_BATCH_SIZE) {
+        const size_t nEnd = std::min(vtxid.size(), nStart + MEMPOOL_STREAM_BATCH_SIZE);
+        vBatch.clear();
+        {
+            LOCK2(cs_main, mempool.cs);
+            for (size_t i = nStart; i < nEnd; i++) {
+                // Skip the transactions that left the mempool meanwhile
+                auto it = mempool.mapTx.find(vtxid[i]);
+                if (it != mempool.mapTx.end())
+                    vBatch.push_back(std::make_pair(vtxid[i], mempoolEntryToJSON(*it)));
+            }
+        }
+        for (const auto& entry : vBatch)
+            writer.pushKV(entry.first.ToString(), entry.second);
+    }
+    writer.endObject();
+}
+
 // insightexplorer
 UniValue getblockdeltas(const UniValue& params, bool fHelp)
 {
@@ -585,13 +663,13 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    std::shared_ptr<const CChainSnapshot> snapshot = GetChainSnapshot();
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > snapshot->Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = (*snapshot)[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -627,8 +705,6 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -636,20 +712,99 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
+    // Blocks of the active chain are served from the chain snapshot without
+    // waiting for cs_main, anything else takes the slow path below.
+    std::shared_ptr<const CChainSnapshot> snapshot = GetChainSnapshot();
+    const CBlockIndex* pindexActive = LookupActiveChainBlock(hash);
+    if (pindexActive && snapshot->Contains(pindexActive))
+    {
+        if (!fVerbose)
+            return blockheaderToHex(pindexActive);
+        return blockheaderToJSON(pindexActive, snapshot->Height() - pindexActive->nHeight + 1, snapshot->Next(pindexActive));
+    }
+
+    LOCK(cs_main);
+
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (!fVerbose)
+        return blockheaderToHex(pblockindex);
+
+    return blockheaderToJSON(pblockindex);
+}
+
+/** Parse the arguments of getblock and read the block, cs_main must be held */
+static CBlockIndex* readBlockParams(const UniValue& params, CBlock& block, int& verbosity)
+{
+    AssertLockHeld(cs_main);
+
+    std::string strHash = params[0].get_str();
+
+    // If height is supplied, find the hash
+    if (strHash.size() < (2 * sizeof(uint256))) {
+        // std::stoi allows characters, whereas we want to be strict
+        regex r("[[:digit:]]+");
+        if (!regex_match(strHash, r)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        int nHeight = -1;
+        try {
+            nHeight = std::stoi(strHash);
+        }
+        catch (const std::exception &e) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        if (nHeight < 0 || nHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
+        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+    }
+
+    uint256 hash(uint256S(strHash));
+
+    verbosity = 1;
+    if (params.size() > 1) {
+        if(params[1].isNum()) {
+            verbosity = params[1].get_int();
+        } else {
+            verbosity = params[1].get_bool() ? 1 : 0;
+        }
+    }
+
+    if (verbosity < 0 || verbosity > 2) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    }
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
+static UniValue blockResultToJSON(const CBlock& block, const CBlockIndex* pblockindex, int verbosity)
+{
+    if (verbosity == 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
 UniValue getblock(const UniValue& params, bool fHelp)
@@ -702,66 +857,37 @@ UniValue getblock(const UniValue& params, bool fHelp)
 
     LOCK(cs_main);
 
-    std::string strHash = params[0].get_str();
-
-    // If height is supplied, find the hash
-    if (strHash.size() < (2 * sizeof(uint256))) {
-        // std::stoi allows characters, whereas we want to be strict
-        regex r("[[:digit:]]+");
-        if (!regex_match(strHash, r)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
-
-        int nHeight = -1;
-        try {
-            nHeight = std::stoi(strHash);
-        }
-        catch (const std::exception &e) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
-
-        if (nHeight < 0 || nHeight > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-        }
-        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
-    }
-
-    uint256 hash(uint256S(strHash));
+    CBlock block;
+    int verbosity;
+    CBlockIndex* pblockindex = readBlockParams(params, block, verbosity);
 
-    int verbosity = 1;
-    if (params.size() > 1) {
-        if(params[1].isNum()) {
-            verbosity = params[1].get_int();
-        } else {
-            verbosity = params[1].get_bool() ? 1 : 0;
-        }
-    }
+    return blockResultToJSON(block, pblockindex, verbosity);
+}
 
-    if (verbosity < 0 || verbosity > 2) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+static void getblock_stream(const UniValue& params, JSONWriter& writer)
+{
+    if (params.size() < 1 || params.size() > 2) {
+        writer.value(getblock(params, false));
+        return;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
+    // Everything that needs cs_main is done before writing, which can wait
+    // for a slow client
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
-    if (verbosity == 0)
+    int verbosity;
+    UniValue result;
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        LOCK(cs_main);
+        CBlockIndex* pblockindex = readBlockParams(params, block, verbosity);
+        result = verbosity < 2 ? blockResultToJSON(block, pblockindex, verbosity) : blockToJSON(block, pblockindex, false);
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    if (verbosity < 2) {
+        writer.value(result);
+        return;
+    }
+
+    blockToJSON(writer, block, result);
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
@@ -1378,6 +1504,21 @@ UniValue dpos_listroundvotes(const UniValue& params, bool fHelp)
 }
 
 
+static UniValue txVoteToJSON(const dpos::CTxVote_p2p& vote)
+{
+    UniValue jsonVote{UniValue::VOBJ};
+    jsonVote.push_back(Pair("hash", vote.GetHash().GetHex()));
+    jsonVote.push_back(Pair("tipBlock", vote.tip.GetHex()));
+    jsonVote.push_back(Pair("round", static_cast<int>(vote.nRound)));
+    for (std::size_t i{0}; i < vote.choices.size(); i++) {
+        std::string postfix{std::to_string(i)};
+        jsonVote.push_back(Pair("choice_txid#" + postfix, vote.choices[i].subject.GetHex()));
+        jsonVote.push_back(Pair("choice_decision#" + postfix, vote.choices[i].decision));
+    }
+    jsonVote.push_back(Pair("signature", HexStr(vote.signature)));
+    return jsonVote;
+}
+
 UniValue dpos_listtxvotes(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0) {
@@ -1404,41 +1545,45 @@ UniValue dpos_listtxvotes(const UniValue& params, bool fHelp)
 
     UniValue rv(UniValue::VARR);
     for (const auto& vote : dpos::getController()->listTxVotes()) {
-        UniValue jsonVote{UniValue::VOBJ};
-        jsonVote.push_back(Pair("hash", vote.GetHash().GetHex()));
-        jsonVote.push_back(Pair("tipBlock", vote.tip.GetHex()));
-        jsonVote.push_back(Pair("round", static_cast<int>(vote.nRound)));
-        for (std::size_t i{0}; i < vote.choices.size(); i++) {
-            std::string postfix{std::to_string(i)};
-            jsonVote.push_back(Pair("choice_txid#" + postfix, vote.choices[i].subject.GetHex()));
-            jsonVote.push_back(Pair("choice_decision#" + postfix, vote.choices[i].decision));
-        }
-        jsonVote.push_back(Pair("signature", HexStr(vote.signature)));
-        rv.push_back(jsonVote);
+        rv.push_back(txVoteToJSON(vote));
     }
 
     return rv;
 }
 
+static void dpos_listtxvotes_stream(const UniValue& params, JSONWriter& writer)
+{
+    if (params.size() != 0) {
+        writer.value(dpos_listtxvotes(params, false));
+        return;
+    }
+
+    writer.beginArray();
+    for (const auto& vote : dpos::getController()->listTxVotes()) {
+        writer.value(txVoteToJSON(vote));
+    }
+    writer.endArray();
+}
+
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  streaming actor
+  //  --------------------- ------------------------  -----------------------  ----------  ---------------
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
+    { "blockchain",         "getblock",               &getblock,               true,       &getblock_stream },
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       &getrawmempool_stream },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
     { "blockchain",         "dpos_listviceblocks",     &dpos_listviceblocks,     true  },
     { "blockchain",         "dpos_listroundvotes",     &dpos_listroundvotes,     true  },
-    { "blockchain",         "dpos_listtxvotes",        &dpos_listtxvotes,        true  },
+    { "blockchain",         "dpos_listtxvotes",        &dpos_listtxvotes,        true,       &dpos_listtxvotes_stream },
 
     // insightexplorer
     { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },    
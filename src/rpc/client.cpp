@@ -160,6 +160,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "mn_finalizedismissvoting", 0},
     { "mn_finalizedismissvoting", 1},
     { "dpos_gettxvotes", 0},
+    { "i_listtransactioncommits", 0},
     { "mn_setoperator", 0},
     { "mn_setoperator", 1},
     { "mn_list", 0},
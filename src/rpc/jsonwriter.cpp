@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonwriter.h"
+
+#include <assert.h>
+
+JSONWriter::JSONWriter(const Sink& sink, size_t nChunkSize) :
+    sink(sink), nChunkSize(nChunkSize), fAfterKey(false), fFlushed(false)
+{
+    buffer.reserve(nChunkSize);
+}
+
+void JSONWriter::separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            buffer += ',';
+        vEmpty.back() = false;
+    }
+}
+
+void JSONWriter::written()
+{
+    if (buffer.size() >= nChunkSize)
+        flush();
+}
+
+void JSONWriter::beginObject()
+{
+    separate();
+    buffer += '{';
+    vEmpty.push_back(true);
+}
+
+void JSONWriter::endObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    buffer += '}';
+    written();
+}
+
+void JSONWriter::beginArray()
+{
+    separate();
+    buffer += '[';
+    vEmpty.push_back(true);
+}
+
+void JSONWriter::endArray()
+{
+    assert(!vEmpty.empty());
+    vEmpty.pop_back();
+    buffer += ']';
+    written();
+}
+
+void JSONWriter::key(const std::string& name)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    separate();
+    buffer += UniValue(name).write();
+    buffer += ':';
+    fAfterKey = true;
+}
+
+void JSONWriter::value(const UniValue& val)
+{
+    if (val.isObject()) {
+        beginObject();
+        for (size_t i = 0; i < val.size(); i++)
+            pushKV(val.getKeys()[i], val.getValues()[i]);
+        endObject();
+    } else if (val.isArray()) {
+        beginArray();
+        for (size_t i = 0; i < val.size(); i++)
+            value(val.getValues()[i]);
+        endArray();
+    } else {
+        separate();
+        buffer += val.write();
+        written();
+    }
+}
+
+void JSONWriter::flush()
+{
+    if (buffer.empty())
+        return;
+    fFlushed = true;
+    sink(buffer);
+    buffer.clear();
+}
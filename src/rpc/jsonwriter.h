@@ -0,0 +1,63 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/** Output is handed to the sink in chunks of about this many bytes */
+static const size_t DEFAULT_JSON_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Incremental JSON emitter. Objects and arrays are opened and closed one
+ * element at a time, so a large result never has to exist as a whole, neither
+ * as a UniValue tree nor as a string. Whenever the pending output reaches the
+ * chunk size it is passed to the sink, which may take it over by swapping.
+ *
+ * The output is the same as UniValue::write() of the equivalent tree.
+ */
+class JSONWriter
+{
+public:
+    typedef boost::function<void(std::string& chunk)> Sink;
+
+    JSONWriter(const Sink& sink, size_t nChunkSize = DEFAULT_JSON_CHUNK_SIZE);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    /** Key of the next value, inside an object */
+    void key(const std::string& name);
+    /** Write a complete value, nested arrays and objects are written element by element */
+    void value(const UniValue& val);
+    void pushKV(const std::string& name, const UniValue& val) { key(name); value(val); }
+
+    /** Hand the pending output to the sink */
+    void flush();
+    /** Output not handed to the sink yet */
+    std::string& pending() { return buffer; }
+    /** Whether any output has been handed to the sink */
+    bool flushed() const { return fFlushed; }
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string buffer;
+    //! For each open array or object, whether it has no elements yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+    bool fFlushed;
+
+    void separate();
+    void written();
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
@@ -352,6 +352,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
             "  \"localsolps\": xxx.xxxxx    (numeric) The average local solution rate in Sol/s since this node was started\n"
+            "  \"threadsolps\": [ xxx.xxxxx, ... ] (array) The average solution rate in Sol/s of each local miner thread\n"
             "  \"networksolps\": x          (numeric) The estimated network solution rate in Sol/s\n"
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
@@ -374,6 +375,10 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("genproclimit",     (int)GetArg("-genproclimit", -1)));
     obj.push_back(Pair("localsolps"  ,     getlocalsolps(params, false)));
+    UniValue threadsolps(UniValue::VARR);
+    for (double solps : GetLocalSolPSPerThread())
+        threadsolps.push_back(UniValue(solps));
+    obj.push_back(Pair("threadsolps",      threadsolps));
     obj.push_back(Pair("networksolps",     getnetworksolps(params, false)));
     obj.push_back(Pair("networkhashps",    getnetworksolps(params, false)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
@@ -4,11 +4,13 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "clientversion.h"
+#include "httpserver.h"
 #include "init.h"
 #include "key_io.h"
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "notificationqueue.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -731,6 +733,107 @@ UniValue i_listtransactions(const UniValue& params, bool fHelp)
     return rv;
 }
 
+static UniValue CommittedTxToJSON(const dpos::CCommittedTx& commit)
+{
+    UniValue entry{UniValue::VOBJ};
+    entry.push_back(Pair("txid", commit.txid.GetHex()));
+    entry.push_back(Pair("tip", commit.tip.GetHex()));
+    entry.push_back(Pair("sequence", commit.nSequence));
+    entry.push_back(Pair("time", commit.nTime));
+    return entry;
+}
+
+UniValue i_gettransactioncommit(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1) {
+        throw runtime_error(
+            "i_gettransactioncommit \"txid\"\n"
+            "\nReturns whether an instant transaction is committed at the current tip, from the commit log.\n"
+            "\nArguments:\n"
+            "1. \"txid\"           (string, required) The transaction id\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"xxx\",      (string) The transaction id\n"
+            "  \"committed\": b,     (boolean) If the transaction is committed\n"
+            "  \"tip\": \"xxx\",       (string, only if committed) The tip of the voting the transaction was committed at\n"
+            "  \"sequence\": n,      (numeric, only if committed) The position of the commit in the commit log\n"
+            "  \"time\": n           (numeric, only if committed) When the commit was seen, in seconds since epoch\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("i_gettransactioncommit", "\"mytxid\"")
+            + HelpExampleRpc("i_gettransactioncommit", "\"mytxid\"")
+        );
+    }
+
+    const uint256 txid = ParseHashV(params[0], "txid");
+    const boost::optional<dpos::CCommittedTx> commit = dpos::getController()->getCommittedTx(txid);
+
+    UniValue rv{UniValue::VOBJ};
+    if (commit != boost::none) {
+        rv = CommittedTxToJSON(commit.get());
+        rv.push_back(Pair("committed", true));
+    } else {
+        rv.push_back(Pair("txid", txid.GetHex()));
+        rv.push_back(Pair("committed", false));
+    }
+    return rv;
+}
+
+UniValue i_listtransactioncommits(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1) {
+        throw runtime_error(
+            "i_listtransactioncommits ( sequence )\n"
+            "\nLists the commits of instant transactions logged after a sequence number which are\n"
+            "still valid at the current tip, and the removals of commits which are not valid anymore.\n"
+            "Pass the returned \"sequence\" to the next call to get the new entries only.\n"
+            "\nArguments:\n"
+            "1. sequence          (numeric, optional, default=0) List the commits logged after this sequence number\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sequence\": n,      (numeric) The sequence number of the latest logged commit or removal\n"
+            "  \"complete\": b,      (boolean) False if removals after the given sequence number were forgotten,\n"
+            "                      list again from 0 and replace what you have then. Always true from 0\n"
+            "  \"commits\": [        (array) The commits and removals, oldest first\n"
+            "    {\n"
+            "      \"txid\": \"xxx\",  (string) The transaction id\n"
+            "      \"tip\": \"xxx\",   (string) The tip of the voting the transaction was committed at\n"
+            "      \"sequence\": n,  (numeric) The position of the commit or removal in the commit log\n"
+            "      \"time\": n,      (numeric) When the commit or removal was seen, in seconds since epoch\n"
+            "      \"removed\": b    (boolean) If the commit is not valid at the current tip anymore\n"
+            "    },...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("i_listtransactioncommits", "")
+            + HelpExampleCli("i_listtransactioncommits", "42")
+            + HelpExampleRpc("i_listtransactioncommits", "42")
+        );
+    }
+
+    int64_t nSequence = 0;
+    if (params.size() > 0) {
+        nSequence = params[0].get_int64();
+        if (nSequence < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sequence, must be non-negative");
+    }
+
+    uint64_t nLastSequence = 0;
+    bool fComplete = true;
+    UniValue commits{UniValue::VARR};
+    for (const auto& commit : dpos::getController()->listCommittedTxsSince(nSequence, &nLastSequence, &fComplete)) {
+        UniValue entry = CommittedTxToJSON(commit);
+        entry.push_back(Pair("removed", commit.fRemoved));
+        commits.push_back(entry);
+    }
+
+    UniValue rv{UniValue::VOBJ};
+    rv.push_back(Pair("sequence", nLastSequence));
+    rv.push_back(Pair("complete", fComplete));
+    rv.push_back(Pair("commits", commits));
+    return rv;
+}
+
 UniValue isinitialblockdownload(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0) {
@@ -750,6 +853,96 @@ UniValue isinitialblockdownload(const UniValue& params, bool fHelp)
     return rv;
 }
 
+UniValue getrpcqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0) {
+        throw runtime_error(
+            "getrpcqueueinfo\n"
+            "\nReturns the state of the RPC work queue, one entry per lane.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lane\": \"name\",      (string) fast, wallet or heavy\n"
+            "    \"queued\": n,         (numeric) requests waiting for a worker\n"
+            "    \"clients\": n,        (numeric) distinct clients with waiting requests\n"
+            "    \"running\": n,        (numeric) requests being executed\n"
+            "    \"threads\": n,        (numeric) most workers the lane may occupy at once\n"
+            "    \"depth\": n,          (numeric) most requests the lane may hold waiting\n"
+            "    \"processed\": n,      (numeric) requests executed since startup\n"
+            "    \"rejected\": n,       (numeric) requests refused since startup because the lane or client was full\n"
+            "    \"avg_wait_us\": n,    (numeric) moving average of the queueing time in microseconds\n"
+            "    \"max_wait_us\": n     (numeric) longest queueing time in microseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcqueueinfo", "")
+            + HelpExampleRpc("getrpcqueueinfo", "")
+        );
+    }
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(const HTTPWorkLaneStats& stats, GetHTTPWorkQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lane", HTTPWorkLaneName(stats.lane)));
+        obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+        obj.push_back(Pair("clients", (uint64_t)stats.nClients));
+        obj.push_back(Pair("running", stats.nRunning));
+        obj.push_back(Pair("threads", stats.nThreads));
+        obj.push_back(Pair("depth", (uint64_t)stats.nMaxDepth));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("avg_wait_us", stats.nAvgWait));
+        obj.push_back(Pair("max_wait_us", stats.nMaxWait));
+        result.push_back(obj);
+    }
+    return result;
+}
+
+UniValue getnotificationqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0) {
+        throw runtime_error(
+            "getnotificationqueueinfo\n"
+            "\nReturns the state of the ZMQ and AMQP notification queues.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",        (string) zmq or amqp\n"
+            "    \"queued\": n,           (numeric) notifications waiting to be published\n"
+            "    \"max_queued\": n,       (numeric) most notifications that were waiting at once\n"
+            "    \"size\": n,             (numeric) most notifications that may wait\n"
+            "    \"published\": n,        (numeric) notifications published, a batch of transactions counts once\n"
+            "    \"transactions\": n,     (numeric) transactions published\n"
+            "    \"dropped\": n,          (numeric) notifications dropped because the queue was full\n"
+            "    \"blocked\": n,          (numeric) times validation waited for room in the queue (-notifyqueueblock)\n"
+            "    \"blocked_us\": n        (numeric) total time validation waited, in microseconds\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnotificationqueueinfo", "")
+            + HelpExampleRpc("getnotificationqueueinfo", "")
+        );
+    }
+
+    UniValue result(UniValue::VARR);
+    BOOST_FOREACH(const CNotificationQueueStats& stats, GetNotificationQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.name));
+        obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+        obj.push_back(Pair("max_queued", (uint64_t)stats.nMaxQueued));
+        obj.push_back(Pair("size", (uint64_t)stats.nMaxSize));
+        obj.push_back(Pair("published", stats.nPublished));
+        obj.push_back(Pair("transactions", stats.nTransactions));
+        obj.push_back(Pair("dropped", stats.nDropped));
+        obj.push_back(Pair("blocked", stats.nBlocked));
+        obj.push_back(Pair("blocked_us", stats.nBlockedTime));
+        result.push_back(obj);
+    }
+    return result;
+}
+
 
 // insightexplorer
 static bool getAddressFromIndex(
@@ -821,6 +1014,65 @@ static bool getAddressesFromParams(
     return true;
 }
 
+// insightexplorer
+// With "limit" the results come in pages of at most limit rows, read straight
+// from the index without collecting everything first. A page that isn't the
+// last one carries a "cursor" to pass back for the next page.
+static bool getPageParams(const UniValue& params, size_t& limit, std::string& cursor)
+{
+    if (!params[0].isObject())
+        return false;
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (limitValue.isNull())
+        return false;
+    if (limitValue.get_int() <= 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    }
+    limit = limitValue.get_int();
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    cursor = cursorValue.isNull() ? "" : cursorValue.get_str();
+    return true;
+}
+
+template <typename Position>
+static std::string encodeCursor(const Position& position)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << position;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template <typename Position>
+static void decodeCursor(const std::string& cursor, Position& position)
+{
+    if (!IsHex(cursor)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    std::vector<unsigned char> data(ParseHex(cursor));
+    CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ss >> position;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+}
+
+// A cursor of getaddressdeltas or getaddressutxos: the position in the address
+// list and the index key of the first row of the next page.
+template <typename Key>
+static void decodeAddressCursor(
+    const std::string& cursor,
+    const std::vector<std::pair<uint160, int>>& addresses,
+    std::pair<uint32_t, Key>& position)
+{
+    decodeCursor(cursor, position);
+    if (position.first >= addresses.size() ||
+        addresses[position.first].first != position.second.hashBytes ||
+        addresses[position.first].second != (int)position.second.type) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor doesn't match the addresses");
+    }
+}
+
 // insightexplorer
 UniValue getaddressmempool(const UniValue& params, bool fHelp)
 {
@@ -924,6 +1176,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean, optional, default=false) Include chain info with results\n"
+            "  \"limit\"      (number, optional) Return at most this many outputs, ordered by address and txid\n"
+            "  \"cursor\"     (string, optional) The cursor of the previous page, to get the next one\n"
             "}\n"
             "(or)\n"
             "\"address\"  (string) The base58check encoded address\n"
@@ -953,7 +1207,9 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    ],\n"
             "  \"hash\"              (string)  The block hash\n"
             "  \"height\"            (numeric) The block height\n"
-            "}\n"
+            "}\n\n"
+            "(if limit is given, an object as above with:)\n\n"
+            "  \"cursor\"            (string)  Only if there are more outputs, the cursor to get the next page\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"chainInfo\": true}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"chainInfo\": true}")
@@ -975,19 +1231,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
-    std::vector<CAddressUnspentDbEntry> unspentOutputs;
-    for (const auto& it : addresses) {
-        if (!GetAddressUnspent(it.first, it.second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(),
-        [](const CAddressUnspentDbEntry& a, const CAddressUnspentDbEntry& b) -> bool {
-            return a.second.blockHeight < b.second.blockHeight;
-        });
-
-    UniValue utxos(UniValue::VARR);
-    for (const auto& it : unspentOutputs) {
+    auto utxoToJSON = [](const CAddressUnspentDbEntry& it) {
         UniValue output(UniValue::VOBJ);
         std::string address;
         if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address)) {
@@ -1000,14 +1244,63 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         output.push_back(Pair("script", HexStr(it.second.script.begin(), it.second.script.end())));
         output.push_back(Pair("satoshis", it.second.satoshis));
         output.push_back(Pair("height", it.second.blockHeight));
-        utxos.push_back(output);
+        return output;
+    };
+
+    size_t limit = 0;
+    std::string cursor;
+    bool paged = getPageParams(params, limit, cursor);
+
+    UniValue utxos(UniValue::VARR);
+    std::string nextCursor;
+    if (paged) {
+        std::pair<uint32_t, CAddressUnspentKey> position(0, CAddressUnspentKey());
+        if (!cursor.empty()) {
+            decodeAddressCursor(cursor, addresses, position);
+        }
+        for (uint32_t i = position.first; i < addresses.size() && nextCursor.empty(); i++) {
+            CAddressUnspentKey keyFrom(addresses[i].second, addresses[i].first, uint256(), 0);
+            if (!cursor.empty() && i == position.first) {
+                keyFrom = position.second;
+            }
+            bool fScanned = ScanAddressUnspent(keyFrom, [&](const CAddressUnspentDbEntry& it) {
+                if (utxos.size() == limit) {
+                    nextCursor = encodeCursor(std::make_pair(i, it.first));
+                    return false;
+                }
+                utxos.push_back(utxoToJSON(it));
+                return true;
+            });
+            if (!fScanned) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+    } else {
+        std::vector<CAddressUnspentDbEntry> unspentOutputs;
+        for (const auto& it : addresses) {
+            if (!GetAddressUnspent(it.first, it.second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(),
+            [](const CAddressUnspentDbEntry& a, const CAddressUnspentDbEntry& b) -> bool {
+                return a.second.blockHeight < b.second.blockHeight;
+            });
+
+        for (const auto& it : unspentOutputs) {
+            utxos.push_back(utxoToJSON(it));
+        }
     }
 
-    if (!includeChainInfo)
+    if (!includeChainInfo && !paged)
         return utxos;
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("utxos", utxos));
+    if (!nextCursor.empty())
+        result.push_back(Pair("cursor", nextCursor));
+    if (!includeChainInfo)
+        return result;
 
     LOCK(cs_main);  // for chainActive
     result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
@@ -1072,7 +1365,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false)}\n"
+            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false), (\"limit\": n), (\"cursor\": \"cursor\")}\n"
             "\nReturns all changes for an address.\n"
             "\nReturns information about all changes to the given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain.\n"
@@ -1087,6 +1380,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\"       (number, optional) The start block height\n"
             "  \"end\"         (number, optional) The end block height\n"
             "  \"chainInfo\"   (boolean, optional, default=false) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\"       (number, optional) Return at most this many deltas\n"
+            "  \"cursor\"      (string, optional) The cursor of the previous page, to get the next one\n"
             "}\n"
             "(or)\n"
             "\"address\"       (string) The base58check encoded address\n"
@@ -1122,7 +1417,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "      \"hash\"          (string)  The end block hash\n"
             "      \"height\"        (numeric) The height of the end block\n"
             "    }\n"
-            "}\n"
+            "}\n\n"
+            "(if limit is given, an object as above with:)\n\n"
+            "  \"cursor\"          (string)  Only if there are more deltas, the cursor to get the next page\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}")
@@ -1137,10 +1434,6 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     int end = 0;
     getHeightRange(params, start, end);
 
-    std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
-
     bool includeChainInfo = false;
     if (params[0].isObject()) {
         UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
@@ -1149,8 +1442,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         }
     }
 
-    UniValue deltas(UniValue::VARR);
-    for (const auto& it : addressIndex) {
+    auto deltaToJSON = [](const CAddressIndexDbEntry& it) {
         std::string address;
         if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
@@ -1163,13 +1455,59 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         delta.push_back(Pair("index", (int)it.first.index));
         delta.push_back(Pair("satoshis", it.second));
         delta.push_back(Pair("txid", it.first.txhash.GetHex()));
-        deltas.push_back(delta);
+        return delta;
+    };
+
+    size_t limit = 0;
+    std::string cursor;
+    bool paged = getPageParams(params, limit, cursor);
+
+    std::vector<std::pair<uint160, int>> addresses;
+    UniValue deltas(UniValue::VARR);
+    std::string nextCursor;
+    if (paged) {
+        if (!getAddressesFromParams(params, addresses)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        }
+        std::pair<uint32_t, CAddressIndexKey> position(0, CAddressIndexKey());
+        if (!cursor.empty()) {
+            decodeAddressCursor(cursor, addresses, position);
+        }
+        for (uint32_t i = position.first; i < addresses.size() && nextCursor.empty(); i++) {
+            CAddressIndexKey keyFrom(addresses[i].second, addresses[i].first, start, 0, uint256(), 0, false);
+            if (!cursor.empty() && i == position.first) {
+                keyFrom = position.second;
+            }
+            bool fScanned = ScanAddressIndex(keyFrom, end, [&](const CAddressIndexDbEntry& it) {
+                if (deltas.size() == limit) {
+                    nextCursor = encodeCursor(std::make_pair(i, it.first));
+                    return false;
+                }
+                deltas.push_back(deltaToJSON(it));
+                return true;
+            });
+            if (!fScanned) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                    "No information available for address");
+            }
+        }
+    } else {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+        getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+        for (const auto& it : addressIndex) {
+            deltas.push_back(deltaToJSON(it));
+        }
     }
 
     UniValue result(UniValue::VOBJ);
 
     if (!(includeChainInfo && start > 0 && end > 0)) {
-        return deltas;
+        if (!paged)
+            return deltas;
+        result.push_back(Pair("deltas", deltas));
+        if (!nextCursor.empty())
+            result.push_back(Pair("cursor", nextCursor));
+        return result;
     }
 
     UniValue startInfo(UniValue::VOBJ);
@@ -1186,6 +1524,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     endInfo.push_back(Pair("height", end));
 
     result.push_back(Pair("deltas", deltas));
+    if (!nextCursor.empty())
+        result.push_back(Pair("cursor", nextCursor));
     result.push_back(Pair("start", startInfo));
     result.push_back(Pair("end", endInfo));
 
@@ -1220,6 +1560,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in zatoshis\n"
             "  \"received\"  (string) The total number of zatoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving the addresses, counted once per address\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}'")
@@ -1232,22 +1573,86 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    // this method doesn't take start and end block height params, so set
-    // to zero (full range, entire blockchain)
-    getAddressesInHeightRange(params, 0, 0, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
 
+    // The totals are maintained by the address index, no need to sum up its entries
     CAmount balance = 0;
     CAmount received = 0;
-    for (const auto& it : addressIndex) {
-        if (it.second > 0) {
-            received += it.second;
+    int64_t txCount = 0;
+    for (const auto& it : addresses) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance(it.first, it.second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
         }
-        balance += it.second;
+        balance += value.balance;
+        received += value.received;
+        txCount += value.txCount;
     }
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txCount));
+    return result;
+}
+
+// A page of getaddresstxids. Every address contributes its first limit + 1
+// txids after the cursor, in (height, txid) order, so their merge holds the
+// page and tells whether there is another one. The cursor is the last txid
+// of the page with its height.
+static UniValue getaddresstxidspage(const UniValue& params, int start, int end, size_t limit, const std::string& cursor)
+{
+    std::vector<std::pair<uint160, int>> addresses;
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    std::pair<int, std::string> after(-1, "");
+    if (!cursor.empty()) {
+        std::pair<int, uint256> position;
+        decodeCursor(cursor, position);
+        after = std::make_pair(position.first, position.second.GetHex());
+    }
+
+    std::set<std::pair<int, std::string>> txids;
+    for (const auto& it : addresses) {
+        // Entries of a height are ordered by position in the block rather than
+        // by txid, so a height is always read to its end.
+        std::set<std::pair<int, std::string>> found;
+        const int fromHeight = std::max(start, after.first);
+        bool fScanned = ScanAddressIndex(CAddressIndexKey(it.second, it.first, fromHeight, 0, uint256(), 0, false), end,
+            [&](const CAddressIndexDbEntry& entry) {
+                std::pair<int, std::string> txid(entry.first.blockHeight, entry.first.txhash.GetHex());
+                if (found.size() > limit && txid.first != found.rbegin()->first)
+                    return false;
+                if (txid > after)
+                    found.insert(txid);
+                return true;
+            });
+        if (!fScanned) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
+        }
+        txids.insert(found.begin(), found.end());
+    }
+
+    UniValue page(UniValue::VARR);
+    std::string nextCursor;
+    for (auto it = txids.begin(); it != txids.end(); ++it) {
+        if (page.size() == limit) {
+            const auto& last = *std::prev(it);
+            nextCursor = encodeCursor(std::make_pair(last.first, uint256S(last.second)));
+            break;
+        }
+        page.push_back(it->second);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txids", page));
+    if (!nextCursor.empty())
+        result.push_back(Pair("cursor", nextCursor));
     return result;
 }
 
@@ -1262,7 +1667,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n)}\n"
+            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"limit\": n), (\"cursor\": \"cursor\")}\n"
             "\nReturns the txids for given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain.\n"
             + disabledMsg +
@@ -1275,6 +1680,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number, optional) The start block height\n"
             "  \"end\" (number, optional) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids\n"
+            "  \"cursor\" (string, optional) The cursor of the previous page, to get the next one\n"
             "}\n"
             "(or)\n"
             "\"address\"  (string) The base58check encoded address\n"
@@ -1282,7 +1689,12 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
-            "]\n"
+            "]\n\n"
+            "(or, if limit is given):\n\n"
+            "{\n"
+            "  \"txids\": [\"transactionid\", ...]  (array) The transaction ids as above\n"
+            "  \"cursor\"                          (string) Only if there are more txids, the cursor to get the next page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}")
@@ -1297,6 +1709,12 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     int end = 0;
     getHeightRange(params, start, end);
 
+    size_t limit = 0;
+    std::string cursor;
+    if (getPageParams(params, limit, cursor)) {
+        return getaddresstxidspage(params, start, end, limit, cursor);
+    }
+
     std::vector<std::pair<uint160, int>> addresses;
     std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
     getAddressesInHeightRange(params, start, end, addresses, addressIndex);
@@ -1386,6 +1804,8 @@ static const CRPCCommand commands[] =
     { "util",               "createmultisig",         &createmultisig,         true  },
     { "util",               "verifymessage",          &verifymessage,          true  },
     { "control",            "isinitialblockdownload", &isinitialblockdownload, true  },
+    { "control",            "getrpcqueueinfo",        &getrpcqueueinfo,        true  },
+    { "control",            "getnotificationqueueinfo", &getnotificationqueueinfo, true  },
     // START insightexplorer
     /* Address index */
     { "addressindex",       "getaddresstxids",        &getaddresstxids,        false }, /* insight explorer */
@@ -1406,6 +1826,8 @@ static const CRPCCommand commands[] =
     { "hidden",             "mn_filterheartbeats",    &mn_filterheartbeats,    true  },
     /* dPoS */
     { "hidden",             "i_listtransactions",     &i_listtransactions,     true  },
+    { "hidden",             "i_gettransactioncommit", &i_gettransactioncommit, true  },
+    { "hidden",             "i_listtransactioncommits", &i_listtransactioncommits, true  },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
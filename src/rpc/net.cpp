@@ -75,6 +75,25 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
     }
 }
 
+/** Per message type traffic, handler and wait times (in seconds) are only tracked for received messages */
+static UniValue MsgTypeStatsToJSON(const mapMsgTypeStats& mapStats, bool fRecv)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& entry : mapStats) {
+        if (entry.second.nMessages == 0)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", entry.second.nMessages));
+        obj.push_back(Pair("bytes", entry.second.nBytes));
+        if (fRecv) {
+            obj.push_back(Pair("handlertime", entry.second.nHandlerMicros / 1e6));
+            obj.push_back(Pair("waittime", entry.second.nWaitMicros / 1e6));
+        }
+        ret.push_back(Pair(entry.first, obj));
+    }
+    return ret;
+}
+
 UniValue getpeerinfo(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -106,7 +125,24 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) The number of blocks we may ask from this peer at once, sized by its delivery time\n"
+            "    \"block_delivery_time\": n,  (numeric) The smoothed time in seconds this peer takes to deliver a block, 0 if not measured yet\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"sent_per_msg\": {         (json object) Messages sent to the peer, by message type\n"
+            "       \"type\": {\n"
+            "         \"count\": n,           (numeric) The number of messages, unknown types are counted as \"*other*\"\n"
+            "         \"bytes\": n            (numeric) The total bytes, including message headers\n"
+            "       }, ...\n"
+            "    },\n"
+            "    \"recv_per_msg\": {         (json object) Messages received from the peer, by message type\n"
+            "       \"type\": {\n"
+            "         \"count\": n,           (numeric) The number of messages\n"
+            "         \"bytes\": n,           (numeric) The total bytes, including message headers\n"
+            "         \"handlertime\": n,     (numeric) The total time in seconds spent processing them\n"
+            "         \"waittime\": n         (numeric) The total time in seconds they waited to be processed\n"
+            "       }, ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -156,8 +192,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInTransitLimit));
+            obj.push_back(Pair("block_delivery_time", statestats.nBlockDeliveryTime / 1e6));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("sent_per_msg", MsgTypeStatsToJSON(stats.mapSendStats, false)));
+        obj.push_back(Pair("recv_per_msg", MsgTypeStatsToJSON(stats.mapRecvStats, true)));
 
         ret.push_back(obj);
     }
@@ -364,7 +404,9 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"sent_per_msg\": {...}, (json object) Messages sent to all peers by message type, as in getpeerinfo\n"
+            "  \"recv_per_msg\": {...}  (json object) Messages received from all peers by message type, as in getpeerinfo\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getnettotals", "")
@@ -375,6 +417,8 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+    obj.push_back(Pair("sent_per_msg", MsgTypeStatsToJSON(CNode::GetTotalSendStats(), false)));
+    obj.push_back(Pair("recv_per_msg", MsgTypeStatsToJSON(CNode::GetTotalRecvStats(), true)));
     return obj;
 }
 
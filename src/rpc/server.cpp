@@ -4,6 +4,7 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "rpc/server.h"
+#include "rpc/jsonwriter.h"
 
 #include "init.h"
 #include "key_io.h"
@@ -14,6 +15,7 @@
 #include "utilstrencodings.h"
 #include "asyncrpcqueue.h"
 
+#include <atomic>
 #include <memory>
 
 #include <univalue.h>
@@ -418,11 +420,82 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Progress of a batch shared between the threads working on it */
+struct CRPCBatch
 {
+    const UniValue& vReq;
+    std::vector<UniValue> vReply;
+    std::atomic<size_t> nNext;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nDone;
+
+    CRPCBatch(const UniValue& vReq) : vReq(vReq), vReply(vReq.size()), nNext(0), nDone(0) {}
+};
+
+/** Execute requests of the batch until none are left to claim */
+static void JSONRPCExecBatchItems(std::shared_ptr<CRPCBatch> batch)
+{
+    // A helper that starts after all requests were claimed returns without
+    // touching vReq, which may be gone by then.
+    size_t reqIdx;
+    while ((reqIdx = batch->nNext++) < batch->vReply.size()) {
+        UniValue reply = JSONRPCExecOne(batch->vReq[reqIdx]);
+        boost::unique_lock<boost::mutex> lock(batch->cs);
+        batch->vReply[reqIdx] = reply;
+        if (++batch->nDone == batch->vReply.size())
+            batch->cond.notify_all();
+    }
+}
+
+/** Categories whose commands only read node state */
+static const char* const READ_ONLY_CATEGORIES[] = {"addressindex", "blockchain", "util"};
+
+static bool IsReadOnlyRequest(const UniValue& req)
+{
+    // Malformed requests and unknown methods only produce an error reply
+    if (!req.isObject() || !find_value(req, "method").isStr())
+        return true;
+    const CRPCCommand* pcmd = tableRPC[find_value(req, "method").get_str()];
+    if (!pcmd)
+        return true;
+    for (const char* category : READ_ONLY_CATEGORIES) {
+        if (pcmd->category == category)
+            return true;
+    }
+    return false;
+}
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskDispatcher& dispatch)
+{
+    std::shared_ptr<CRPCBatch> batch = std::make_shared<CRPCBatch>(vReq);
+
+    // Only batches of read-only commands run concurrently. Any other batch
+    // runs in request order, as its requests may depend on each other, e.g.
+    // walletpassphrase followed by sendtoaddress.
+    bool fConcurrent = dispatch && vReq.size() > 1;
+    for (size_t reqIdx = 0; reqIdx < vReq.size() && fConcurrent; reqIdx++)
+        fConcurrent = IsReadOnlyRequest(vReq[reqIdx]);
+
+    // The calling thread works on the batch too, so it only ever waits for
+    // requests that are already being executed and cannot deadlock on a busy queue.
+    if (fConcurrent) {
+        size_t nHelpers = std::min((size_t)std::max(GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY), (int64_t)1), vReq.size()) - 1;
+        for (size_t i = 0; i < nHelpers; i++) {
+            if (!dispatch(boost::bind(JSONRPCExecBatchItems, batch)))
+                break;
+        }
+    }
+    JSONRPCExecBatchItems(batch);
+    {
+        boost::unique_lock<boost::mutex> lock(batch->cs);
+        while (batch->nDone < batch->vReply.size())
+            batch->cond.wait(lock);
+    }
+
     UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (size_t reqIdx = 0; reqIdx < batch->vReply.size(); reqIdx++)
+        ret.push_back(batch->vReply[reqIdx]);
 
     return ret.write() + "\n";
 }
@@ -456,6 +529,38 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+void CRPCTable::execute(const std::string &strMethod, const UniValue &params, JSONWriter &writer) const
+{
+    // Return immediately if in warmup
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            throw JSONRPCError(RPC_IN_WARMUP, rpcWarmupStatus);
+    }
+
+    // Find method
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        // Execute
+        if (pcmd->streamActor)
+            pcmd->streamActor(params, writer);
+        else
+            writer.value(pcmd->actor(params, false));
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    g_rpcSignals.PostCommand(*pcmd);
+}
+
 std::string HelpExampleCli(const std::string& methodname, const std::string& args)
 {
     return "> crypticcoin-cli " + methodname + " " + args + "\n";
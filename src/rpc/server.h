@@ -22,6 +22,7 @@
 
 class AsyncRPCQueue;
 class CRPCCommand;
+class JSONWriter;
 
 namespace RPCServer
 {
@@ -34,6 +35,9 @@ namespace RPCServer
 class CBlockIndex;
 class CNetAddr;
 
+/** Default for -rpcbatchconcurrency, the number of threads working on one batch request */
+static const int DEFAULT_RPC_BATCH_CONCURRENCY = 4;
+
 class JSONRequest
 {
 public:
@@ -118,6 +122,8 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/** Writes the result of a call piecewise, for commands with potentially huge results */
+typedef void(*rpcstreamfn_type)(const UniValue& params, JSONWriter& writer);
 
 class CRPCCommand
 {
@@ -126,6 +132,12 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Optional, used instead of actor when the result is streamed
+    rpcstreamfn_type streamActor;
+
+    CRPCCommand(const std::string& categoryIn, const std::string& nameIn, rpcfn_type actorIn,
+                bool okSafeModeIn, rpcstreamfn_type streamActorIn = nullptr)
+        : category(categoryIn), name(nameIn), actor(actorIn), okSafeMode(okSafeModeIn), streamActor(streamActorIn) {}
 };
 
 /**
@@ -149,6 +161,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method, writing the result to writer.
+     * Commands without a streaming implementation are executed normally and
+     * their result is written as a whole.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    void execute(const std::string &method, const UniValue &params, JSONWriter &writer) const;
+
 
     /**
      * Appends a CRPCCommand to the dispatch table.
@@ -186,7 +206,14 @@ extern CAmount getInstantBalanceZaddr(std::string address, bool ignoreUnspendabl
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Runs a task on another thread, returns false if it could not be queued */
+typedef boost::function<bool(const boost::function<void()>& task)> RPCTaskDispatcher;
+/**
+ * Execute a batch of requests. With a dispatcher, up to -rpcbatchconcurrency
+ * requests of a batch made only of read-only commands are executed at the
+ * same time, other batches run sequentially. Replies are in request order.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCTaskDispatcher& dispatch = RPCTaskDispatcher());
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::string& enableArg);
 
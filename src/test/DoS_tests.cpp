@@ -15,6 +15,7 @@
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
+#include "txorphanpool.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
@@ -27,16 +28,6 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/test/data/test_case.hpp>
 
-// Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-    CTransaction tx;
-    NodeId fromPeer;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
 {
@@ -110,13 +101,9 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     BOOST_CHECK(!CNode::IsBanned(addr));
 }
 
-CTransaction RandomOrphan()
+CTransaction RandomOrphan(const std::vector<CTransaction>& vOrphans)
 {
-    std::map<uint256, COrphanTx>::iterator it;
-    it = mapOrphanTransactions.lower_bound(GetRandHash());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
+    return vOrphans[GetRand(vOrphans.size())];
 }
 
 // Parameterized testing over consensus branch ids
@@ -129,6 +116,10 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
     CBasicKeyStore keystore;
     keystore.AddKey(key);
 
+    orphanTxPool.Clear();
+    std::vector<CTransaction> vOrphans;
+    const int64_t nTime = GetTime();
+
     // 50 orphan transactions:
     for (int i = 0; i < 50; i++)
     {
@@ -141,13 +132,14 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(tx, i);
+        BOOST_CHECK(orphanTxPool.AddTx(tx, i, nTime, DEFAULT_MAX_ORPHAN_TX_PER_PEER));
+        vOrphans.push_back(tx);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransaction txPrev = RandomOrphan();
+        CTransaction txPrev = RandomOrphan(vOrphans);
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -158,13 +150,13 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, txPrev, tx, 0, SIGHASH_ALL, consensusBranchId);
 
-        AddOrphanTx(tx, i);
+        orphanTxPool.AddTx(tx, i, nTime, DEFAULT_MAX_ORPHAN_TX_PER_PEER);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransaction txPrev = RandomOrphan();
+        CTransaction txPrev = RandomOrphan(vOrphans);
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -182,25 +174,97 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(tx, i));
+        BOOST_CHECK(!orphanTxPool.AddTx(tx, i, nTime, DEFAULT_MAX_ORPHAN_TX_PER_PEER));
     }
 
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        size_t sizeBefore = orphanTxPool.Size();
+        BOOST_CHECK(orphanTxPool.EraseForPeer(i) > 0);
+        BOOST_CHECK(orphanTxPool.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanTxPool.PeerCount(i), 0);
+        BOOST_CHECK_EQUAL(orphanTxPool.PeerBytes(i), 0);
     }
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
-    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    // Test Limit() function:
+    orphanTxPool.Limit(40, nTime);
+    BOOST_CHECK(orphanTxPool.Size() <= 40);
+    orphanTxPool.Limit(10, nTime);
+    BOOST_CHECK(orphanTxPool.Size() <= 10);
+    orphanTxPool.Limit(0, nTime);
+    BOOST_CHECK_EQUAL(orphanTxPool.Size(), 0);
+    BOOST_CHECK_EQUAL(orphanTxPool.Bytes(), 0);
+    BOOST_CHECK(orphanTxPool.GetChildren(vOrphans[0].GetHash()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanQuotaAndExpiry)
+{
+    orphanTxPool.Clear();
+    const int64_t nTime = GetTime();
+
+    std::vector<CTransaction> vParents;
+    for (int i = 0; i < 10; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        vParents.push_back(tx);
+    }
+
+    // A single peer can't fill the pool beyond its quota
+    for (int i = 0; i < 10; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = vParents[i].GetHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        BOOST_CHECK_EQUAL(orphanTxPool.AddTx(tx, 1, nTime + i, 5), i < 5);
+    }
+    BOOST_CHECK_EQUAL(orphanTxPool.PeerCount(1), 5);
+    BOOST_CHECK_EQUAL(orphanTxPool.PeerBytes(1), orphanTxPool.Bytes());
+    BOOST_CHECK_EQUAL(orphanTxPool.GetChildren(vParents[0].GetHash()).size(), 1);
+    BOOST_CHECK(orphanTxPool.GetChildren(vParents[9].GetHash()).empty());
+
+    // An orphan from another peer survives eviction of the heaviest peer
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].prevout.hash = GetRandHash();
+    txOther.vout.resize(1);
+    BOOST_CHECK(orphanTxPool.AddTx(txOther, 2, nTime + 10, 5));
+    orphanTxPool.Limit(3, nTime + 10);
+    BOOST_CHECK_EQUAL(orphanTxPool.Size(), 3);
+    BOOST_CHECK_EQUAL(orphanTxPool.PeerCount(1), 2);
+    BOOST_CHECK(orphanTxPool.HaveTx(txOther.GetHash()));
+
+    // Orphans expire once they are older than ORPHAN_TX_EXPIRE_TIME
+    orphanTxPool.Limit(100, nTime + 4 + ORPHAN_TX_EXPIRE_TIME);
+    BOOST_CHECK_EQUAL(orphanTxPool.PeerCount(1), 0);
+    BOOST_CHECK(orphanTxPool.HaveTx(txOther.GetHash()));
+
+    // Orphans included in a block are dropped, and confirmed parents
+    // are handed out once for reprocessing of their children
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout.hash = vParents[0].GetHash();
+    txChild.vout.resize(1);
+    BOOST_CHECK(orphanTxPool.AddTx(txChild, 3, nTime + 10, 5));
+
+    CBlock block;
+    block.vtx.push_back(txOther);
+    block.vtx.push_back(vParents[0]);
+    orphanTxPool.EraseForBlock(block);
+    BOOST_CHECK(!orphanTxPool.HaveTx(txOther.GetHash()));
+    BOOST_CHECK(orphanTxPool.HaveTx(txChild.GetHash()));
+    std::vector<uint256> vReady = orphanTxPool.TakeReadyParents();
+    BOOST_CHECK(vReady.size() == 1 && vReady[0] == vParents[0].GetHash());
+    BOOST_CHECK(orphanTxPool.TakeReadyParents().empty());
+    orphanTxPool.Clear();
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
+#include "addressindex.h"
 #include "dbwrapper.h"
+#include "main.h"
 #include "uint256.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
@@ -229,6 +231,30 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
-
+// Indexing the same block twice must not count its entries twice
+BOOST_FIXTURE_TEST_CASE(address_balance_reindex_block, TestingSetup)
+{
+    uint160 addressHash(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 txid1 = GetRandHash();
+    uint256 txid2 = GetRandHash();
+    std::vector<CAddressIndexDbEntry> vect;
+    vect.push_back(make_pair(CAddressIndexKey(1, addressHash, 10, 1, txid1, 0, false), 500));
+    vect.push_back(make_pair(CAddressIndexKey(1, addressHash, 10, 2, txid2, 0, true), -200));
+    vect.push_back(make_pair(CAddressIndexKey(1, addressHash, 10, 2, txid2, 1, false), 50));
+
+    CAddressBalanceValue value;
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vect));
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vect));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(addressHash, 1, value));
+    BOOST_CHECK_EQUAL(value.balance, 350);
+    BOOST_CHECK_EQUAL(value.received, 550);
+    BOOST_CHECK_EQUAL(value.txCount, 2);
+
+    BOOST_CHECK(pblocktree->EraseAddressIndex(vect));
+    BOOST_CHECK(pblocktree->EraseAddressIndex(vect));
+    BOOST_CHECK(pblocktree->ReadAddressBalance(addressHash, 1, value));
+    BOOST_CHECK(value.IsNull());
+    BOOST_CHECK_EQUAL(value.balance, 0);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notificationqueue.h"
+
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(notificationqueue_tests, BasicTestingSetup)
+
+static CTransaction MakeTransaction(uint32_t nLockTime)
+{
+    CMutableTransaction tx;
+    tx.nLockTime = nLockTime;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(notificationqueue_order_and_batching)
+{
+    // Everything published is recorded as "tx<locktime>" or "block<n>", with
+    // the transactions of one batch joined by ','
+    std::vector<std::string> vPublished;
+    CNotificationQueue queue("test", [&vPublished](const std::vector<CTransaction>& vtx) {
+        std::string strBatch;
+        for (size_t i = 0; i < vtx.size(); i++)
+            strBatch += (i ? ",tx" : "tx") + std::to_string(vtx[i].nLockTime);
+        vPublished.push_back(strBatch);
+    }, 10, 2);
+
+    // Nothing is published before the queue is started, so everything below is
+    // queued at once like during a burst
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(1)));
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(2)));
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(3)));
+    BOOST_CHECK(queue.Push([&vPublished]() { vPublished.push_back("block1"); }));
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(4)));
+    BOOST_CHECK_EQUAL(queue.GetStats().nQueued, 4U);
+
+    queue.Start();
+    queue.Stop();
+
+    // Batches hold at most two transactions and never span another notification
+    BOOST_REQUIRE_EQUAL(vPublished.size(), 4U);
+    BOOST_CHECK_EQUAL(vPublished[0], "tx1,tx2");
+    BOOST_CHECK_EQUAL(vPublished[1], "tx3");
+    BOOST_CHECK_EQUAL(vPublished[2], "block1");
+    BOOST_CHECK_EQUAL(vPublished[3], "tx4");
+
+    CNotificationQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+    BOOST_CHECK_EQUAL(stats.nMaxQueued, 4U);
+    BOOST_CHECK_EQUAL(stats.nPublished, 4U);
+    BOOST_CHECK_EQUAL(stats.nTransactions, 4U);
+    BOOST_CHECK_EQUAL(stats.nDropped, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(notificationqueue_drop_when_full)
+{
+    int nPublished = 0;
+    CNotificationQueue queue("test", [&nPublished](const std::vector<CTransaction>& vtx) {
+        nPublished += vtx.size();
+    }, 2, 1);
+
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(1)));
+    BOOST_CHECK(queue.PushTransaction(MakeTransaction(2)));
+    BOOST_CHECK(!queue.PushTransaction(MakeTransaction(3)));
+    BOOST_CHECK(!queue.Push([&nPublished]() { nPublished += 100; }));
+
+    std::vector<CNotificationQueueStats> vStats = GetNotificationQueueStats();
+    BOOST_REQUIRE_EQUAL(vStats.size(), 1U);
+    BOOST_CHECK_EQUAL(vStats[0].name, "test");
+    BOOST_CHECK_EQUAL(vStats[0].nDropped, 2U);
+
+    queue.Start();
+    queue.Stop();
+    BOOST_CHECK_EQUAL(nPublished, 2);
+}
+
+BOOST_AUTO_TEST_CASE(notificationqueue_block_when_full)
+{
+    std::vector<int> vPublished;
+    CNotificationQueue queue("test", [](const std::vector<CTransaction>& vtx) {}, 1, 1, true);
+    BOOST_CHECK(queue.Push([&vPublished]() { vPublished.push_back(1); }));
+
+    // The queue is full, so this push waits until the publisher made room
+    bool fPushed = false;
+    boost::thread pusher([&queue, &vPublished, &fPushed]() {
+        fPushed = queue.Push([&vPublished]() { vPublished.push_back(2); });
+    });
+    while (queue.GetStats().nBlocked == 0)
+        MilliSleep(1);
+    BOOST_CHECK_EQUAL(queue.GetStats().nQueued, 1U);
+
+    queue.Start();
+    pusher.join();
+    BOOST_CHECK(fPushed);
+
+    // Stopping releases a caller that is still waiting, its notification is dropped
+    CNotificationQueue stopped("test", [](const std::vector<CTransaction>& vtx) {}, 1, 1, true);
+    BOOST_CHECK(stopped.Push([]() {}));
+    fPushed = true;
+    boost::thread waiter([&stopped, &fPushed]() { fPushed = stopped.Push([]() {}); });
+    while (stopped.GetStats().nBlocked == 0)
+        MilliSleep(1);
+    stopped.Stop();
+    waiter.join();
+    BOOST_CHECK(!fPushed);
+    BOOST_CHECK_EQUAL(stopped.GetStats().nDropped, 1U);
+
+    queue.Stop();
+    BOOST_REQUIRE_EQUAL(vPublished.size(), 2U);
+    BOOST_CHECK_EQUAL(vPublished[0], 1);
+    BOOST_CHECK_EQUAL(vPublished[1], 2);
+    CNotificationQueueStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocked, 1U);
+    BOOST_CHECK_EQUAL(stats.nDropped, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
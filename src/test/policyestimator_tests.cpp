@@ -3,12 +3,15 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "policy/fees.h"
+#include "clientversion.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
@@ -185,6 +188,72 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
 }
 
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimates_WriteRead)
+{
+    CTxMemPool mpool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    std::list<CTransaction> dummyConflicted;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+
+    // Fee transactions of increasing fee rates, where the cheaper ones wait longer
+    std::vector<uint256> txHashes[10];
+    std::vector<CTransaction> block;
+    int blocknum = 0;
+    while (blocknum < 100) {
+        for (int j = 0; j < 10; j++) {
+            for (int k = 0; k < 2; k++) {
+                tx.vin[0].prevout.n = 10000*blocknum+100*j+k;
+                uint256 hash = tx.GetHash();
+                mpool.addUnchecked(hash, entry.Fee(2000 * (j+1)).Time(GetTime()).Priority(0).Height(blocknum).FromTx(tx, &mpool));
+                txHashes[j].push_back(hash);
+            }
+        }
+        for (int h = 0; h <= blocknum%10; h++) {
+            while (txHashes[9-h].size()) {
+                CTransaction btx;
+                if (mpool.lookup(txHashes[9-h].back(), btx))
+                    block.push_back(btx);
+                txHashes[9-h].pop_back();
+            }
+        }
+        mpool.removeForBlock(block, ++blocknum, dummyConflicted);
+        block.clear();
+    }
+
+    boost::filesystem::path temp = GetTempPath() /
+        boost::filesystem::unique_path("fee_estimates-%%%%.dat");
+    {
+        CAutoFile fileout(fopen(temp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(mpool.WriteFeeEstimates(fileout));
+    }
+
+    // The stored moving averages don't depend on the estimator's internal weighting
+    CTxMemPool mpoolRead(CFeeRate(1000));
+    {
+        CAutoFile filein(fopen(temp.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(mpoolRead.ReadFeeEstimates(filein));
+    }
+    boost::filesystem::remove(temp);
+
+    bool fHaveEstimate = false;
+    for (unsigned int i = 1; i <= MAX_BLOCK_CONFIRMS; i++) {
+        CAmount nFee = mpool.estimateFee(i).GetFeePerK();
+        CAmount nFeeRead = mpoolRead.estimateFee(i).GetFeePerK();
+        BOOST_CHECK(nFeeRead <= nFee + 1 && nFeeRead + 1 >= nFee);
+        fHaveEstimate |= nFee > 0;
+    }
+    BOOST_CHECK(fHaveEstimate);
+
+    // Targets we don't track fail without touching the stats
+    BOOST_CHECK(mpoolRead.estimateFee(0) == CFeeRate(0));
+    BOOST_CHECK(mpoolRead.estimateFee(MAX_BLOCK_CONFIRMS + 1) == CFeeRate(0));
+    BOOST_CHECK_EQUAL(mpoolRead.estimatePriority(MAX_BLOCK_CONFIRMS + 1), -1);
+}
+
 BOOST_AUTO_TEST_CASE(TxConfirmStats_FindBucketIndex)
 {
     std::vector<double> buckets {0.0, 3.5, 42.0};
@@ -4,6 +4,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonwriter.h"
 
 #include "key_io.h"
 #include "main.h"
@@ -462,4 +463,62 @@ BOOST_AUTO_TEST_CASE(rpc_insightexplorer)
     fTimestampIndex = false;
 }
 
+BOOST_AUTO_TEST_CASE(rpc_jsonwriter)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("empty_obj", UniValue(UniValue::VOBJ)));
+    inner.push_back(Pair("empty_arr", UniValue(UniValue::VARR)));
+    inner.push_back(Pair("null", NullUniValue));
+    inner.push_back(Pair("quoted \"key\"", "line\nbreak"));
+    UniValue arr(UniValue::VARR);
+    arr.push_back(1);
+    arr.push_back(inner);
+    arr.push_back(UniValue(UniValue::VARR));
+    arr.push_back(false);
+    UniValue val(UniValue::VOBJ);
+    val.push_back(Pair("amount", ValueFromAmount(123456789)));
+    val.push_back(Pair("list", arr));
+    val.push_back(Pair("inner", inner));
+
+    // Whole value, written at once
+    for (size_t nChunkSize : {DEFAULT_JSON_CHUNK_SIZE, (size_t)1, (size_t)7}) {
+        std::string out;
+        size_t nChunks = 0;
+        auto sink = [&](std::string& chunk) { out += chunk; nChunks++; };
+        JSONWriter writer(sink, nChunkSize);
+        writer.value(val);
+        writer.flush();
+        BOOST_CHECK_EQUAL(out, val.write());
+        BOOST_CHECK(writer.pending().empty());
+        if (nChunkSize < 8)
+            BOOST_CHECK(nChunks > 1);
+        else
+            BOOST_CHECK_EQUAL(nChunks, 1);
+    }
+
+    // Same value, written element by element
+    std::string out;
+    size_t nChunks = 0;
+    auto sink = [&](std::string& chunk) { out += chunk; nChunks++; };
+    JSONWriter writer(sink, 16);
+    writer.beginObject();
+    writer.pushKV("amount", ValueFromAmount(123456789));
+    writer.key("list");
+    writer.beginArray();
+    for (size_t i = 0; i < arr.size(); i++)
+        writer.value(arr[i]);
+    writer.endArray();
+    writer.pushKV("inner", inner);
+    writer.endObject();
+    BOOST_CHECK(writer.flushed());
+    writer.flush();
+    BOOST_CHECK_EQUAL(out, val.write());
+
+    // Nothing is handed to the sink before a chunk is full
+    JSONWriter small(sink);
+    small.value(arr);
+    BOOST_CHECK(!small.flushed());
+    BOOST_CHECK_EQUAL(small.pending(), arr.write());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
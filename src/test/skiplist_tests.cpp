@@ -100,4 +100,53 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chainsnapshot_test)
+{
+    // Build a main chain 10000 blocks long, and a branch splitting off at block 4999.
+    std::vector<uint256> vHashMain(10000);
+    std::vector<CBlockIndex> vBlocksMain(10000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = ArithToUint256(i);
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+    }
+    std::vector<uint256> vHashSide(1000);
+    std::vector<CBlockIndex> vBlocksSide(1000);
+    for (unsigned int i=0; i<vBlocksSide.size(); i++) {
+        vHashSide[i] = ArithToUint256(i + 5000 + (arith_uint256(1) << 128));
+        vBlocksSide[i].nHeight = i + 5000;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[4999];
+        vBlocksSide[i].phashBlock = &vHashSide[i];
+        vBlocksSide[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+    CChainSnapshot snapshot(&vBlocksMain.back());
+    BOOST_CHECK_EQUAL(snapshot.Height(), chain.Height());
+    BOOST_CHECK(snapshot.Tip() == chain.Tip());
+    BOOST_CHECK(snapshot[-1] == NULL);
+    BOOST_CHECK(snapshot[10000] == NULL);
+
+    // A snapshot answers like the chain it was taken from
+    for (int n=0; n<1000; n++) {
+        int r = insecure_rand() % 11000;
+        CBlockIndex* pindex = (r < 10000) ? &vBlocksMain[r] : &vBlocksSide[r - 10000];
+        BOOST_CHECK(snapshot[pindex->nHeight] == chain[pindex->nHeight]);
+        BOOST_CHECK_EQUAL(snapshot.Contains(pindex), chain.Contains(pindex));
+        BOOST_CHECK(snapshot.Next(pindex) == chain.Next(pindex));
+    }
+
+    // and keeps doing so after the chain has moved on
+    chain.SetTip(&vBlocksSide.back());
+    BOOST_CHECK(snapshot.Contains(&vBlocksMain[9999]));
+    BOOST_CHECK(!snapshot.Contains(&vBlocksSide[0]));
+    BOOST_CHECK(snapshot.Next(&vBlocksMain[4999]) == &vBlocksMain[5000]);
+    BOOST_CHECK(snapshot.Next(&vBlocksMain[9999]) == NULL);
+    BOOST_CHECK(CChainSnapshot().Tip() == NULL);
+    BOOST_CHECK_EQUAL(CChainSnapshot().Height(), -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
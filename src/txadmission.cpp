@@ -0,0 +1,240 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txadmission.h"
+
+#include "chainparams.h"
+#include "consensus/upgrades.h"
+#include "main.h"
+#include "net.h"
+#include "script/interpreter.h"
+#include "txmempool.h"
+#include "util.h"
+
+CTxPrecheckCache txPrecheckCache;
+CTxAdmissionQueue txAdmissionQueue;
+
+void CTxPrecheckCache::Insert(const uint256& hash, int nHeight, const CValidationState& state)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        it->second.nHeight = nHeight;
+        it->second.state = state;
+        return;
+    }
+    // Verdicts are normally consumed right away by the commit stage; the
+    // oldest ones only linger for transactions that were never committed.
+    while (mapEntries.size() >= MAX_TXPRECHECK_CACHE_SIZE && !lInsertionOrder.empty()) {
+        mapEntries.erase(lInsertionOrder.front());
+        lInsertionOrder.pop_front();
+    }
+    lInsertionOrder.push_back(hash);
+    mapEntries.insert(std::make_pair(hash, Entry{nHeight, state, std::prev(lInsertionOrder.end())}));
+}
+
+bool CTxPrecheckCache::Contains(const uint256& hash, int nHeight) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = mapEntries.find(hash);
+    return it != mapEntries.end() && it->second.nHeight == nHeight;
+}
+
+bool CTxPrecheckCache::Take(const uint256& hash, int nHeight, CValidationState& state)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return false;
+    const bool fMatch = it->second.nHeight == nHeight;
+    if (fMatch)
+        state = it->second.state;
+    lInsertionOrder.erase(it->second.itOrder);
+    mapEntries.erase(it);
+    return fMatch;
+}
+
+void CTxPrecheckCache::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapEntries.clear();
+    lInsertionOrder.clear();
+}
+
+size_t CTxPrecheckCache::Size() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return mapEntries.size();
+}
+
+static void WarmSignatureCache(const CTransaction& tx, int nHeight)
+{
+    if (tx.IsCoinBase() || tx.vin.empty())
+        return;
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    {
+        // Short snapshot of the spent coins; the signatures are checked after
+        // the locks are released.
+        LOCK2(cs_main, mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        view.SetBackend(viewMemPool);
+        if (!view.HaveInputs(tx))
+            return;
+        view.SetBackend(dummy);
+    }
+
+    const uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    PrecomputedTransactionData txdata(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        boost::this_thread::interruption_point();
+        const CCoins* coins = view.AccessCoins(tx.vin[i].prevout.hash);
+        assert(coins);
+        CScriptCheck check(*coins, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true, consensusBranchId, &txdata);
+        if (!check())
+            return;
+    }
+}
+
+void PreValidateTransaction(const CTransaction& tx)
+{
+    const uint256 hash = tx.GetHash();
+    if (mempool.exists(hash))
+        return;
+
+    int nextBlockHeight;
+    {
+        LOCK(cs_main);
+        nextBlockHeight = chainActive.Height() + 1;
+    }
+    if (txPrecheckCache.Contains(hash, nextBlockHeight))
+        return;
+
+    CValidationState state;
+    auto verifier = libzcash::ProofVerifier::Strict();
+    if (CheckTransaction(tx, state, verifier)) {
+        // Same DoS level as AcceptToMemoryPool
+        ContextualCheckTransaction(tx, state, Params(), nextBlockHeight, 10);
+    }
+    txPrecheckCache.Insert(hash, nextBlockHeight, state);
+
+    if (state.IsValid())
+        WarmSignatureCache(tx, nextBlockHeight);
+}
+
+CTxAdmissionQueue::CTxAdmissionQueue() : fRunning(false)
+{
+}
+
+CTxAdmissionQueue::~CTxAdmissionQueue()
+{
+    Stop();
+}
+
+void CTxAdmissionQueue::Start(boost::thread_group& threadGroup, int nThreads, CommitFunction fnCommitIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (fRunning || nThreads <= 0)
+        return;
+    fnCommit = fnCommitIn;
+    for (int i = 0; i < nThreads; i++) {
+        vWorkers.emplace_back(new Worker());
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()>>, "txadm",
+                                              boost::function<void()>(boost::bind(&CTxAdmissionQueue::Thread, this, vWorkers.back().get()))));
+    }
+    fRunning = true;
+}
+
+void CTxAdmissionQueue::Stop()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fRunning = false;
+}
+
+bool CTxAdmissionQueue::IsRunning() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return fRunning;
+}
+
+CTxAdmissionQueue::PushResult CTxAdmissionQueue::Push(CNode* pfrom, const CTransaction& tx)
+{
+    Worker* worker = nullptr;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || vWorkers.empty())
+            return NOT_RUNNING;
+        worker = vWorkers[pfrom->GetId() % vWorkers.size()].get();
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(worker->cs);
+        if (worker->fExited)
+            return NOT_RUNNING;
+        // Neither wait for room, which would stall the message handler for
+        // every peer, nor process the transaction inline, which would overtake
+        // the ones of the same peer that are still queued.
+        if (worker->jobs.size() >= MAX_TXADMISSION_QUEUE_PER_WORKER)
+            return DROPPED;
+        worker->jobs.push_back(Job{pfrom->AddRef(), tx});
+    }
+    worker->cond.notify_one();
+    return QUEUED;
+}
+
+size_t CTxAdmissionQueue::Size() const
+{
+    std::vector<Worker*> workers;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        for (const auto& worker : vWorkers)
+            workers.push_back(worker.get());
+    }
+    size_t nSize = 0;
+    for (Worker* worker : workers) {
+        boost::unique_lock<boost::mutex> lock(worker->cs);
+        nSize += worker->jobs.size();
+    }
+    return nSize;
+}
+
+void CTxAdmissionQueue::Thread(Worker* worker)
+{
+    try {
+        while (true) {
+            Job job{nullptr, CTransaction()};
+            {
+                boost::unique_lock<boost::mutex> lock(worker->cs);
+                while (worker->jobs.empty())
+                    worker->cond.wait(lock);
+                job = worker->jobs.front();
+                worker->jobs.pop_front();
+            }
+
+            try {
+                if (!job.pfrom->fDisconnect) {
+                    PreValidateTransaction(job.tx);
+                    fnCommit(job.pfrom, job.tx);
+                }
+            } catch (const boost::thread_interrupted&) {
+                job.pfrom->Release();
+                throw;
+            } catch (const std::exception& e) {
+                // One bad transaction must not stop the admission of the others
+                LogPrintf("%s: admission of tx %s failed: %s\n", __func__, job.tx.GetHash().ToString(), e.what());
+            } catch (...) {
+                LogPrintf("%s: admission of tx %s failed: unknown exception\n", __func__, job.tx.GetHash().ToString());
+            }
+            job.pfrom->Release();
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(worker->cs);
+        for (Job& job : worker->jobs)
+            job.pfrom->Release();
+        worker->jobs.clear();
+        worker->fExited = true;
+        throw;
+    }
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXADMISSION_H
+#define BITCOIN_TXADMISSION_H
+
+#include "consensus/validation.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+class CNode;
+
+/** Maximum number of mempool pre-validation threads allowed */
+static const int MAX_TXADMISSION_THREADS = 16;
+/** -txadmissionthreads default (number of mempool pre-validation threads, 0 = validate inline) */
+static const int DEFAULT_TXADMISSION_THREADS = 2;
+/** Maximum number of transactions queued for pre-validation per worker */
+static const size_t MAX_TXADMISSION_QUEUE_PER_WORKER = 5000;
+/** Maximum number of pre-validation verdicts kept until the commit stage consumes them */
+static const size_t MAX_TXPRECHECK_CACHE_SIZE = 20000;
+
+/**
+ * Verdicts of the context-free and contextual transaction checks (including
+ * JoinSplit and Sapling proof verification) computed outside of cs_main.
+ * AcceptToMemoryPool consumes a verdict instead of re-running the checks
+ * when it was computed for the same next block height.
+ */
+class CTxPrecheckCache
+{
+public:
+    void Insert(const uint256& hash, int nHeight, const CValidationState& state);
+    bool Contains(const uint256& hash, int nHeight) const;
+    /** Look up and remove a verdict. Returns false if there is none for nHeight. */
+    bool Take(const uint256& hash, int nHeight, CValidationState& state);
+    void Clear();
+    size_t Size() const;
+
+private:
+    struct Entry {
+        int nHeight;
+        CValidationState state;
+        //! Position of the hash in lInsertionOrder
+        std::list<uint256>::iterator itOrder;
+    };
+
+    mutable boost::mutex cs;
+    std::map<uint256, Entry> mapEntries;
+    std::list<uint256> lInsertionOrder;
+};
+
+extern CTxPrecheckCache txPrecheckCache;
+
+/**
+ * Run the expensive, lock-free part of mempool admission for a transaction
+ * and record the verdict in txPrecheckCache. Transparent signatures are
+ * checked against a snapshot of the spent coins to warm the signature cache;
+ * their result is advisory only, the commit stage re-checks the inputs.
+ */
+void PreValidateTransaction(const CTransaction& tx);
+
+/**
+ * Two-stage mempool admission for transactions received from peers.
+ *
+ * Workers pre-validate transactions without holding cs_main and then run
+ * the short serialized commit stage, which takes cs_main and calls
+ * AcceptToMemoryPool. Transactions from one peer are always handled by the
+ * same worker, so the per-peer relay order is preserved.
+ */
+class CTxAdmissionQueue
+{
+public:
+    enum PushResult {
+        QUEUED,
+        //! The peer's worker is saturated, the transaction was not queued
+        DROPPED,
+        //! The queue is not running, the caller should process the transaction inline
+        NOT_RUNNING,
+    };
+
+    typedef boost::function<void(CNode*, const CTransaction&)> CommitFunction;
+
+    CTxAdmissionQueue();
+    ~CTxAdmissionQueue();
+
+    /** Start nThreads workers committing through fnCommit. Does nothing if nThreads <= 0. */
+    void Start(boost::thread_group& threadGroup, int nThreads, CommitFunction fnCommit);
+    /** Stop accepting new work. Workers exit when interrupted. */
+    void Stop();
+    bool IsRunning() const;
+
+    /**
+     * Queue a transaction received from pfrom. Takes a reference on pfrom
+     * that is released once the transaction was committed. Never blocks:
+     * while the peer's worker is saturated the transaction is dropped, so
+     * that the message handler keeps serving the other peers and the peer's
+     * queued transactions are not overtaken.
+     */
+    PushResult Push(CNode* pfrom, const CTransaction& tx);
+
+    /** Number of transactions waiting for pre-validation */
+    size_t Size() const;
+
+private:
+    struct Job {
+        CNode* pfrom;
+        CTransaction tx;
+    };
+
+    struct Worker {
+        boost::mutex cs;
+        boost::condition_variable cond;
+        std::deque<Job> jobs;
+        bool fExited = false;
+    };
+
+    void Thread(Worker* worker);
+
+    mutable boost::mutex cs;
+    bool fRunning;
+    CommitFunction fnCommit;
+    std::vector<std::unique_ptr<Worker>> vWorkers;
+};
+
+extern CTxAdmissionQueue txAdmissionQueue;
+
+#endif // BITCOIN_TXADMISSION_H
@@ -48,6 +48,7 @@ static const char DB_DISMISSVOTES = 'V';
 static const char DB_TEAM = 'T';
 // insightexplorer
 static const char DB_ADDRESSINDEX = 'd';
+static const char DB_ADDRESSBALANCEINDEX = 'e';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_TIMESTAMPINDEX = 'T';
@@ -378,10 +379,63 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::v
     return true;
 }
 
+// Visit the unspent outputs of the address of keyFrom, starting at keyFrom,
+// until fn returns false.
+bool CBlockTreeDB::ScanAddressUnspentIndex(const CAddressUnspentKey &keyFrom,
+        boost::function<bool(const CAddressUnspentDbEntry&)> fn)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, keyFrom));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressUnspentKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX &&
+              key.second.type == keyFrom.type && key.second.hashBytes == keyFrom.hashBytes))
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        if (!fn(make_pair(key.second, nValue)))
+            break;
+        pcursor->Next();
+    }
+    return true;
+}
+
+// Visit the address index entries of the address of keyFrom, starting at
+// keyFrom and up to height end (if positive), until fn returns false.
+bool CBlockTreeDB::ScanAddressIndex(const CAddressIndexKey &keyFrom, int end,
+        boost::function<bool(const CAddressIndexDbEntry&)> fn)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, keyFrom));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+              key.second.type == keyFrom.type && key.second.hashBytes == keyFrom.hashBytes))
+            break;
+        if (end > 0 && key.second.blockHeight > end)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        if (!fn(make_pair(key.second, nValue)))
+            break;
+        pcursor->Next();
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
     CDBBatch batch(*this);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    UpdateAddressBalanceIndex(batch, vect, false);
     return WriteBatch(batch);
 }
 
@@ -389,9 +443,106 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &ve
     CDBBatch batch(*this);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    UpdateAddressBalanceIndex(batch, vect, true);
     return WriteBatch(batch);
 }
 
+// Apply the entries of one block to the balance totals of their addresses, in
+// the same batch as the entries themselves so both stay consistent. Only
+// entries that are actually added (or removed) count, so indexing a block
+// again, e.g. when replaying after an unclean shutdown, leaves the totals as
+// they are.
+void CBlockTreeDB::UpdateAddressBalanceIndex(CDBBatch &batch, const std::vector<CAddressIndexDbEntry> &vect, bool fErase)
+{
+    struct CBalanceDelta {
+        CAmount balance = 0;
+        CAmount received = 0;
+        std::set<uint256> txids;
+    };
+    std::map<std::pair<unsigned int, uint160>, CBalanceDelta> mapDeltas;
+    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        // The batch is not visible yet, so this sees the index before the block.
+        if (Exists(make_pair(DB_ADDRESSINDEX, it->first)) != fErase)
+            continue;
+        CBalanceDelta &delta = mapDeltas[make_pair(it->first.type, it->first.hashBytes)];
+        delta.balance += it->second;
+        if (it->second > 0)
+            delta.received += it->second;
+        delta.txids.insert(it->first.txhash);
+    }
+
+    const int sign = fErase ? -1 : 1;
+    for (const auto &it : mapDeltas) {
+        const CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalanceValue value;
+        if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, key), value))
+            value.SetNull();
+        value.balance += sign * it.second.balance;
+        value.received += sign * it.second.received;
+        value.txCount += sign * (int64_t)it.second.txids.size();
+        if (value.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, key));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+        }
+    }
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value))
+        value.SetNull();
+    return true;
+}
+
+// Build the balance totals from the address index, for databases indexed
+// before they were maintained. Entries are sorted by address, so each address
+// is summed up and written before moving on to the next one.
+bool CBlockTreeDB::RebuildAddressBalanceIndex()
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    boost::scoped_ptr<CDBBatch> batch(new CDBBatch(*this));
+    CAddressIndexIteratorKey keyCurrent;
+    CAddressBalanceValue value;
+    uint256 lastTxHash;
+    size_t nAddresses = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        if (!fValid || key.second.type != keyCurrent.type || key.second.hashBytes != keyCurrent.hashBytes) {
+            if (!value.IsNull()) {
+                batch->Write(make_pair(DB_ADDRESSBALANCEINDEX, keyCurrent), value);
+                if (++nAddresses % 10000 == 0) {
+                    if (!WriteBatch(*batch))
+                        return false;
+                    batch.reset(new CDBBatch(*this));
+                }
+            }
+            if (!fValid)
+                break;
+            keyCurrent = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+            value.SetNull();
+            lastTxHash.SetNull();
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        // Entries of a transaction are adjacent, keyed by height, position and txid
+        if (key.second.txhash != lastTxHash)
+            value.txCount++;
+        lastTxHash = key.second.txhash;
+        pcursor->Next();
+    }
+    LogPrintf("%s: balances of %u addresses\n", __func__, nAddresses);
+    return WriteBatch(*batch);
+}
+
 bool CBlockTreeDB::ReadAddressIndex(
         uint160 addressHash, int type,
         std::vector<CAddressIndexDbEntry> &addressIndex,
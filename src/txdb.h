@@ -30,6 +30,7 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
 struct CTimestampIndexKey;
@@ -126,6 +127,12 @@ public:
     bool WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool ReadAddressIndex(uint160 addressHash, int type, std::vector<CAddressIndexDbEntry> &addressIndex, int start = 0, int end = 0);
+    bool ScanAddressUnspentIndex(const CAddressUnspentKey &keyFrom,
+            boost::function<bool(const CAddressUnspentDbEntry&)> fn);
+    bool ScanAddressIndex(const CAddressIndexKey &keyFrom, int end,
+            boost::function<bool(const CAddressIndexDbEntry&)> fn);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+    bool RebuildAddressBalanceIndex();
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
@@ -139,6 +146,9 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+private:
+    // insightexplorer
+    void UpdateAddressBalanceIndex(CDBBatch &batch, const std::vector<CAddressIndexDbEntry> &vect, bool fErase);
 };
 
 /** Access to the masternodes database (masternodes/) */
@@ -634,14 +634,13 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+// The estimator publishes its estimates once per block, reading them doesn't need cs
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
-    LOCK(cs);
     return minerPolicyEstimator->estimateFee(nBlocks);
 }
 double CTxMemPool::estimatePriority(int nBlocks) const
 {
-    LOCK(cs);
     return minerPolicyEstimator->estimatePriority(nBlocks);
 }
 
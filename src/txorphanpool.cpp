@@ -0,0 +1,256 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanpool.h"
+
+#include "util.h"
+#include "version.h"
+
+COrphanTxPool orphanTxPool;
+
+COrphanTxPool::COrphanTxPool() : nTotalBytes(0), nNextSweep(0)
+{
+}
+
+bool COrphanTxPool::AddTx(const CTransaction& tx, NodeId peer, int64_t nTime, unsigned int nMaxPerPeer)
+{
+    const uint256 hash = tx.GetHash();
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    const size_t sz = GetSerializeSize(tx, SER_NETWORK, tx.nVersion);
+    if (sz > MAX_ORPHAN_TX_SIZE)
+    {
+        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (mapOrphans.count(hash))
+        return false;
+
+    CPeerOrphans& peerOrphans = mapPeers[peer];
+    if (peerOrphans.setByTime.size() >= nMaxPerPeer)
+    {
+        LogPrint("mempool", "ignoring orphan tx %s, peer=%d reached its quota of %u\n", hash.ToString(), peer, nMaxPerPeer);
+        if (peerOrphans.setByTime.empty())
+            mapPeers.erase(peer);
+        return false;
+    }
+
+    mapOrphans.insert(std::make_pair(hash, COrphanTx{tx, peer, nTime, sz}));
+    for (const CTxIn& txin : tx.vin)
+        mapOrphansByPrev[txin.prevout.hash].insert(hash);
+    peerOrphans.setByTime.insert(std::make_pair(nTime, hash));
+    peerOrphans.nBytes += sz;
+    setByTime.insert(std::make_pair(nTime, hash));
+    nTotalBytes += sz;
+
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u bytes %u)\n", hash.ToString(),
+             mapOrphans.size(), mapOrphansByPrev.size(), nTotalBytes);
+    return true;
+}
+
+bool COrphanTxPool::HaveTx(const uint256& hash) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return mapOrphans.count(hash) != 0;
+}
+
+bool COrphanTxPool::EraseTx(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return EraseTxLocked(hash);
+}
+
+bool COrphanTxPool::EraseTxLocked(const uint256& hash)
+{
+    auto it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return false;
+    const COrphanTx& orphan = it->second;
+
+    for (const CTxIn& txin : orphan.tx.vin)
+    {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout.hash);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+
+    auto itPeer = mapPeers.find(orphan.fromPeer);
+    if (itPeer != mapPeers.end())
+    {
+        itPeer->second.setByTime.erase(std::make_pair(orphan.nTimeAdded, hash));
+        itPeer->second.nBytes -= orphan.nSize;
+        if (itPeer->second.setByTime.empty())
+            mapPeers.erase(itPeer);
+    }
+
+    setByTime.erase(std::make_pair(orphan.nTimeAdded, hash));
+    nTotalBytes -= orphan.nSize;
+    mapOrphans.erase(it);
+    return true;
+}
+
+unsigned int COrphanTxPool::EraseForPeer(NodeId peer)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end())
+        return 0;
+
+    // EraseTxLocked drops the peer entry together with its last orphan
+    std::vector<uint256> vErase;
+    for (const auto& entry : itPeer->second.setByTime)
+        vErase.push_back(entry.second);
+    for (const uint256& hash : vErase)
+        EraseTxLocked(hash);
+
+    LogPrint("mempool", "Erased %d orphan tx from peer %d\n", vErase.size(), peer);
+    return vErase.size();
+}
+
+void COrphanTxPool::EraseForBlock(const CBlock& block)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (mapOrphans.empty())
+        return;
+
+    std::vector<uint256> vErase;
+    for (const CTransaction& tx : block.vtx)
+    {
+        const uint256 hash = tx.GetHash();
+        if (mapOrphans.count(hash))
+            vErase.push_back(hash);
+        if (mapOrphansByPrev.count(hash))
+            setReadyParents.insert(hash);
+
+        // Orphans double spending the block's inputs can never be accepted
+        for (const CTxIn& txin : tx.vin)
+        {
+            auto itPrev = mapOrphansByPrev.find(txin.prevout.hash);
+            if (itPrev == mapOrphansByPrev.end())
+                continue;
+            for (const uint256& orphanHash : itPrev->second)
+            {
+                const CTransaction& orphanTx = mapOrphans[orphanHash].tx;
+                for (const CTxIn& orphanIn : orphanTx.vin)
+                {
+                    if (orphanIn.prevout == txin.prevout)
+                        vErase.push_back(orphanHash);
+                }
+            }
+        }
+    }
+
+    unsigned int nErased = 0;
+    for (const uint256& hash : vErase)
+        nErased += EraseTxLocked(hash) ? 1 : 0;
+    if (nErased > 0)
+        LogPrint("mempool", "Erased %d orphan tx included or conflicted by block\n", nErased);
+}
+
+unsigned int COrphanTxPool::Limit(unsigned int nMaxOrphans, int64_t nTime)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+
+    unsigned int nErased = 0;
+    if (nNextSweep <= nTime)
+    {
+        // Sweep orphans whose parents never showed up
+        const int64_t nMinTime = nTime - ORPHAN_TX_EXPIRE_TIME;
+        while (!setByTime.empty() && setByTime.begin()->first <= nMinTime)
+        {
+            EraseTxLocked(setByTime.begin()->second);
+            ++nErased;
+        }
+        nNextSweep = nTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0)
+            LogPrint("mempool", "Erased %d expired orphan tx\n", nErased);
+    }
+
+    unsigned int nEvicted = 0;
+    while (mapOrphans.size() > nMaxOrphans)
+    {
+        // Take from the peer using the most memory, so a flooding peer
+        // evicts its own orphans rather than those of everyone else
+        auto itHeaviest = mapPeers.begin();
+        for (auto it = mapPeers.begin(); it != mapPeers.end(); ++it)
+        {
+            if (it->second.nBytes > itHeaviest->second.nBytes)
+                itHeaviest = it;
+        }
+        assert(itHeaviest != mapPeers.end());
+        EraseTxLocked(itHeaviest->second.setByTime.begin()->second);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+std::vector<std::pair<CTransaction, NodeId>> COrphanTxPool::GetChildren(const uint256& parent) const
+{
+    std::vector<std::pair<CTransaction, NodeId>> vChildren;
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto itByPrev = mapOrphansByPrev.find(parent);
+    if (itByPrev == mapOrphansByPrev.end())
+        return vChildren;
+    for (const uint256& hash : itByPrev->second)
+    {
+        const COrphanTx& orphan = mapOrphans.at(hash);
+        vChildren.push_back(std::make_pair(orphan.tx, orphan.fromPeer));
+    }
+    return vChildren;
+}
+
+std::vector<uint256> COrphanTxPool::TakeReadyParents()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::vector<uint256> vParents(setReadyParents.begin(), setReadyParents.end());
+    setReadyParents.clear();
+    return vParents;
+}
+
+void COrphanTxPool::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapOrphans.clear();
+    mapOrphansByPrev.clear();
+    mapPeers.clear();
+    setByTime.clear();
+    setReadyParents.clear();
+    nTotalBytes = 0;
+    nNextSweep = 0;
+}
+
+size_t COrphanTxPool::Size() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return mapOrphans.size();
+}
+
+size_t COrphanTxPool::Bytes() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nTotalBytes;
+}
+
+size_t COrphanTxPool::PeerCount(NodeId peer) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = mapPeers.find(peer);
+    return it == mapPeers.end() ? 0 : it->second.setByTime.size();
+}
+
+size_t COrphanTxPool::PeerBytes(NodeId peer) const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    auto it = mapPeers.find(peer);
+    return it == mapPeers.end() ? 0 : it->second.nBytes;
+}
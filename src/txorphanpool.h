@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Crypticcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANPOOL_H
+#define BITCOIN_TXORPHANPOOL_H
+
+#include "net.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+/** Orphans larger than this are ignored, the sender is expected to rebroadcast them later */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Default for -maxorphantxperpeer, the maximum number of orphans kept from a single peer */
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_PER_PEER = 25;
+/** Orphans are dropped after this many seconds if their parents never arrived */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum interval in seconds between two sweeps of expired orphans */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions whose inputs are not known yet, kept until their parents
+ * arrive. The pool has its own lock so that peers flooding orphans don't
+ * contend on cs_main.
+ *
+ * Every orphan is indexed by the transactions it spends from, by the peer it
+ * came from and by its entry time. When the pool is full, the peer using the
+ * most bytes loses its oldest orphan first.
+ */
+class COrphanTxPool
+{
+public:
+    COrphanTxPool();
+
+    /**
+     * Add an orphan received from peer at nTime. Returns false if it is
+     * already known, too large or the peer reached nMaxPerPeer orphans.
+     */
+    bool AddTx(const CTransaction& tx, NodeId peer, int64_t nTime, unsigned int nMaxPerPeer);
+    bool HaveTx(const uint256& hash) const;
+    bool EraseTx(const uint256& hash);
+    /** Erase all orphans received from peer. Returns the number erased. */
+    unsigned int EraseForPeer(NodeId peer);
+    /**
+     * Erase the orphans included in or conflicting with a connected block, and
+     * remember the block transactions with orphan children for TakeReadyParents().
+     */
+    void EraseForBlock(const CBlock& block);
+
+    /**
+     * Drop orphans older than ORPHAN_TX_EXPIRE_TIME (at most every
+     * ORPHAN_TX_EXPIRE_INTERVAL seconds), then evict until at most
+     * nMaxOrphans remain. Returns the number of evicted orphans.
+     */
+    unsigned int Limit(unsigned int nMaxOrphans, int64_t nTime);
+
+    /** Copies of the orphans spending outputs of parent, with the peers they came from */
+    std::vector<std::pair<CTransaction, NodeId>> GetChildren(const uint256& parent) const;
+    /** Parents that were confirmed since the last call and have orphans waiting on them */
+    std::vector<uint256> TakeReadyParents();
+
+    void Clear();
+    size_t Size() const;
+    size_t Bytes() const;
+    size_t PeerCount(NodeId peer) const;
+    size_t PeerBytes(NodeId peer) const;
+
+private:
+    struct COrphanTx {
+        CTransaction tx;
+        NodeId fromPeer;
+        int64_t nTimeAdded;
+        size_t nSize;
+    };
+
+    struct CPeerOrphans {
+        size_t nBytes = 0;
+        std::set<std::pair<int64_t, uint256>> setByTime;
+    };
+
+    bool EraseTxLocked(const uint256& hash);
+
+    mutable boost::mutex cs;
+    std::map<uint256, COrphanTx> mapOrphans;
+    std::map<uint256, std::set<uint256>> mapOrphansByPrev;
+    std::map<NodeId, CPeerOrphans> mapPeers;
+    std::set<std::pair<int64_t, uint256>> setByTime;
+    std::set<uint256> setReadyParents;
+    size_t nTotalBytes;
+    int64_t nNextSweep;
+};
+
+extern COrphanTxPool orphanTxPool;
+
+#endif // BITCOIN_TXORPHANPOOL_H
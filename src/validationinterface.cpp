@@ -24,9 +24,15 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    g_signals.DposViceBlock.connect(boost::bind(&CValidationInterface::DposViceBlock, pwalletIn, _1, _2, _3));
+    g_signals.DposRoundQuorum.connect(boost::bind(&CValidationInterface::DposRoundQuorum, pwalletIn, _1, _2, _3, _4));
+    g_signals.DposTxCommitted.connect(boost::bind(&CValidationInterface::DposTxCommitted, pwalletIn, _1, _2));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    g_signals.DposTxCommitted.disconnect(boost::bind(&CValidationInterface::DposTxCommitted, pwalletIn, _1, _2));
+    g_signals.DposRoundQuorum.disconnect(boost::bind(&CValidationInterface::DposRoundQuorum, pwalletIn, _1, _2, _3, _4));
+    g_signals.DposViceBlock.disconnect(boost::bind(&CValidationInterface::DposViceBlock, pwalletIn, _1, _2, _3));
     g_signals.BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
     g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
@@ -41,6 +47,9 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_signals.DposTxCommitted.disconnect_all_slots();
+    g_signals.DposRoundQuorum.disconnect_all_slots();
+    g_signals.DposViceBlock.disconnect_all_slots();
     g_signals.BlockFound.disconnect_all_slots();
     g_signals.ScriptForMining.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
@@ -44,6 +44,9 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
+    virtual void DposViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound) {}
+    virtual void DposRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes) {}
+    virtual void DposTxCommitted(const uint256 &txid, const uint256 &tip) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -72,6 +75,12 @@ struct CMainSignals {
     boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /** Notifies listeners of a vice-block accepted by the dPoS voter (vice-block hash, tip, round) */
+    boost::signals2::signal<void (const uint256 &, const uint256 &, uint32_t)> DposViceBlock;
+    /** Notifies listeners that a vice-block got the quorum of round votes (tip, round, vice-block hash, votes) */
+    boost::signals2::signal<void (const uint256 &, uint32_t, const uint256 &, size_t)> DposRoundQuorum;
+    /** Notifies listeners that an instant transaction got the quorum of tx votes (txid, tip of the voting) */
+    boost::signals2::signal<void (const uint256 &, const uint256 &)> DposTxCommitted;
 };
 
 CMainSignals& GetMainSignals();
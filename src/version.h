@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 170007;
+static const int PROTOCOL_VERSION = 170009;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -33,4 +33,13 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 170004;
 
+//! dPoS inventory (heartbeats, vice-blocks and votes) is relayed to peers starting with this version
+static const int DPOS_INV_VERSION = 170007;
+
+//! "dpos_block" getdata requests and replies start with this version
+static const int DPOS_BLOCK_VERSION = 170008;
+
+//! short-id-based block download (compact blocks) starts with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 170009;
+
 #endif // BITCOIN_VERSION_H
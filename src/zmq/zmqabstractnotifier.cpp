@@ -11,7 +11,7 @@ CZMQAbstractNotifier::~CZMQAbstractNotifier()
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/, const CDiskBlockPos & /*pos*/)
 {
     return true;
 }
@@ -25,3 +25,27 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyTransactions(const std::vector<CTransaction> &vtx)
+{
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!NotifyTransaction(vtx[i]))
+            return false;
+    }
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyViceBlock(const uint256 &/*hash*/, const uint256 &/*tip*/, uint32_t /*nRound*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyRoundQuorum(const uint256 &/*tip*/, uint32_t /*nRound*/, const uint256 &/*viceBlockHash*/, size_t /*nVotes*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTxCommitted(const uint256 &/*txid*/, const uint256 &/*tip*/)
+{
+    return true;
+}
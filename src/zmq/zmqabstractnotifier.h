@@ -7,7 +7,10 @@
 
 #include "zmqconfig.h"
 
+#include <vector>
+
 class CBlockIndex;
+struct CDiskBlockPos;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -32,9 +35,15 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** New tip, pos is where the block is stored, read under cs_main when it was queued */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
     virtual bool NotifyBlock(const CBlock& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Transactions that were queued together, by default notified one by one */
+    virtual bool NotifyTransactions(const std::vector<CTransaction> &vtx);
+    virtual bool NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+    virtual bool NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+    virtual bool NotifyTxCommitted(const uint256 &txid, const uint256 &tip);
 
 protected:
     void *psocket;
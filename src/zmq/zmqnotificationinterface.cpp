@@ -7,15 +7,18 @@
 
 #include "version.h"
 #include "main.h"
+#include "notificationqueue.h"
 #include "streams.h"
 #include "util.h"
 
+#include <boost/bind.hpp>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), fPublishCheckedBlocks(false)
 {
 }
 
@@ -39,7 +42,11 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubrawtxbatch"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionBatchNotifier>;
     factories["pubcheckedblock"] = CZMQAbstractNotifier::Create<CZMQPublishCheckedBlockNotifier>;
+    factories["pubdposviceblock"] = CZMQAbstractNotifier::Create<CZMQPublishViceBlockNotifier>;
+    factories["pubdposroundquorum"] = CZMQAbstractNotifier::Create<CZMQPublishRoundQuorumNotifier>;
+    factories["pubdposinstanttx"] = CZMQAbstractNotifier::Create<CZMQPublishTxCommittedNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -91,6 +98,8 @@ bool CZMQNotificationInterface::Initialize()
         if (notifier->Initialize(pcontext))
         {
             LogPrint("zmq", "  Notifier %s ready (address = %s)\n", notifier->GetType(), notifier->GetAddress());
+            if (notifier->GetType() == "pubcheckedblock")
+                fPublishCheckedBlocks = true;
         }
         else
         {
@@ -104,6 +113,13 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    queue.reset(new CNotificationQueue("zmq",
+        boost::bind(&CZMQNotificationInterface::PublishTransactions, this, _1),
+        GetArg("-notifyqueuesize", DEFAULT_NOTIFY_QUEUE_SIZE),
+        GetArg("-notifytxbatch", DEFAULT_NOTIFY_TX_BATCH),
+        GetBoolArg("-notifyqueueblock", DEFAULT_NOTIFY_QUEUE_BLOCK)));
+    queue->Start();
+
     return true;
 }
 
@@ -111,6 +127,12 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (queue)
+    {
+        // Publish what is still queued before the sockets go away
+        queue->Stop();
+        queue.reset();
+    }
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -127,48 +149,57 @@ void CZMQNotificationInterface::Shutdown()
 
 void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    // Called without cs_main, take it here so the publisher never needs it
+    CDiskBlockPos pos;
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
     }
+    queue->Push(boost::bind(&CZMQNotificationInterface::PublishBlockTip, this, pindex, pos));
 }
 
 void CZMQNotificationInterface::BlockChecked(const CBlock& block, const CValidationState& state)
 {
-    if (state.IsInvalid()) {
+    if (state.IsInvalid() || !fPublishCheckedBlocks) {
         return;
     }
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(block))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    std::shared_ptr<const CBlock> pblock = std::make_shared<CBlock>(block);
+    queue->Push(boost::bind(&CZMQNotificationInterface::PublishCheckedBlock, this, pblock));
 }
 
 void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    queue->PushTransaction(tx);
+}
+
+void CZMQNotificationInterface::DposViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound)
+{
+    queue->Push([this, hash, tip, nRound]() {
+        Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyViceBlock(hash, tip, nRound); });
+    });
+}
+
+void CZMQNotificationInterface::DposRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes)
+{
+    queue->Push([this, tip, nRound, viceBlockHash, nVotes]() {
+        Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyRoundQuorum(tip, nRound, viceBlockHash, nVotes); });
+    });
+}
+
+void CZMQNotificationInterface::DposTxCommitted(const uint256 &txid, const uint256 &tip)
+{
+    queue->Push([this, txid, tip]() {
+        Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyTxCommitted(txid, tip); });
+    });
+}
+
+void CZMQNotificationInterface::Publish(const boost::function<bool(CZMQAbstractNotifier*)> &notify)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        if (notify(notifier))
         {
             i++;
         }
@@ -179,3 +210,18 @@ void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CB
         }
     }
 }
+
+void CZMQNotificationInterface::PublishBlockTip(const CBlockIndex *pindex, const CDiskBlockPos &pos)
+{
+    Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyBlock(pindex, pos); });
+}
+
+void CZMQNotificationInterface::PublishCheckedBlock(std::shared_ptr<const CBlock> pblock)
+{
+    Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyBlock(*pblock); });
+}
+
+void CZMQNotificationInterface::PublishTransactions(const std::vector<CTransaction> &vtx)
+{
+    Publish([&](CZMQAbstractNotifier *notifier) { return notifier->NotifyTransactions(vtx); });
+}
@@ -9,8 +9,14 @@
 #include "consensus/validation.h"
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/function.hpp>
 
 class CBlockIndex;
+struct CDiskBlockPos;
+class CNotificationQueue;
 class CZMQAbstractNotifier;
 
 class CZMQNotificationInterface : public CValidationInterface
@@ -28,12 +34,26 @@ protected:
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void BlockChecked(const CBlock& block, const CValidationState& state);
+    void DposViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+    void DposRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+    void DposTxCommitted(const uint256 &txid, const uint256 &tip);
 
 private:
     CZMQNotificationInterface();
 
+    // Run on the publisher thread of the queue
+    /** Pass a notification to every notifier, the ones that fail are shut down */
+    void Publish(const boost::function<bool(CZMQAbstractNotifier*)> &notify);
+    void PublishTransactions(const std::vector<CTransaction> &vtx);
+    void PublishBlockTip(const CBlockIndex *pindex, const CDiskBlockPos &pos);
+    void PublishCheckedBlock(std::shared_ptr<const CBlock> pblock);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! Notifications waiting to be published, the notifiers are only used from its thread
+    std::unique_ptr<CNotificationQueue> queue;
+    //! Whether checked blocks are published, they are only copied for the queue then
+    bool fPublishCheckedBlocks;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
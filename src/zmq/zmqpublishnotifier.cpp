@@ -5,6 +5,7 @@
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "notificationformat.h"
 #include "util.h"
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
@@ -13,6 +14,10 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_RAWTXBATCH = "rawtxbatch";
+static const char *MSG_DPOSVICEBLOCK = "dposviceblock";
+static const char *MSG_DPOSROUNDQUORUM = "dposroundquorum";
+static const char *MSG_DPOSINSTANTTX = "dposinstanttx";
 static const char *MSG_CHECKEDBLOCK = "checkedblock";
 
 // Internal function to send multipart message
@@ -141,7 +146,7 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -161,16 +166,16 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // No cs_main here, validation may be waiting for room in the queue while holding it
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     {
-        LOCK(cs_main);
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        if(!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != pindex->GetBlockHash())
         {
             zmqError("Can't read block from disk");
             return false;
@@ -186,11 +191,9 @@ bool CZMQPublishCheckedBlockNotifier::NotifyBlock(const CBlock& block)
 {
     LogPrint("zmq", "zmq: Publish checkedblock %s\n", block.GetHash().GetHex());
 
+    // The block is a copy owned by the notification queue, no lock needed
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        ss << block;
-    }
+    ss << block;
 
     return SendMessage(MSG_CHECKEDBLOCK, &(*ss.begin()), ss.size());
 }
@@ -203,3 +206,43 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishRawTransactionBatchNotifier::NotifyTransactions(const std::vector<CTransaction> &vtx)
+{
+    LogPrint("zmq", "zmq: Publish rawtxbatch of %u transactions\n", vtx.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << vtx;
+    return SendMessage(MSG_RAWTXBATCH, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishViceBlockNotifier::NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound)
+{
+    LogPrint("zmq", "zmq: Publish dposviceblock %s\n", hash.GetHex());
+    // vice-block hash, tip it is built on, round
+    unsigned char data[68];
+    unsigned char *p = WriteNotificationHash(data, hash);
+    p = WriteNotificationHash(p, tip);
+    WriteLE32(p, nRound);
+    return SendMessage(MSG_DPOSVICEBLOCK, data, sizeof(data));
+}
+
+bool CZMQPublishRoundQuorumNotifier::NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes)
+{
+    LogPrint("zmq", "zmq: Publish dposroundquorum %s\n", viceBlockHash.GetHex());
+    // vice-block hash, tip of the voting, round, number of votes
+    unsigned char data[72];
+    unsigned char *p = WriteNotificationHash(data, viceBlockHash);
+    p = WriteNotificationHash(p, tip);
+    WriteLE32(p, nRound);
+    WriteLE32(p + 4, (uint32_t)nVotes);
+    return SendMessage(MSG_DPOSROUNDQUORUM, data, sizeof(data));
+}
+
+bool CZMQPublishTxCommittedNotifier::NotifyTxCommitted(const uint256 &txid, const uint256 &tip)
+{
+    LogPrint("zmq", "zmq: Publish dposinstanttx %s\n", txid.GetHex());
+    // txid, tip of the voting that committed it
+    unsigned char data[64];
+    WriteNotificationHash(WriteNotificationHash(data, txid), tip);
+    return SendMessage(MSG_DPOSINSTANTTX, data, sizeof(data));
+}
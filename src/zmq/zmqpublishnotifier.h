@@ -31,7 +31,7 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -43,7 +43,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &pos);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,10 +52,34 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishRawTransactionBatchNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTransactions(const std::vector<CTransaction> &vtx);
+};
+
 class CZMQPublishCheckedBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
     bool NotifyBlock(const CBlock &block);
 };
 
+class CZMQPublishViceBlockNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyViceBlock(const uint256 &hash, const uint256 &tip, uint32_t nRound);
+};
+
+class CZMQPublishRoundQuorumNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyRoundQuorum(const uint256 &tip, uint32_t nRound, const uint256 &viceBlockHash, size_t nVotes);
+};
+
+class CZMQPublishTxCommittedNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTxCommitted(const uint256 &txid, const uint256 &tip);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H